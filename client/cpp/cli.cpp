@@ -15,6 +15,8 @@
 #include <fstream>
 
 #include "client/kvs_client.hpp"
+#include "kvs_threads.hpp"
+#include "metadata.pb.h"
 #include "yaml-cpp/yaml.h"
 
 #include <assert.h>
@@ -24,6 +26,17 @@ unsigned kRoutingThreadCount;
 ZmqUtil zmq_util;
 ZmqUtilInterface *kZmqUtil = &zmq_util;
 
+// Scans go to the routing threads' scan ports, which KvsClient does not talk
+// to, and their answers come back on a socket of their own.
+struct ScanClient {
+  vector<Address> routing_addresses_;
+  Address response_address_;
+  SocketCache *pushers_;
+  zmq::socket_t *puller_;
+  unsigned timeout_;
+  unsigned request_count_;
+};
+
 void print_set(set<string> set) {
   std::cout << "{ ";
   for (const string &val : set) {
@@ -33,7 +46,64 @@ void print_set(set<string> set) {
   std::cout << "}" << std::endl;
 }
 
-void handle_request(KvsClientInterface *client, string input) {
+// Prints the keys in [start, end) that begin with prefix, asking for a page
+// of at most limit keys at a time and resuming each page where the last one
+// stopped.
+void scan(ScanClient &scanner, const string &start, const string &end,
+          const string &prefix, unsigned limit) {
+  ScanRequest request;
+  request.set_response_address(scanner.response_address_);
+  request.set_start(start);
+  request.set_end(end);
+  request.set_prefix(prefix);
+  request.set_limit(limit);
+
+  vector<zmq::pollitem_t> pollitems = {
+      {static_cast<void *>(*scanner.puller_), 0, ZMQ_POLLIN, 0}};
+
+  unsigned count = 0;
+  bool incomplete = false;
+
+  do {
+    string rid = std::to_string(scanner.request_count_++);
+    request.set_request_id(rid);
+
+    // any routing thread can serve any page
+    Address address =
+        scanner.routing_addresses_[rand() % scanner.routing_addresses_.size()];
+
+    string serialized;
+    request.SerializeToString(&serialized);
+    kZmqUtil->send_string(serialized, &(*scanner.pushers_)[address]);
+
+    ScanResponse response;
+    do {
+      if (kZmqUtil->poll(scanner.timeout_, &pollitems) == 0) {
+        std::cout << "Scan timed out after " << count << " keys." << std::endl;
+        return;
+      }
+
+      response.ParseFromString(kZmqUtil->recv_string(scanner.puller_));
+    } while (response.request_id() != rid);
+
+    for (const Key &key : response.keys()) {
+      std::cout << key << std::endl;
+    }
+
+    count += response.keys_size();
+    incomplete |= response.incomplete();
+    request.set_continuation(response.continuation());
+  } while (!request.continuation().empty());
+
+  std::cout << count << " keys." << std::endl;
+  if (incomplete) {
+    std::cout << "Some storage threads did not answer; keys may be missing."
+              << std::endl;
+  }
+}
+
+void handle_request(KvsClientInterface *client, ScanClient &scanner,
+                    string input) {
   vector<string> v;
   split(input, ' ', v);
 
@@ -105,6 +175,30 @@ void handle_request(KvsClientInterface *client, string input) {
 
     KeyResponse response = responses[0];
 
+    if (response.response_id() != rid) {
+      std::cout << "Invalid response: ID did not match request ID!"
+                << std::endl;
+    }
+    if (response.error() == AnnaError::NO_ERROR) {
+      std::cout << "Success!" << std::endl;
+    } else {
+      std::cout << "Failure!" << std::endl;
+    }
+  } else if (v[0] == "DEL") {
+    // a delete is a put of an empty value, which the servers keep as a
+    // tombstone until it has reached every replica
+    Key key = v[1];
+    LWWPairLattice<string> val(
+        TimestampValuePair<string>(generate_timestamp(0), ""));
+
+    string rid = client->put_async(key, serialize(val), LatticeType::LWW);
+    vector<KeyResponse> responses = client->receive_async();
+    while (responses.size() == 0) {
+      responses = client->receive_async();
+    }
+
+    KeyResponse response = responses[0];
+
     if (response.response_id() != rid) {
       std::cout << "Invalid response: ID did not match request ID!"
                 << std::endl;
@@ -186,30 +280,43 @@ void handle_request(KvsClientInterface *client, string input) {
 
     SetLattice<string> latt = deserialize_set(responses[0].tuples(0).payload());
     print_set(latt.reveal());
+  } else if (v[0] == "SCAN") {
+    // SCAN <start> [end] [prefix] [limit]; an empty end runs to the last key
+    // and a limit of 0 takes the routing tier's default page size
+    if (v.size() < 2) {
+      std::cout << "Usage: SCAN <start> [end] [prefix] [limit]" << std::endl;
+      return;
+    }
+
+    string end = v.size() > 2 ? v[2] : "";
+    string prefix = v.size() > 3 ? v[3] : "";
+    unsigned limit = v.size() > 4 ? std::stoul(v[4]) : 0;
+
+    scan(scanner, v[1], end, prefix, limit);
   } else {
     std::cout << "Unrecognized command " << v[0]
-              << ". Valid commands are GET, GET_SET, PUT, PUT_SET, PUT_CAUSAL, "
-              << "and GET_CAUSAL." << std::endl;
+              << ". Valid commands are GET, GET_SET, PUT, PUT_SET, DEL, "
+              << "PUT_CAUSAL, GET_CAUSAL, and SCAN." << std::endl;
     ;
   }
 }
 
-void run(KvsClientInterface *client) {
+void run(KvsClientInterface *client, ScanClient &scanner) {
   string input;
   while (true) {
     std::cout << "kvs> ";
 
     getline(std::cin, input);
-    handle_request(client, input);
+    handle_request(client, scanner, input);
   }
 }
 
-void run(KvsClientInterface *client, string filename) {
+void run(KvsClientInterface *client, ScanClient &scanner, string filename) {
   string input;
   std::ifstream infile(filename);
 
   while (getline(infile, input)) {
-    handle_request(client, input);
+    handle_request(client, scanner, input);
   }
 }
 
@@ -240,17 +347,32 @@ int main(int argc, char *argv[]) {
   }
 
   vector<UserRoutingThread> threads;
+  vector<Address> scan_addresses;
   for (Address addr : routing_ips) {
     for (unsigned i = 0; i < kRoutingThreadCount; i++) {
       threads.push_back(UserRoutingThread(addr, i));
+      scan_addresses.push_back(RoutingThread(addr, i).scan_connect_address());
     }
   }
 
   KvsClient client(threads, ip, 0, 10000);
 
+  zmq::context_t context(1);
+  SocketCache pushers(&context, ZMQ_PUSH);
+  zmq::socket_t scan_puller(context, ZMQ_PULL);
+  scan_puller.bind(kBindBase + std::to_string(kUserScanResponsePort));
+
+  ScanClient scanner = {scan_addresses,
+                        "tcp://" + ip + ":" +
+                            std::to_string(kUserScanResponsePort),
+                        &pushers,
+                        &scan_puller,
+                        10000,
+                        0};
+
   if (argc == 2) {
-    run(&client);
+    run(&client, scanner);
   } else {
-    run(&client, argv[2]);
+    run(&client, scanner, argv[2]);
   }
 }
@@ -85,6 +85,21 @@ class BaseAnnaClient():
         '''
         raise NotImplementedError
 
+    def scan(self, start, end='', prefix='', limit=0):
+        '''
+        Lists the keys in a range, in key order.
+
+        start: The first key of the range
+        end: The key after the range; the range is unbounded if this is empty
+        prefix: If set, only keys that begin with it are returned
+        limit: The most keys to ask for in one round trip, or 0 for the
+        routing tier's default; the scan continues until the range is done
+
+        returns: The list of keys, and False if some servers did not answer in
+        time, so that keys may be missing, or True otherwise
+        '''
+        raise NotImplementedError
+
     @property
     def response_address(self):
         raise NotImplementedError
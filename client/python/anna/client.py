@@ -26,6 +26,8 @@ from anna.anna_pb2 import (
 )
 from anna.base_client import BaseAnnaClient
 from anna.common import UserThread
+from anna.lattices import LWWPairLattice
+from anna.metadata_pb2 import ScanRequest, ScanResponse
 from anna.zmq_util import (
     recv_response,
     send_request,
@@ -46,6 +48,8 @@ class AnnaTcpClient(BaseAnnaClient):
         always work
         elb_ports: The ports on which the routing tier will listen; use 6450 if
         running in local mode, otherwise do not change
+        scan_ports: The ports on which the routing tier will listen for key
+        range scans, one per routing thread as with elb_ports
         offset: A port numbering offset, which is only needed if multiple
         clients are running on the same machine
         '''
@@ -54,8 +58,10 @@ class AnnaTcpClient(BaseAnnaClient):
 
         if local:
             self.elb_ports = [6450]
+            self.scan_ports = [7450]
         else:
             self.elb_ports = list(range(6450, 6454))
+            self.scan_ports = list(range(7450, 7454))
 
         if ip:
             self.ut = UserThread(ip, offset)
@@ -74,6 +80,9 @@ class AnnaTcpClient(BaseAnnaClient):
         self.key_address_puller = self.context.socket(zmq.PULL)
         self.key_address_puller.bind(self.ut.get_key_address_bind_addr())
 
+        self.scan_puller = self.context.socket(zmq.PULL)
+        self.scan_puller.bind(self.ut.get_scan_response_bind_addr())
+
         self.rid = 0
 
     def get(self, keys):
@@ -204,6 +213,16 @@ class AnnaTcpClient(BaseAnnaClient):
 
         return results
 
+    # Deletes keys by writing them an empty LWW value with the given
+    # timestamp. The servers keep it as a tombstone, which hides earlier
+    # writes, until it has had time to reach every replica.
+    def delete(self, keys, timestamp):
+        if type(keys) != list:
+            keys = [keys]
+
+        return self.put(keys, [LWWPairLattice(timestamp, b'')
+                               for _ in keys])
+
     def put_all(self, key, value):
         worker_addresses = self._get_worker_address(key, False)
 
@@ -238,6 +257,42 @@ class AnnaTcpClient(BaseAnnaClient):
 
         return True
 
+    def scan(self, start, end='', prefix='', limit=0):
+        request = ScanRequest()
+        request.response_address = self.ut.get_scan_response_connect_addr()
+        request.start = start
+        request.end = end
+        request.prefix = prefix
+        request.limit = limit
+
+        keys = []
+        complete = True
+
+        # Each response is one page of the range; its continuation, if set,
+        # is sent back to get the page after it. Any routing thread can serve
+        # any page.
+        while True:
+            request.request_id = self._get_request_id()
+
+            port = random.choice(self.scan_ports)
+            dst_addr = 'tcp://' + self.elb_addr + ':' + str(port)
+            send_request(request, self.pusher_cache.get(dst_addr))
+
+            response = ScanResponse()
+            response.ParseFromString(self.scan_puller.recv())
+            while response.request_id != request.request_id:
+                response.Clear()
+                response.ParseFromString(self.scan_puller.recv())
+
+            keys.extend(response.keys)
+            if response.incomplete:
+                complete = False
+
+            if not response.continuation:
+                return keys, complete
+
+            request.continuation = response.continuation
+
     # Returns the worker address for a particular key. If worker addresses for
     # that key are not cached locally, a query is synchronously issued to the
     # routing tier, and the address cache is updated.
@@ -15,6 +15,7 @@
 # Define port offsets for KVS and routing ports
 REQUEST_PULLING_BASE_PORT = 6460
 KEY_ADDRESS_BASE_PORT = 6760
+SCAN_RESPONSE_BASE_PORT = 7550
 
 
 class Thread():
@@ -44,3 +45,9 @@ class UserThread(Thread):
 
     def get_key_address_bind_addr(self):
         return self._base + str(self.tid + KEY_ADDRESS_BASE_PORT)
+
+    def get_scan_response_connect_addr(self):
+        return self._ip_base + str(self.tid + SCAN_RESPONSE_BASE_PORT)
+
+    def get_scan_response_bind_addr(self):
+        return self._base + str(self.tid + SCAN_RESPONSE_BASE_PORT)
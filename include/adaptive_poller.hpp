@@ -0,0 +1,92 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_ADAPTIVE_POLLER_HPP_
+#define INCLUDE_ADAPTIVE_POLLER_HPP_
+
+#include "kvs_types.hpp"
+#include "zmq/zmq_util.hpp"
+
+// Polls the sockets of an event loop without keeping a core busy while the
+// loop is idle. For a spin window after the last event, it polls without
+// blocking, so that a burst of requests does not pay for a wakeup per
+// request; once the window has passed with nothing to do, it blocks until a
+// socket is ready or the loop's next periodic work is due. A negative spin
+// window never blocks, for latency benchmarks that can spare a core per
+// thread.
+class AdaptivePoller {
+  int spin_us_;
+  SteadyTimePoint last_event_;
+
+  // the time the last poll returned, which the loop uses as the current time
+  SteadyTimePoint now_;
+
+  // the time spent blocked in poll, in microseconds, since the last reset
+  unsigned long long blocked_us_;
+
+public:
+  AdaptivePoller(int spin_us)
+      : spin_us_(spin_us), last_event_(std::chrono::steady_clock::now()),
+        now_(last_event_), blocked_us_(0) {}
+
+  // Polls items, blocking until deadline at the latest once the spin window
+  // has passed, or for as long as it takes if the deadline is
+  // SteadyTimePoint::max(). Returns the number of items that are ready.
+  int poll(vector<zmq::pollitem_t> *items, const SteadyTimePoint &deadline) {
+    SteadyTimePoint start;
+    long timeout = 0;
+
+    // the time of the last poll stands in for the current time here, so a
+    // busy loop reads the clock once per pass
+    if (spin_us_ >= 0 &&
+        now_ - last_event_ >= std::chrono::microseconds(spin_us_)) {
+      start = std::chrono::steady_clock::now();
+
+      if (deadline == SteadyTimePoint::max()) {
+        timeout = -1;
+      } else {
+        // poll timeouts are in milliseconds; rounding up wakes the loop just
+        // after the deadline rather than spinning up to it
+        long long wait = std::chrono::duration_cast<std::chrono::microseconds>(
+                             deadline - start)
+                             .count();
+        timeout = wait > 0 ? (wait + 999) / 1000 : 0;
+      }
+    }
+
+    int ready = kZmqUtil->poll(timeout, items);
+    now_ = std::chrono::steady_clock::now();
+
+    if (timeout != 0) {
+      blocked_us_ +=
+          std::chrono::duration_cast<std::chrono::microseconds>(now_ - start)
+              .count();
+    }
+
+    if (ready > 0) {
+      last_event_ = now_;
+    }
+
+    return ready;
+  }
+
+  // the time the last poll returned
+  const SteadyTimePoint &now() const { return now_; }
+
+  unsigned long long blocked_time() const { return blocked_us_; }
+
+  void reset_counters() { blocked_us_ = 0; }
+};
+
+#endif // INCLUDE_ADAPTIVE_POLLER_HPP_
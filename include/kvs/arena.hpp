@@ -0,0 +1,134 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_ARENA_HPP_
+#define INCLUDE_KVS_ARENA_HPP_
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Define the size of each chunk an arena requests from the system allocator
+const std::size_t kDefaultArenaChunkSize = 1 << 20; // 1 MB
+
+// A bump allocator that carves allocations out of large chunks. Memory is
+// only returned to the system when the arena is destroyed. Arenas are not
+// thread-safe; each server thread owns its own.
+class Arena {
+public:
+  explicit Arena(std::size_t chunk_size = kDefaultArenaChunkSize)
+      : chunk_size_(chunk_size), cur_(nullptr), end_(nullptr),
+        bytes_reserved_(0) {}
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  ~Arena() {
+    for (char *chunk : chunks_) {
+      ::operator delete(chunk);
+    }
+  }
+
+  void *allocate(std::size_t bytes,
+                 std::size_t align = alignof(std::max_align_t)) {
+    std::size_t pad = padding(cur_, align);
+
+    if (cur_ == nullptr || cur_ + pad + bytes > end_) {
+      // oversized requests get a dedicated chunk so that we don't waste the
+      // remainder of the current one
+      std::size_t size = bytes + align > chunk_size_ ? bytes + align
+                                                      : chunk_size_;
+      char *chunk = static_cast<char *>(::operator new(size));
+      chunks_.push_back(chunk);
+      bytes_reserved_ += size;
+
+      if (size != chunk_size_) {
+        return chunk + padding(chunk, align);
+      }
+
+      cur_ = chunk;
+      end_ = chunk + size;
+      pad = padding(cur_, align);
+    }
+
+    char *result = cur_ + pad;
+    cur_ = result + bytes;
+    return result;
+  }
+
+  // the number of bytes this arena has requested from the system allocator
+  std::size_t bytes_reserved() const { return bytes_reserved_; }
+
+private:
+  static std::size_t padding(const char *ptr, std::size_t align) {
+    std::size_t misalign = reinterpret_cast<std::size_t>(ptr) & (align - 1);
+    return misalign == 0 ? 0 : align - misalign;
+  }
+
+  std::size_t chunk_size_;
+  std::vector<char *> chunks_;
+  char *cur_;
+  char *end_;
+  std::size_t bytes_reserved_;
+};
+
+// A fixed-size object pool layered on top of an Arena. Destroyed objects are
+// threaded onto an intrusive free list and their slots are reused by later
+// allocations, so a store with a stable working set does not grow its arena.
+template <typename T> class ArenaPool {
+  union Node {
+    Node *next;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+public:
+  explicit ArenaPool(std::size_t chunk_size = kDefaultArenaChunkSize)
+      : arena_(chunk_size), free_list_(nullptr), live_(0) {}
+
+  template <typename... Args> T *create(Args &&... args) {
+    void *mem;
+
+    if (free_list_ != nullptr) {
+      mem = free_list_;
+      free_list_ = free_list_->next;
+    } else {
+      mem = arena_.allocate(sizeof(Node), alignof(Node));
+    }
+
+    live_ += 1;
+    return new (mem) T(std::forward<Args>(args)...);
+  }
+
+  void destroy(T *obj) {
+    obj->~T();
+
+    Node *node = reinterpret_cast<Node *>(obj);
+    node->next = free_list_;
+    free_list_ = node;
+    live_ -= 1;
+  }
+
+  std::size_t live_objects() const { return live_; }
+
+  std::size_t bytes_reserved() const { return arena_.bytes_reserved(); }
+
+private:
+  Arena arena_;
+  Node *free_list_;
+  std::size_t live_;
+};
+
+#endif // INCLUDE_KVS_ARENA_HPP_
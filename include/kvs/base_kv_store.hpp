@@ -15,31 +15,86 @@
 #ifndef INCLUDE_KVS_BASE_KV_STORE_HPP_
 #define INCLUDE_KVS_BASE_KV_STORE_HPP_
 
+#include <unordered_map>
+
 #include "anna.pb.h"
+#include "lattice_bytes.hpp"
 #include "lattices/core_lattices.hpp"
 
 template <typename K, typename V> class KVStore {
 protected:
-  MapLattice<K, V> db;
+  struct Entry {
+    V value;
+
+    // the encoded form of value, empty until it is read after a merge
+    string serialized;
+  };
+
+  std::unordered_map<K, Entry> db;
 
 public:
   KVStore<K, V>() {}
 
-  KVStore<K, V>(MapLattice<K, V> &other) { db = other; }
+  KVStore<K, V>(MapLattice<K, V> &other) {
+    for (const auto &pair : other.reveal()) {
+      db[pair.first].value = pair.second;
+    }
+  }
 
   V get(const K &k, AnnaError &error) {
-    if (!db.contains(k).reveal()) {
+    auto it = db.find(k);
+
+    if (it == db.end()) {
       error = AnnaError::KEY_DNE;
+      return V();
+    }
+
+    return it->second.value;
+  }
+
+  void put(const K &k, const V &v) {
+    Entry &entry = db[k];
+    entry.value.merge(v);
+
+    // the buffer is kept, so re-encoding a hot key does not allocate
+    entry.serialized.clear();
+  }
+
+  unsigned size(const K &k) {
+    auto it = db.find(k);
+    return it == db.end() ? 0 : it->second.value.size().reveal();
+  }
+
+  // the bytes of memory k's entry holds: its map node, key and value, and
+  // the buffer its encoding is cached in
+  unsigned bytes(const K &k) {
+    auto it = db.find(k);
+    if (it == db.end()) {
+      return 0;
     }
 
-    return db.at(k);
+    return kContainerNodeOverhead + string_bytes(k) +
+           lattice_bytes(it->second.value) +
+           string_bytes(it->second.serialized);
   }
 
-  void put(const K &k, const V &v) { return db.at(k).merge(v); }
+  void remove(const K &k) { db.erase(k); }
 
-  unsigned size(const K &k) { return db.at(k).size().reveal(); }
+  // the cached encoding of k's value, or nullptr if it has been merged since
+  // it was last encoded
+  const string *serialized(const K &k) const {
+    auto it = db.find(k);
+    return it == db.end() || it->second.serialized.empty()
+               ? nullptr
+               : &it->second.serialized;
+  }
 
-  void remove(const K &k) { db.remove(k); }
+  void cache_serialized(const K &k, const string &serialized) {
+    auto it = db.find(k);
+    if (it != db.end()) {
+      it->second.serialized = serialized;
+    }
+  }
 };
 
 #endif // INCLUDE_KVS_BASE_KV_STORE_HPP_
@@ -0,0 +1,112 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_BLOOM_FILTER_HPP_
+#define INCLUDE_KVS_BLOOM_FILTER_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "types.hpp"
+
+// The number of counters kept per expected key; with kBloomHashCount hashes
+// this gives a false positive rate of about 1%
+const unsigned kBloomCountersPerKey = 10;
+
+// The number of counters each key maps to
+const unsigned kBloomHashCount = 7;
+
+// The smallest number of keys a filter is sized for
+const std::size_t kBloomMinKeys = 1024;
+
+// A counting Bloom filter over keys. Each key increments kBloomHashCount
+// one-byte counters, so keys can be removed again as long as every remove is
+// paired with an earlier insert of the same key. A counter that saturates is
+// never decremented, which can only cause false positives.
+class CountingBloomFilter {
+public:
+  CountingBloomFilter(std::size_t expected_keys)
+      : counters_(std::max(expected_keys, kBloomMinKeys) *
+                      kBloomCountersPerKey,
+                  0),
+        capacity_(std::max(expected_keys, kBloomMinKeys)), size_(0) {}
+
+  void insert(const Key &key) {
+    std::size_t h1, h2;
+    hash(key, h1, h2);
+
+    for (unsigned i = 0; i < kBloomHashCount; i++) {
+      uint8_t &counter = counters_[(h1 + i * h2) % counters_.size()];
+      if (counter != UINT8_MAX) {
+        counter += 1;
+      }
+    }
+
+    size_ += 1;
+  }
+
+  void remove(const Key &key) {
+    std::size_t h1, h2;
+    hash(key, h1, h2);
+
+    for (unsigned i = 0; i < kBloomHashCount; i++) {
+      uint8_t &counter = counters_[(h1 + i * h2) % counters_.size()];
+      if (counter != UINT8_MAX && counter != 0) {
+        counter -= 1;
+      }
+    }
+
+    size_ -= 1;
+  }
+
+  // false means the key was definitely never inserted (or has been removed)
+  bool may_contain(const Key &key) const {
+    std::size_t h1, h2;
+    hash(key, h1, h2);
+
+    for (unsigned i = 0; i < kBloomHashCount; i++) {
+      if (counters_[(h1 + i * h2) % counters_.size()] == 0) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // the number of keys the filter was sized for
+  std::size_t capacity() const { return capacity_; }
+
+  // the number of keys currently in the filter
+  std::size_t size() const { return size_; }
+
+private:
+  // double hashing: the i-th counter of a key is h1 + i * h2
+  static void hash(const Key &key, std::size_t &h1, std::size_t &h2) {
+    uint64_t h = std::hash<Key>{}(key);
+    h1 = static_cast<std::size_t>(h);
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h2 = static_cast<std::size_t>(h) | 1;
+  }
+
+  std::vector<uint8_t> counters_;
+  std::size_t capacity_;
+  std::size_t size_;
+};
+
+#endif // INCLUDE_KVS_BLOOM_FILTER_HPP_
@@ -0,0 +1,515 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_DISK_IO_HPP_
+#define INCLUDE_KVS_DISK_IO_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+
+#include "hash_ring.hpp"
+#include "key_interner.hpp"
+#include "server_utils.hpp"
+#include "thread_affinity.hpp"
+#include "value_compression.hpp"
+
+// Serializes access to a serializer that is shared between the event loop and
+// the disk I/O thread. All the serializers of a thread share one mutex, since
+// they share one storage backend.
+class LockedSerializer final : public Serializer {
+  Serializer *serializer_;
+  std::mutex *mutex_;
+
+public:
+  LockedSerializer(Serializer *serializer, std::mutex *mutex)
+      : serializer_(serializer), mutex_(mutex) {}
+
+  string get(const Key &key, AnnaError &error) {
+    std::lock_guard<std::mutex> lock(*mutex_);
+    return serializer_->get(key, error);
+  }
+
+  unsigned put(const Key &key, const string &serialized) {
+    std::lock_guard<std::mutex> lock(*mutex_);
+    return serializer_->put(key, serialized);
+  }
+
+  void remove(const Key &key) {
+    std::lock_guard<std::mutex> lock(*mutex_);
+    serializer_->remove(key);
+  }
+};
+
+// What a disk operation does once the I/O thread has run it
+enum class DiskTarget {
+  // fills in a tuple of a user response
+  RESPONSE,
+  // adds the value to a gossip message
+  GOSSIP,
+  // a write or remove from background work, which only updates the key's
+  // bookkeeping
+  NONE
+};
+
+enum class DiskOperationType { GET, PUT, REMOVE };
+
+// A single GET, PUT or REMOVE on one key, executed by the disk I/O thread
+struct DiskOperation {
+  DiskOperationType type_;
+  Key key_;
+  LatticeType lattice_type_;
+  string payload_;
+
+  // which response or gossip message this operation belongs to, and which
+  // tuple of it
+  DiskTarget target_;
+  unsigned long long response_id_;
+  int tuple_index_;
+
+  // whether a GET decompresses the value, as clients and caches expect
+  bool unpack_;
+
+  // results, filled in by the I/O thread
+  string result_;
+  AnnaError error_;
+  unsigned size_;
+};
+
+// A user response that is waiting for its disk operations to finish
+struct PendingDiskResponse {
+  KeyResponse response_;
+  Address response_address_;
+  unsigned outstanding_;
+};
+
+// A gossip message that is waiting for the values it carries to be read
+struct PendingDiskGossip {
+  KeyRequest request_;
+  Address address_;
+  unsigned outstanding_;
+};
+
+// Moves the disk reads and writes of a disk thread off the event loop. The
+// request handler stages one operation per tuple and then defers the response;
+// gossip reads and background writes and removes are queued directly. A
+// dedicated I/O thread runs the operations in submission order, so operations
+// on the same key are applied in the order the event loop issued them, and a
+// read sees every write queued before it. Completions are signaled on an
+// eventfd that the event loop polls next to its sockets, and a response or
+// gossip message is sent once all of its operations have finished. When it
+// has nothing queued, the I/O thread runs the thread's idle work, such as
+// compacting the log store.
+class AsyncDiskIO {
+public:
+  // idle_work runs on the I/O thread while no operations are queued, and
+  // returns whether it has more to do; it is rerun after every write. The
+  // I/O thread runs on cpus if they are given, and otherwise on the CPUs of
+  // the thread that creates it.
+  AsyncDiskIO(const SerializerMap &serializers,
+              std::function<bool()> idle_work = nullptr,
+              const cpu_set_t *cpus = nullptr)
+      : serializers_(serializers), idle_work_(idle_work),
+        next_response_id_(0), stop_(false),
+        idle_pending_(idle_work != nullptr), submitted_count_(0),
+        executed_count_(0) {
+    event_fd_ = eventfd(0, EFD_NONBLOCK);
+    if (event_fd_ == -1) {
+      std::cerr << "Failed to create disk I/O eventfd" << std::endl;
+    }
+
+    thread_ = std::thread(&AsyncDiskIO::run, this);
+
+    if (cpus != nullptr) {
+      set_thread_cpus(thread_, *cpus);
+    }
+  }
+
+  AsyncDiskIO(const AsyncDiskIO &) = delete;
+  AsyncDiskIO &operator=(const AsyncDiskIO &) = delete;
+
+  ~AsyncDiskIO() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+
+    submitted_cv_.notify_one();
+    thread_.join();
+    close(event_fd_);
+  }
+
+  // the file descriptor the event loop polls for completions
+  int completion_fd() const { return event_fd_; }
+
+  // Stages a GET whose result goes into tuple tuple_index of the response
+  // that is currently being built
+  void get(const Key &key, LatticeType lattice_type, int tuple_index) {
+    staged_.push_back(operation(DiskOperationType::GET, key, lattice_type, "",
+                                DiskTarget::RESPONSE, tuple_index, true));
+  }
+
+  // Stages a PUT whose result goes into tuple tuple_index of the response
+  // that is currently being built
+  void put(const Key &key, LatticeType lattice_type, const string &payload,
+           int tuple_index) {
+    staged_.push_back(operation(DiskOperationType::PUT, key, lattice_type,
+                                payload, DiskTarget::RESPONSE, tuple_index,
+                                false));
+  }
+
+  // Submits the staged operations on behalf of response. Returns false if
+  // nothing was staged, in which case the caller sends the response itself.
+  bool defer(const KeyResponse &response, const Address &response_address) {
+    if (staged_.size() == 0) {
+      return false;
+    }
+
+    unsigned long long response_id = next_response_id_++;
+    pending_responses_[response_id] = {response, response_address,
+                                       (unsigned)staged_.size()};
+
+    for (DiskOperation &op : staged_) {
+      op.response_id_ = response_id;
+    }
+
+    submit(staged_);
+    return true;
+  }
+
+  // Queues a write from background work (gossip, replication); the key's
+  // size is recorded once it completes
+  void queue_put(const Key &key, LatticeType lattice_type,
+                 const string &payload) {
+    vector<DiskOperation> ops = {operation(DiskOperationType::PUT, key,
+                                           lattice_type, payload,
+                                           DiskTarget::NONE, 0, false)};
+    submit(ops);
+  }
+
+  // Queues the removal of a key whose bookkeeping is already gone
+  void queue_remove(const Key &key, LatticeType lattice_type) {
+    vector<DiskOperation> ops = {operation(DiskOperationType::REMOVE, key,
+                                           lattice_type, "", DiskTarget::NONE,
+                                           0, false)};
+    submit(ops);
+  }
+
+  // Reads the stored values of the keys for each address on the I/O thread,
+  // and sends them as a gossip message once they are all read; with unpack,
+  // values are decompressed first, for caches
+  void gossip(const AddressKeysetMap &addr_keyset_map,
+              const map<Key, KeyProperty> &stored_key_map, bool unpack,
+              SocketCache &pushers) {
+    vector<DiskOperation> ops;
+
+    for (const auto &key_pair : addr_keyset_map) {
+      unsigned long long gossip_id = next_response_id_++;
+      PendingDiskGossip &pending = pending_gossip_[gossip_id];
+      pending.request_.set_type(RequestType::PUT);
+      pending.address_ = key_pair.first;
+      pending.outstanding_ = 0;
+
+      for (const Key &key : key_pair.second) {
+        auto it = stored_key_map.find(key);
+        if (it == stored_key_map.end()) {
+          continue;
+        }
+
+        DiskOperation op =
+            operation(DiskOperationType::GET, key, it->second.type_, "",
+                      DiskTarget::GOSSIP, 0, unpack);
+        op.response_id_ = gossip_id;
+        ops.push_back(std::move(op));
+        pending.outstanding_ += 1;
+      }
+
+      if (pending.outstanding_ == 0) {
+        send_gossip(gossip_id, pushers);
+      }
+    }
+
+    submit(ops);
+  }
+
+  // Blocks until every operation submitted so far has run, so that a read
+  // on the event loop sees the writes queued before it
+  void wait_until_idle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    unsigned long long target = submitted_count_;
+    executed_cv_.wait(lock,
+                      [this, target] { return executed_count_ >= target; });
+  }
+
+  // Fills finished operations into their responses and gossip messages,
+  // records the new sizes of the keys that were written, and sends every
+  // response and message that is complete. A key that was removed while its
+  // write was in flight stays removed: its removal was queued behind the
+  // write.
+  void process_completions(map<Key, KeyProperty> &stored_key_map,
+                           unsigned long long &storage_consumption,
+                           KeyHandleSet &local_changeset, SocketCache &pushers) {
+    // the count only wakes the event loop, so a failed read (nothing
+    // signaled yet) still collects whatever has completed
+    uint64_t count;
+    if (read(event_fd_, &count, sizeof(count)) != sizeof(count)) {
+      count = 0;
+    }
+
+    std::deque<DiskOperation> completed;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      completed.swap(completed_);
+    }
+
+    for (DiskOperation &op : completed) {
+      if (op.type_ == DiskOperationType::PUT) {
+        auto it = stored_key_map.find(op.key_);
+
+        if (it != stored_key_map.end()) {
+          KeyProperty &property = it->second;
+          storage_consumption =
+              storage_consumption - property.size_ + op.size_;
+          property.size_ = op.size_;
+          property.type_ = op.lattice_type_;
+
+          // background writes are not gossiped on
+          if (op.target_ == DiskTarget::RESPONSE) {
+            local_changeset.insert(op.key_);
+          }
+        }
+      }
+
+      if (op.target_ == DiskTarget::RESPONSE) {
+        PendingDiskResponse &pending = pending_responses_[op.response_id_];
+        KeyTuple *tp = pending.response_.mutable_tuples(op.tuple_index_);
+
+        if (op.type_ == DiskOperationType::GET) {
+          tp->set_payload(std::move(op.result_));
+          tp->set_error(op.error_);
+        }
+
+        pending.outstanding_ -= 1;
+        if (pending.outstanding_ == 0) {
+          if (pending.response_address_ != "") {
+            string serialized;
+            pending.response_.SerializeToString(&serialized);
+            kZmqUtil->send_string(serialized,
+                                  &pushers[pending.response_address_]);
+          }
+
+          pending_responses_.erase(op.response_id_);
+        }
+      } else if (op.target_ == DiskTarget::GOSSIP) {
+        PendingDiskGossip &pending = pending_gossip_[op.response_id_];
+
+        // LWW tombstones read as KEY_DNE, but are gossiped like any other
+        // value so that deletes reach every replica
+        if (op.error_ == AnnaError::NO_ERROR ||
+            (op.lattice_type_ == LatticeType::LWW &&
+             op.error_ == AnnaError::KEY_DNE && !op.result_.empty())) {
+          prepare_put_tuple(pending.request_, op.key_, op.lattice_type_,
+                            op.result_);
+        }
+
+        pending.outstanding_ -= 1;
+        if (pending.outstanding_ == 0) {
+          send_gossip(op.response_id_, pushers);
+        }
+      }
+    }
+  }
+
+private:
+  DiskOperation operation(DiskOperationType type, const Key &key,
+                          LatticeType lattice_type, const string &payload,
+                          DiskTarget target, int tuple_index, bool unpack) {
+    DiskOperation op;
+    op.type_ = type;
+    op.key_ = key;
+    op.lattice_type_ = lattice_type;
+    op.payload_ = payload;
+    op.target_ = target;
+    op.response_id_ = 0;
+    op.tuple_index_ = tuple_index;
+    op.unpack_ = unpack;
+    op.error_ = AnnaError::NO_ERROR;
+    op.size_ = 0;
+
+    return op;
+  }
+
+  void submit(vector<DiskOperation> &ops) {
+    if (ops.empty()) {
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (DiskOperation &op : ops) {
+        submitted_.push_back(std::move(op));
+      }
+
+      submitted_count_ += ops.size();
+    }
+
+    ops.clear();
+    submitted_cv_.notify_one();
+  }
+
+  void send_gossip(unsigned long long gossip_id, SocketCache &pushers) {
+    PendingDiskGossip &pending = pending_gossip_[gossip_id];
+
+    string serialized;
+    pending.request_.SerializeToString(&serialized);
+    kZmqUtil->send_string(serialized, &pushers[pending.address_]);
+
+    pending_gossip_.erase(gossip_id);
+  }
+
+  // the body of the I/O thread
+  void run() {
+    while (true) {
+      std::deque<DiskOperation> batch;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        submitted_cv_.wait(lock, [this] {
+          return stop_ || !submitted_.empty() || idle_pending_;
+        });
+
+        if (stop_) {
+          return;
+        }
+
+        if (submitted_.empty()) {
+          // idle work runs in small steps, so that operations queued in the
+          // meantime wait for one step at most
+          lock.unlock();
+          bool more = idle_work_();
+          lock.lock();
+
+          idle_pending_ = more;
+          continue;
+        }
+
+        batch.swap(submitted_);
+      }
+
+      bool wrote = false;
+
+      for (DiskOperation &op : batch) {
+        Serializer *serializer = serializers_[op.lattice_type_];
+
+        if (op.type_ == DiskOperationType::GET) {
+          // values are decompressed here rather than on the event loop
+          op.result_ = serializer->get(op.key_, op.error_);
+          if (op.unpack_) {
+            op.result_ = kValueCompressor.unpack(op.lattice_type_,
+                                                 std::move(op.result_));
+          }
+        } else if (op.type_ == DiskOperationType::PUT) {
+          op.size_ = serializer->put(op.key_, op.payload_);
+          wrote = true;
+        } else {
+          serializer->remove(op.key_);
+          wrote = true;
+        }
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        executed_count_ += batch.size();
+
+        for (DiskOperation &op : batch) {
+          // removes have nothing to report
+          if (op.type_ != DiskOperationType::REMOVE ||
+              op.target_ != DiskTarget::NONE) {
+            completed_.push_back(std::move(op));
+          }
+        }
+
+        if (wrote && idle_work_ != nullptr) {
+          idle_pending_ = true;
+        }
+      }
+
+      executed_cv_.notify_all();
+
+      uint64_t count = 1;
+      if (write(event_fd_, &count, sizeof(count)) != sizeof(count)) {
+        std::cerr << "Failed to signal disk I/O completion" << std::endl;
+      }
+    }
+  }
+
+  // a copy of the serializers, which must be safe to call from the I/O thread
+  SerializerMap serializers_;
+  std::function<bool()> idle_work_;
+
+  // only touched by the event loop
+  vector<DiskOperation> staged_;
+  map<unsigned long long, PendingDiskResponse> pending_responses_;
+  map<unsigned long long, PendingDiskGossip> pending_gossip_;
+  unsigned long long next_response_id_;
+
+  // shared with the I/O thread, guarded by mutex_
+  std::mutex mutex_;
+  std::condition_variable submitted_cv_;
+  std::condition_variable executed_cv_;
+  std::deque<DiskOperation> submitted_;
+  std::deque<DiskOperation> completed_;
+  bool stop_;
+  bool idle_pending_;
+  unsigned long long submitted_count_;
+  unsigned long long executed_count_;
+
+  int event_fd_;
+  std::thread thread_;
+};
+
+// Hands the writes and removes of the event loop's background work (gossip,
+// replication, expiry, joins) to the disk I/O thread, so that a slow volume
+// does not stall the loop. A put returns a size of 0; the key's size is
+// recorded when the write completes. Reads wait for the queued operations to
+// finish first, so they see every earlier write; they are left to rare
+// paths, such as a departing thread handing off its keys.
+class QueuedSerializer final : public Serializer {
+  Serializer *serializer_;
+  LatticeType lattice_type_;
+  AsyncDiskIO *disk_io_;
+
+public:
+  QueuedSerializer(Serializer *serializer, LatticeType lattice_type,
+                   AsyncDiskIO *disk_io)
+      : serializer_(serializer), lattice_type_(lattice_type),
+        disk_io_(disk_io) {}
+
+  string get(const Key &key, AnnaError &error) {
+    disk_io_->wait_until_idle();
+    return serializer_->get(key, error);
+  }
+
+  unsigned put(const Key &key, const string &serialized) {
+    disk_io_->queue_put(key, lattice_type_, serialized);
+    return 0;
+  }
+
+  void remove(const Key &key) { disk_io_->queue_remove(key, lattice_type_); }
+};
+
+#endif // INCLUDE_KVS_DISK_IO_HPP_
@@ -0,0 +1,459 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_FILE_STORE_HPP_
+#define INCLUDE_KVS_FILE_STORE_HPP_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "bloom_filter.hpp"
+#include "types.hpp"
+
+// A bounded set of open file descriptors, keyed by the key whose file they
+// refer to, that closes the least recently used descriptor when it is full.
+class DescriptorCache {
+  typedef std::list<std::pair<Key, int>> EntryList;
+
+public:
+  DescriptorCache(std::size_t capacity) : capacity_(capacity) {}
+
+  DescriptorCache(const DescriptorCache &) = delete;
+  DescriptorCache &operator=(const DescriptorCache &) = delete;
+
+  ~DescriptorCache() {
+    for (const auto &entry : entries_) {
+      close(entry.second);
+    }
+  }
+
+  // returns the cached descriptor for key, or -1
+  int get(const Key &key) {
+    auto it = index_.find(key);
+
+    if (it == index_.end()) {
+      return -1;
+    }
+
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->second;
+  }
+
+  // hands fd over to the cache, which must have a nonzero capacity
+  void put(const Key &key, int fd) {
+    while (entries_.size() >= capacity_) {
+      close(entries_.back().second);
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+
+    entries_.push_front({key, fd});
+    index_[key] = entries_.begin();
+  }
+
+  // closes the descriptor cached for key, if there is one
+  void remove(const Key &key) {
+    auto it = index_.find(key);
+
+    if (it != index_.end()) {
+      close(it->second->second);
+      entries_.erase(it->second);
+      index_.erase(it);
+    }
+  }
+
+  std::size_t capacity() const { return capacity_; }
+
+  std::size_t size() const { return entries_.size(); }
+
+private:
+  std::size_t capacity_;
+  EntryList entries_;
+  std::unordered_map<Key, EntryList::iterator> index_;
+};
+
+// The original disk engine: every key is stored in its own file, named after
+// the key. Files are spread over a two-level fan-out of 256 x 256
+// directories, picked by a hash of the key, so that no directory grows large
+// enough to slow down lookups. Descriptors of recently used files are kept
+// open, and a counting Bloom filter over the stored keys answers most lookups
+// of absent keys without touching the filesystem.
+class FileStore {
+  string root_;
+  CountingBloomFilter *filter_;
+  DescriptorCache descriptors_;
+
+  // the directory of a key's file, relative to the root, e.g. "3f/a0/"; the
+  // hash is FNV-1a with a final mix, so that keys differing only in their
+  // last characters still spread over both levels, and the layout does not
+  // depend on the standard library
+  static string shard(const Key &key) {
+    uint32_t hash = 2166136261u;
+    for (char c : key) {
+      hash = (hash ^ (unsigned char)c) * 16777619u;
+    }
+
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+
+    static const char digits[] = "0123456789abcdef";
+    string dir = "xx/xx/";
+    dir[0] = digits[(hash >> 28) & 0xf];
+    dir[1] = digits[(hash >> 24) & 0xf];
+    dir[3] = digits[(hash >> 20) & 0xf];
+    dir[4] = digits[(hash >> 16) & 0xf];
+    return dir;
+  }
+
+  static bool is_directory(const string &dir, const struct dirent *entry) {
+    if (entry->d_type != DT_UNKNOWN) {
+      return entry->d_type == DT_DIR;
+    }
+
+    struct stat st;
+    return stat((dir + entry->d_name).c_str(), &st) == 0 &&
+           S_ISDIR(st.st_mode);
+  }
+
+  // calls visit(name, is_directory) for every entry of a directory other
+  // than . and ..
+  template <typename Visit>
+  static void for_each_entry(const string &dir, Visit visit) {
+    DIR *handle = opendir(dir.c_str());
+
+    if (handle == nullptr) {
+      return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != nullptr) {
+      string name = entry->d_name;
+      if (name != "." && name != "..") {
+        visit(name, is_directory(dir, entry));
+      }
+    }
+
+    closedir(handle);
+  }
+
+  //! Compute the name of the file that stores a value for a given key
+  string fname(const Key &key) const { return root_ + shard(key) + key; }
+
+  // creates the directories of a key's shard
+  bool make_shard(const Key &key) {
+    string dir = root_ + shard(key);
+
+    for (std::size_t end : {dir.find('/', root_.size()), dir.size() - 1}) {
+      if (mkdir(dir.substr(0, end).c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Failed to create directory " << dir.substr(0, end)
+                  << std::endl;
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // rebuilds the filter from the files in the shards, sized for twice as
+  // many keys as there are now
+  void rebuild_filter() {
+    vector<Key> keys;
+
+    for_each_entry(root_, [this, &keys](const string &outer, bool is_dir) {
+      if (!is_dir) {
+        return;
+      }
+
+      for_each_entry(root_ + outer + "/", [this, &keys, &outer](
+                                              const string &inner,
+                                              bool is_dir) {
+        if (!is_dir) {
+          return;
+        }
+
+        for_each_entry(root_ + outer + "/" + inner + "/",
+                       [&keys](const string &name, bool is_dir) {
+                         if (!is_dir) {
+                           keys.push_back(name);
+                         }
+                       });
+      });
+    });
+
+    delete filter_;
+    filter_ = new CountingBloomFilter(keys.size() * 2);
+
+    for (const Key &key : keys) {
+      filter_->insert(key);
+    }
+  }
+
+  // opens the file of a key for reading and writing, returning -1 if it
+  // does not exist and create is false; created is set if this call made
+  // the file
+  int open_file(const Key &key, bool create, bool &created) {
+    created = false;
+
+    int fd = descriptors_.get(key);
+    if (fd != -1) {
+      return fd;
+    }
+
+    string path = fname(key);
+    fd = open(path.c_str(), O_RDWR);
+
+    if (fd == -1 && errno == ENOENT && create) {
+      // O_EXCL tells us whether this put creates the key, which is when it
+      // has to be added to the filter
+      fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+
+      if (fd == -1 && errno == ENOENT && make_shard(key)) {
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+      }
+
+      created = fd != -1;
+    }
+
+    if (fd != -1 && descriptors_.capacity() > 0) {
+      descriptors_.put(key, fd);
+    }
+
+    return fd;
+  }
+
+  // closes fd unless the descriptor cache owns it
+  void release(int fd) {
+    if (descriptors_.capacity() == 0) {
+      close(fd);
+    }
+  }
+
+  static bool write_fully(int fd, const string &value, uint64_t offset) {
+    std::size_t written = 0;
+
+    while (written < value.size()) {
+      ssize_t count = pwrite(fd, value.data() + written,
+                             value.size() - written, offset + written);
+      if (count < 0 && errno == EINTR) {
+        continue;
+      } else if (count <= 0) {
+        std::cerr << "Failed to write payload." << std::endl;
+        return false;
+      }
+
+      written += count;
+    }
+
+    return true;
+  }
+
+public:
+  FileStore(const string &root, std::size_t descriptor_capacity = 0)
+      : root_(root), filter_(nullptr), descriptors_(descriptor_capacity) {
+    if (root_.back() != '/') {
+      root_ += "/";
+    }
+
+    if (mkdir(root_.c_str(), 0755) != 0 && errno != EEXIST) {
+      std::cerr << "Failed to create directory " << root_ << std::endl;
+    }
+
+    unsigned moved = migrate(root_);
+    if (moved > 0) {
+      std::cerr << "Moved " << moved << " files in " << root_
+                << " into the sharded layout" << std::endl;
+    }
+
+    rebuild_filter();
+  }
+
+  FileStore(const FileStore &) = delete;
+  FileStore &operator=(const FileStore &) = delete;
+
+  ~FileStore() { delete filter_; }
+
+  // Moves files stored directly in root, by the flat layout older versions
+  // used, into their shards. Returns the number of files moved. The files
+  // are first set aside in a staging directory, since a flat file named
+  // like a shard (e.g. "3f") would otherwise block that shard's creation;
+  // an interrupted migration is finished by the next call.
+  static unsigned migrate(string root) {
+    if (root.back() != '/') {
+      root += "/";
+    }
+
+    string staging = root + ".migrating/";
+    if (mkdir(staging.c_str(), 0755) != 0 && errno != EEXIST) {
+      std::cerr << "Failed to create directory " << staging << std::endl;
+      return 0;
+    }
+
+    for_each_entry(root, [&root, &staging](const string &name, bool is_dir) {
+      if (!is_dir &&
+          rename((root + name).c_str(), (staging + name).c_str()) != 0) {
+        std::cerr << "Failed to move " << root + name << std::endl;
+      }
+    });
+
+    vector<Key> keys;
+    for_each_entry(staging, [&keys](const string &name, bool is_dir) {
+      if (!is_dir) {
+        keys.push_back(name);
+      }
+    });
+
+    unsigned moved = 0;
+
+    for (const Key &key : keys) {
+      string dir = root + shard(key);
+      mkdir(dir.substr(0, root.size() + 2).c_str(), 0755);
+      mkdir(dir.c_str(), 0755);
+
+      if (rename((staging + key).c_str(), (dir + key).c_str()) != 0) {
+        std::cerr << "Failed to move " << staging + key << std::endl;
+      } else {
+        moved += 1;
+      }
+    }
+
+    rmdir(staging.c_str());
+    return moved;
+  }
+
+  // returns false if the key is not stored
+  bool get(const Key &key, string &value) {
+    uint64_t total;
+    return get_prefix(key, std::numeric_limits<std::size_t>::max(), value,
+                      total);
+  }
+
+  // reads at most the first size bytes of a key's value, and sets total to
+  // the value's full size; returns false if the key is not stored
+  bool get_prefix(const Key &key, std::size_t size, string &value,
+                  uint64_t &total) {
+    if (!filter_->may_contain(key)) {
+      return false;
+    }
+
+    bool created;
+    int fd = open_file(key, false, created);
+
+    if (fd == -1) {
+      return false;
+    }
+
+    struct stat st;
+    bool success = fstat(fd, &st) == 0;
+
+    if (success) {
+      total = st.st_size;
+      value.resize(std::min(size, (std::size_t)st.st_size));
+      std::size_t offset = 0;
+
+      while (offset < value.size()) {
+        ssize_t count =
+            pread(fd, &value[offset], value.size() - offset, offset);
+        if (count < 0 && errno == EINTR) {
+          continue;
+        } else if (count <= 0) {
+          std::cerr << "Failed to read payload." << std::endl;
+          success = false;
+          break;
+        }
+
+        offset += count;
+      }
+    }
+
+    release(fd);
+    return success;
+  }
+
+  void put(const Key &key, const string &value) {
+    bool created;
+    int fd = open_file(key, true, created);
+
+    if (fd == -1) {
+      std::cerr << "Failed to open file" << std::endl;
+      return;
+    }
+
+    if (created) {
+      filter_->insert(key);
+    }
+
+    write_fully(fd, value, 0);
+
+    // drop whatever was left of a longer previous value
+    if (ftruncate(fd, value.size()) == -1) {
+      std::cerr << "Failed to truncate file" << std::endl;
+    }
+
+    release(fd);
+
+    if (filter_->size() > filter_->capacity()) {
+      rebuild_filter();
+    }
+  }
+
+  // Appends bytes to the end of a key's value without rewriting it, and sets
+  // size to the value's new size. Returns false if the key is not stored.
+  bool extend(const Key &key, const string &bytes, uint64_t &size) {
+    if (!filter_->may_contain(key)) {
+      return false;
+    }
+
+    bool created;
+    int fd = open_file(key, false, created);
+
+    if (fd == -1) {
+      return false;
+    }
+
+    struct stat st;
+    bool success = fstat(fd, &st) == 0 && write_fully(fd, bytes, st.st_size);
+
+    if (success) {
+      size = st.st_size + bytes.size();
+    }
+
+    release(fd);
+    return success;
+  }
+
+  void remove(const Key &key) {
+    descriptors_.remove(key);
+
+    if (std::remove(fname(key).c_str()) != 0) {
+      std::cerr << "Error deleting file" << std::endl;
+    } else {
+      filter_->remove(key);
+    }
+  }
+};
+
+#endif // INCLUDE_KVS_FILE_STORE_HPP_
@@ -0,0 +1,319 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_FLAT_KV_STORE_HPP_
+#define INCLUDE_KVS_FLAT_KV_STORE_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "anna.pb.h"
+#include "arena.hpp"
+#include "lattice_bytes.hpp"
+#include "lattices/core_lattices.hpp"
+
+// The number of control bytes that are probed together
+const std::size_t kFlatGroupWidth = 16;
+
+// The minimum number of slots in a FlatKVStore index
+const std::size_t kFlatMinCapacity = 16;
+
+// A KVStore replacement that keeps every (key, value) entry in a per-thread
+// arena and indexes the entries with an open-addressing hash table in the
+// style of Swiss tables: a dense array of one-byte control tags (7 bits of
+// the hash, or an empty/deleted marker) is probed one 16-byte group at a
+// time, and only slots whose tag matches are compared against the key. It
+// exposes the same interface as KVStore, so the memory serializers can be
+// instantiated over either.
+template <typename K, typename V> class FlatKVStore {
+  struct Entry {
+    Entry(const K &k) : key(k) {}
+
+    K key;
+    V value;
+
+    // the encoded form of value, empty until it is read after a merge
+    string serialized;
+  };
+
+  typedef int8_t ctrl_t;
+
+  // control byte markers; full slots hold a 7-bit hash tag instead
+  enum : ctrl_t {
+    kEmpty = -128, // 0b10000000
+    kDeleted = -2  // 0b11111110
+  };
+
+public:
+  FlatKVStore<K, V>() : size_(0), tombstones_(0) {
+    resize(kFlatMinCapacity);
+  }
+
+  FlatKVStore<K, V>(const FlatKVStore<K, V> &) = delete;
+  FlatKVStore<K, V> &operator=(const FlatKVStore<K, V> &) = delete;
+
+  ~FlatKVStore() {
+    for (std::size_t i = 0; i < capacity(); i++) {
+      if (is_full(ctrl_[i])) {
+        pool_.destroy(slots_[i]);
+      }
+    }
+  }
+
+  V get(const K &k, AnnaError &error) {
+    Entry *entry = find(k);
+
+    if (entry == nullptr) {
+      error = AnnaError::KEY_DNE;
+      return V();
+    }
+
+    return entry->value;
+  }
+
+  void put(const K &k, const V &v) {
+    Entry *entry = find_or_insert(k);
+    entry->value.merge(v);
+
+    // the buffer is kept, so re-encoding a hot key does not allocate
+    entry->serialized.clear();
+  }
+
+  unsigned size(const K &k) {
+    Entry *entry = find(k);
+    return entry == nullptr ? 0 : entry->value.size().reveal();
+  }
+
+  // the bytes of memory k's entry holds: its slot and control byte, and the
+  // arena entry with the key, value and the buffer its encoding is cached in
+  unsigned bytes(const K &k) {
+    Entry *entry = find(k);
+    if (entry == nullptr) {
+      return 0;
+    }
+
+    return sizeof(Entry *) + sizeof(ctrl_t) + sizeof(Entry) - sizeof(V) +
+           string_heap_bytes(entry->key) + lattice_bytes(entry->value) +
+           string_heap_bytes(entry->serialized);
+  }
+
+  void remove(const K &k) {
+    std::size_t hash = hash_key(k);
+    std::size_t index;
+
+    if (probe(k, hash, index)) {
+      pool_.destroy(slots_[index]);
+      set_ctrl(index, kDeleted);
+      size_ -= 1;
+      tombstones_ += 1;
+    }
+  }
+
+  // the cached encoding of k's value, or nullptr if it has been merged since
+  // it was last encoded
+  const string *serialized(const K &k) {
+    Entry *entry = find(k);
+    return entry == nullptr || entry->serialized.empty() ? nullptr
+                                                         : &entry->serialized;
+  }
+
+  void cache_serialized(const K &k, const string &serialized) {
+    Entry *entry = find(k);
+    if (entry != nullptr) {
+      entry->serialized = serialized;
+    }
+  }
+
+  // the number of keys currently stored
+  std::size_t key_count() const { return size_; }
+
+  // the number of bytes held by the index and the entry arena
+  std::size_t bytes_reserved() const {
+    return ctrl_.capacity() * sizeof(ctrl_t) +
+           slots_.capacity() * sizeof(Entry *) + pool_.bytes_reserved();
+  }
+
+private:
+  std::size_t capacity() const { return slots_.size(); }
+
+  static bool is_full(ctrl_t c) { return c >= 0; }
+
+  static std::size_t hash_key(const K &k) {
+    // std::hash is the identity for integral types, so mix the bits before we
+    // split the hash into a probe position and a tag
+    uint64_t h = std::hash<K>{}(k);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return static_cast<std::size_t>(h);
+  }
+
+  static std::size_t h1(std::size_t hash) { return hash >> 7; }
+
+  static ctrl_t h2(std::size_t hash) { return hash & 0x7f; }
+
+  // returns a bitmask of the positions in the group starting at index whose
+  // control byte equals c
+  uint32_t match(std::size_t index, ctrl_t c) const {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(ctrl_.data() + index));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#else
+    uint32_t mask = 0;
+    for (std::size_t i = 0; i < kFlatGroupWidth; i++) {
+      if (ctrl_[index + i] == c) {
+        mask |= 1u << i;
+      }
+    }
+    return mask;
+#endif
+  }
+
+  // returns a bitmask of the positions in the group that are empty or deleted
+  uint32_t match_empty_or_deleted(std::size_t index) const {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(ctrl_.data() + index));
+    // both markers have the sign bit set, while full slots do not
+    return _mm_movemask_epi8(group);
+#else
+    uint32_t mask = 0;
+    for (std::size_t i = 0; i < kFlatGroupWidth; i++) {
+      if (!is_full(ctrl_[index + i])) {
+        mask |= 1u << i;
+      }
+    }
+    return mask;
+#endif
+  }
+
+  static unsigned lowest_bit(uint32_t mask) { return __builtin_ctz(mask); }
+
+  // looks for k; on success, index is the slot holding it
+  bool probe(const K &k, std::size_t hash, std::size_t &index) const {
+    std::size_t mask = capacity() - 1;
+    std::size_t pos = h1(hash) & mask;
+    ctrl_t tag = h2(hash);
+
+    for (std::size_t stride = kFlatGroupWidth;; stride += kFlatGroupWidth) {
+      for (uint32_t m = match(pos, tag); m != 0; m &= m - 1) {
+        std::size_t candidate = (pos + lowest_bit(m)) & mask;
+        if (slots_[candidate]->key == k) {
+          index = candidate;
+          return true;
+        }
+      }
+
+      if (match(pos, kEmpty) != 0) {
+        return false;
+      }
+
+      // triangular probing visits every group when the capacity is a power
+      // of two
+      pos = (pos + stride) & mask;
+    }
+  }
+
+  // the first empty or deleted slot on k's probe sequence
+  std::size_t find_free_slot(std::size_t hash) const {
+    std::size_t mask = capacity() - 1;
+    std::size_t pos = h1(hash) & mask;
+
+    for (std::size_t stride = kFlatGroupWidth;; stride += kFlatGroupWidth) {
+      uint32_t m = match_empty_or_deleted(pos);
+      if (m != 0) {
+        return (pos + lowest_bit(m)) & mask;
+      }
+
+      pos = (pos + stride) & mask;
+    }
+  }
+
+  Entry *find(const K &k) const {
+    std::size_t index;
+    return probe(k, hash_key(k), index) ? slots_[index] : nullptr;
+  }
+
+  Entry *find_or_insert(const K &k) {
+    std::size_t hash = hash_key(k);
+    std::size_t index;
+
+    if (probe(k, hash, index)) {
+      return slots_[index];
+    }
+
+    // keep the load factor (including tombstones) under 7/8; if most of the
+    // occupied slots are tombstones, rehashing in place is enough
+    if ((size_ + tombstones_ + 1) * 8 > capacity() * 7) {
+      bool grow = (size_ + 1) * 16 > capacity() * 7;
+      resize(grow ? capacity() * 2 : capacity());
+    }
+
+    index = find_free_slot(hash);
+    if (ctrl_[index] == kDeleted) {
+      tombstones_ -= 1;
+    }
+
+    slots_[index] = pool_.create(k);
+    set_ctrl(index, h2(hash));
+    size_ += 1;
+
+    return slots_[index];
+  }
+
+  // the first kFlatGroupWidth control bytes are mirrored past the end of the
+  // array so that a group load starting near the end never wraps
+  void set_ctrl(std::size_t index, ctrl_t c) {
+    ctrl_[index] = c;
+
+    if (index < kFlatGroupWidth) {
+      ctrl_[capacity() + index] = c;
+    }
+  }
+
+  // rebuilds the index with new_capacity slots; this also drops tombstones
+  void resize(std::size_t new_capacity) {
+    std::vector<ctrl_t> old_ctrl;
+    std::vector<Entry *> old_slots;
+    old_ctrl.swap(ctrl_);
+    old_slots.swap(slots_);
+
+    ctrl_.assign(new_capacity + kFlatGroupWidth, kEmpty);
+    slots_.assign(new_capacity, nullptr);
+    tombstones_ = 0;
+
+    for (std::size_t i = 0; i < old_slots.size(); i++) {
+      if (is_full(old_ctrl[i])) {
+        std::size_t hash = hash_key(old_slots[i]->key);
+        std::size_t index = find_free_slot(hash);
+        slots_[index] = old_slots[i];
+        set_ctrl(index, h2(hash));
+      }
+    }
+  }
+
+  std::vector<ctrl_t> ctrl_;
+  std::vector<Entry *> slots_;
+  ArenaPool<Entry> pool_;
+  std::size_t size_;
+  std::size_t tombstones_;
+};
+
+#endif // INCLUDE_KVS_FLAT_KV_STORE_HPP_
@@ -0,0 +1,67 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_KEY_ACCESS_TRACKER_HPP_
+#define INCLUDE_KVS_KEY_ACCESS_TRACKER_HPP_
+
+#include <algorithm>
+
+#include "kvs_types.hpp"
+#include "metadata.hpp"
+
+// The times at which each key was accessed, for the access statistics a
+// thread reports to the monitoring nodes. The times of a key are kept in the
+// order they were recorded, so that the stale ones are a prefix. Only keys
+// with recent accesses are tracked; a stored key that is not tracked has a
+// count of zero.
+class KeyAccessTracker {
+  hmap<Key, vector<TimePoint>> accesses_;
+
+public:
+  void record(const Key &key, const TimePoint &time) {
+    accesses_[key].push_back(time);
+  }
+
+  // the number of accesses to key since the last expire
+  unsigned count(const Key &key) const {
+    auto it = accesses_.find(key);
+    return it == accesses_.end() ? 0 : it->second.size();
+  }
+
+  // drops the accesses from before cutoff, and stops tracking the keys left
+  // without any and the keys that are no longer stored, e.g. those that were
+  // removed or that were only ever read and never existed
+  void expire(const TimePoint &cutoff,
+              const map<Key, KeyProperty> &stored_key_map) {
+    for (auto it = accesses_.begin(); it != accesses_.end();) {
+      vector<TimePoint> &times = it->second;
+      auto fresh = std::find_if(
+          times.begin(), times.end(),
+          [&cutoff](const TimePoint &time) { return time >= cutoff; });
+      times.erase(times.begin(), fresh);
+
+      if (times.empty() || stored_key_map.find(it->first) ==
+                               stored_key_map.end()) {
+        it = accesses_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  // the number of tracked keys
+  std::size_t size() const { return accesses_.size(); }
+};
+
+#endif // INCLUDE_KVS_KEY_ACCESS_TRACKER_HPP_
@@ -0,0 +1,297 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_KEY_EXPIRY_HPP_
+#define INCLUDE_KVS_KEY_EXPIRY_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+
+#include "server_utils.hpp"
+
+// The granularity of key expiry (in milliseconds): keys expire on the first
+// tick at or after their deadline
+const unsigned kExpiryTick = 100;
+
+// A hierarchical timing wheel: kWheelLevels wheels of kWheelSlots slots each,
+// where a slot of level l spans kWheelSlots^l ticks. An item is filed under
+// the lowest level whose span covers its deadline, and is moved down a level
+// each time the wheel above turns past it, so scheduling is O(1) and each item
+// is touched at most once per level before it comes due. Deadlines beyond the
+// top level are parked in its furthest slot and filed again when it turns.
+template <typename T> class TimingWheel {
+  static const unsigned kWheelBits = 6;
+  static const unsigned kWheelSlots = 1 << kWheelBits;
+  static const unsigned kWheelLevels = 4;
+
+  struct Entry {
+    T item;
+    uint64_t deadline;
+  };
+
+  uint64_t now_;
+  vector<Entry> slots_[kWheelLevels][kWheelSlots];
+
+  void file(Entry &&entry) {
+    uint64_t deadline = std::max(entry.deadline, now_);
+    uint64_t delta = deadline - now_;
+
+    unsigned level = 0;
+    while (level < kWheelLevels - 1 &&
+           delta >= (uint64_t)1 << (kWheelBits * (level + 1))) {
+      level++;
+    }
+
+    // park deadlines past the top level's span in its furthest slot
+    uint64_t span = (uint64_t)1 << (kWheelBits * kWheelLevels);
+    if (delta >= span) {
+      deadline = now_ + span - 1;
+    }
+
+    unsigned slot = (deadline >> (kWheelBits * level)) & (kWheelSlots - 1);
+    slots_[level][slot].push_back(std::move(entry));
+  }
+
+public:
+  TimingWheel(uint64_t now) : now_(now) {}
+
+  uint64_t now() const { return now_; }
+
+  // files item to come due at deadline, or on the next tick if that has
+  // passed
+  void schedule(const T &item, uint64_t deadline) {
+    file({item, std::max(deadline, now_ + 1)});
+  }
+
+  // turns the wheel up to tick, appending the items that came due to due
+  void advance(uint64_t tick, vector<T> &due) {
+    while (now_ < tick) {
+      now_ += 1;
+
+      // find the highest wheel that turns over on this tick, and file its
+      // current slot into the wheels below, from the top down
+      unsigned top = 0;
+      while (top < kWheelLevels - 1 &&
+             (now_ & (((uint64_t)1 << (kWheelBits * (top + 1))) - 1)) == 0) {
+        top++;
+      }
+
+      for (unsigned level = top; level > 0; level--) {
+        unsigned slot = (now_ >> (kWheelBits * level)) & (kWheelSlots - 1);
+        vector<Entry> entries;
+        entries.swap(slots_[level][slot]);
+
+        for (Entry &entry : entries) {
+          file(std::move(entry));
+        }
+      }
+
+      vector<Entry> &current = slots_[0][now_ & (kWheelSlots - 1)];
+      for (Entry &entry : current) {
+        due.push_back(std::move(entry.item));
+      }
+
+      current.clear();
+    }
+  }
+};
+
+// Expires keys a fixed time after their last put, with the time set per key
+// prefix. Each key with a TTL is in the timing wheel at most once: a put only
+// moves its deadline, and when the wheel comes to the key, it is either
+// expired or filed again under the later deadline. Puts may come from the
+// disk I/O thread, so all access is under a lock.
+class KeyExpiry {
+  struct Deadline {
+    uint64_t tick;
+
+    // false once the key has been removed, so that the wheel entry still
+    // pending for it is dropped when it comes due
+    bool live;
+  };
+
+  // (prefix, TTL in ticks), longest prefix first
+  vector<std::pair<string, uint64_t>> rules_;
+
+  std::chrono::steady_clock::time_point start_;
+  TimingWheel<Key> wheel_;
+  hmap<Key, Deadline> deadlines_;
+  std::mutex mutex_;
+
+  uint64_t tick(const std::chrono::steady_clock::time_point &now) const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(now - start_)
+               .count() /
+           kExpiryTick;
+  }
+
+public:
+  // rules maps key prefixes to the number of seconds keys with that prefix
+  // live after their last put
+  KeyExpiry(const vector<std::pair<string, unsigned>> &rules)
+      : start_(std::chrono::steady_clock::now()), wheel_(0) {
+    for (const auto &rule : rules) {
+      rules_.push_back({rule.first, rule.second * 1000ULL / kExpiryTick});
+    }
+
+    std::sort(rules_.begin(), rules_.end(),
+              [](const std::pair<string, uint64_t> &lhs,
+                 const std::pair<string, uint64_t> &rhs) {
+                return lhs.first.size() > rhs.first.size();
+              });
+  }
+
+  // (re)starts the TTL of key at now, if it has one
+  void touch(const Key &key, const std::chrono::steady_clock::time_point &now) {
+    if (is_metadata(key)) {
+      return;
+    }
+
+    auto rule = std::find_if(rules_.begin(), rules_.end(),
+                             [&key](const std::pair<string, uint64_t> &rule) {
+                               return key.compare(0, rule.first.size(),
+                                                  rule.first) == 0;
+                             });
+    if (rule == rules_.end()) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t deadline = tick(now) + rule->second;
+    auto it = deadlines_.find(key);
+
+    if (it == deadlines_.end()) {
+      deadlines_[key] = {deadline, true};
+      wheel_.schedule(key, deadline);
+    } else {
+      it->second = {deadline, true};
+    }
+  }
+
+  void forget(const Key &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = deadlines_.find(key);
+
+    if (it != deadlines_.end()) {
+      it->second.live = false;
+    }
+  }
+
+  // appends the keys whose TTL has run out to expired; they are forgotten
+  void expire(const std::chrono::steady_clock::time_point &now,
+              vector<Key> &expired) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    vector<Key> due;
+    wheel_.advance(tick(now), due);
+
+    for (const Key &key : due) {
+      auto it = deadlines_.find(key);
+
+      if (!it->second.live) {
+        deadlines_.erase(it);
+      } else if (it->second.tick > wheel_.now()) {
+        wheel_.schedule(key, it->second.tick);
+      } else {
+        expired.push_back(key);
+        deadlines_.erase(it);
+      }
+    }
+  }
+
+  // whether key has a TTL running
+  bool pending(const Key &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = deadlines_.find(key);
+    return it != deadlines_.end() && it->second.live;
+  }
+
+  // the number of keys in the wheel
+  std::size_t size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return deadlines_.size();
+  }
+};
+
+// Starts the TTL of every key put through the serializer it wraps
+class ExpiringSerializer final : public Serializer {
+  Serializer *serializer_;
+  KeyExpiry *expiry_;
+
+public:
+  ExpiringSerializer(Serializer *serializer, KeyExpiry *expiry)
+      : serializer_(serializer), expiry_(expiry) {}
+
+  string get(const Key &key, AnnaError &error) {
+    return serializer_->get(key, error);
+  }
+
+  unsigned put(const Key &key, const string &serialized) {
+    unsigned size = serializer_->put(key, serialized);
+    expiry_->touch(key, std::chrono::steady_clock::now());
+    return size;
+  }
+
+  void remove(const Key &key) {
+    serializer_->remove(key);
+    expiry_->forget(key);
+  }
+};
+
+// Wraps an LWW serializer to keep track of tombstones: keys whose latest
+// write is an empty value, which is how keys are deleted. Each tombstone is
+// given to a KeyExpiry that expires every key after the grace period, so that
+// it is reclaimed once it has had time to reach the other replicas, unless a
+// later write brings the key back first.
+class TombstoneSerializer final : public Serializer {
+  Serializer *serializer_;
+  KeyExpiry *tombstones_;
+
+public:
+  TombstoneSerializer(Serializer *serializer, KeyExpiry *tombstones)
+      : serializer_(serializer), tombstones_(tombstones) {}
+
+  string get(const Key &key, AnnaError &error) {
+    return serializer_->get(key, error);
+  }
+
+  unsigned put(const Key &key, const string &serialized) {
+    unsigned size = serializer_->put(key, serialized);
+    bool tombstone = wire_lww_tombstone(serialized);
+
+    // most puts neither delete nor land on a deleted key, and need no read
+    if (!tombstone && !tombstones_->pending(key)) {
+      return size;
+    }
+
+    // a tombstone may lose to a later write, and a write may lose to a later
+    // tombstone, so only the merged value tells
+    AnnaError error = AnnaError::NO_ERROR;
+    serializer_->get(key, error);
+
+    if (error != AnnaError::KEY_DNE) {
+      tombstones_->forget(key);
+    } else if (tombstone) {
+      tombstones_->touch(key, std::chrono::steady_clock::now());
+    }
+
+    return size;
+  }
+
+  void remove(const Key &key) {
+    serializer_->remove(key);
+    tombstones_->forget(key);
+  }
+};
+
+#endif // INCLUDE_KVS_KEY_EXPIRY_HPP_
@@ -0,0 +1,294 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_KEY_INTERNER_HPP_
+#define INCLUDE_KVS_KEY_INTERNER_HPP_
+
+#include <algorithm>
+#include <cstdint>
+
+#include "kvs_types.hpp"
+
+typedef uint32_t KeyHandle;
+
+// Gives each key a dense 32-bit handle, so that a server thread's per-key
+// bookkeeping can hold the handle instead of its own copy of the key. Each
+// key is stored once, here. Handles are reference counted: every structure
+// that holds a handle acquires it, and releases it when it lets go, and a
+// handle nobody holds is freed and reused.
+class KeyInterner {
+  hmap<Key, KeyHandle> handles_;
+
+  // the key of each handle, pointing into handles_, whose nodes do not move
+  vector<const Key *> keys_;
+  vector<unsigned> refs_;
+  vector<KeyHandle> free_;
+
+public:
+  // the handle of key, interned if it has none; every acquire is matched by
+  // a release
+  KeyHandle acquire(const Key &key) {
+    auto it = handles_.find(key);
+    if (it != handles_.end()) {
+      refs_[it->second] += 1;
+      return it->second;
+    }
+
+    KeyHandle handle;
+
+    if (free_.empty()) {
+      handle = keys_.size();
+      keys_.push_back(nullptr);
+      refs_.push_back(0);
+    } else {
+      handle = free_.back();
+      free_.pop_back();
+    }
+
+    it = handles_.emplace(key, handle).first;
+    keys_[handle] = &it->first;
+    refs_[handle] = 1;
+    return handle;
+  }
+
+  void release(KeyHandle handle) {
+    refs_[handle] -= 1;
+
+    if (refs_[handle] == 0) {
+      handles_.erase(handles_.find(*keys_[handle]));
+      keys_[handle] = nullptr;
+      free_.push_back(handle);
+    }
+  }
+
+  // looks up the handle of key without interning it
+  bool find(const Key &key, KeyHandle &handle) const {
+    auto it = handles_.find(key);
+    if (it == handles_.end()) {
+      return false;
+    }
+
+    handle = it->second;
+    return true;
+  }
+
+  const Key &key(KeyHandle handle) const { return *keys_[handle]; }
+
+  // the number of keys with a handle
+  std::size_t size() const { return handles_.size(); }
+};
+
+// A set of keys, held by handle. Each member holds one handle of its key.
+class KeyHandleSet {
+  KeyInterner *keys_;
+  set<KeyHandle> handles_;
+
+public:
+  // iterates over the keys of the set
+  class const_iterator {
+    const KeyInterner *keys_;
+    set<KeyHandle>::const_iterator it_;
+
+  public:
+    const_iterator(const KeyInterner *keys,
+                   set<KeyHandle>::const_iterator it)
+        : keys_(keys), it_(it) {}
+
+    const Key &operator*() const { return keys_->key(*it_); }
+
+    const_iterator &operator++() {
+      ++it_;
+      return *this;
+    }
+
+    bool operator!=(const const_iterator &other) const {
+      return it_ != other.it_;
+    }
+  };
+
+  KeyHandleSet(KeyInterner *keys) : keys_(keys) {}
+  KeyHandleSet(const KeyHandleSet &) = delete;
+  KeyHandleSet &operator=(const KeyHandleSet &) = delete;
+
+  ~KeyHandleSet() { clear(); }
+
+  void insert(const Key &key) {
+    KeyHandle handle = keys_->acquire(key);
+
+    if (!handles_.insert(handle).second) {
+      keys_->release(handle);
+    }
+  }
+
+  void erase(const Key &key) {
+    KeyHandle handle;
+    if (keys_->find(key, handle) && handles_.erase(handle) > 0) {
+      keys_->release(handle);
+    }
+  }
+
+  void clear() {
+    for (KeyHandle handle : handles_) {
+      keys_->release(handle);
+    }
+
+    handles_.clear();
+  }
+
+  std::size_t size() const { return handles_.size(); }
+
+  const_iterator begin() const {
+    return const_iterator(keys_, handles_.begin());
+  }
+
+  const_iterator end() const { return const_iterator(keys_, handles_.end()); }
+};
+
+// A map from keys to values of type V, held by handle. Each entry holds one
+// handle of its key.
+template <typename V> class KeyHandleMap {
+  KeyInterner *keys_;
+  hmap<KeyHandle, V> values_;
+
+public:
+  KeyHandleMap(KeyInterner *keys) : keys_(keys) {}
+  KeyHandleMap(const KeyHandleMap &) = delete;
+  KeyHandleMap &operator=(const KeyHandleMap &) = delete;
+
+  ~KeyHandleMap() {
+    for (const auto &pair : values_) {
+      keys_->release(pair.first);
+    }
+  }
+
+  // the value of key, added if key has none
+  V &operator[](const Key &key) {
+    KeyHandle handle = keys_->acquire(key);
+    auto result = values_.emplace(handle, V());
+
+    if (!result.second) {
+      keys_->release(handle);
+    }
+
+    return result.first->second;
+  }
+
+  // the value of key, or nullptr if it has none
+  V *find(const Key &key) {
+    KeyHandle handle;
+    if (!keys_->find(key, handle)) {
+      return nullptr;
+    }
+
+    auto it = values_.find(handle);
+    return it == values_.end() ? nullptr : &it->second;
+  }
+
+  void erase(const Key &key) {
+    KeyHandle handle;
+    if (keys_->find(key, handle) && values_.erase(handle) > 0) {
+      keys_->release(handle);
+    }
+  }
+
+  std::size_t size() const { return values_.size(); }
+};
+
+// Which caches hold which keys, from the key lists caches publish, indexed
+// both ways: by cache, to replace a cache's keys when it publishes a new
+// list, and by key, to find the caches to send a key's updates to. Each
+// (cache, key) pair holds a handle of the key.
+class CacheKeyIndex {
+  KeyInterner *keys_;
+
+  // the keys of each cache, sorted by handle
+  map<Address, vector<KeyHandle>> keys_by_cache_;
+  hmap<KeyHandle, set<Address>> caches_by_key_;
+
+  void unlink(const Address &cache, KeyHandle handle) {
+    auto it = caches_by_key_.find(handle);
+    it->second.erase(cache);
+
+    if (it->second.empty()) {
+      caches_by_key_.erase(it);
+    }
+  }
+
+public:
+  CacheKeyIndex(KeyInterner *keys) : keys_(keys) {}
+
+  // replaces the keys that cache holds
+  template <typename Keys> void update(const Address &cache, const Keys &keys) {
+    vector<KeyHandle> handles;
+    handles.reserve(keys.size());
+
+    for (const Key &key : keys) {
+      handles.push_back(keys_->acquire(key));
+    }
+
+    std::sort(handles.begin(), handles.end());
+    auto last = std::unique(handles.begin(), handles.end());
+
+    // a key listed twice was acquired twice
+    for (auto it = last; it != handles.end(); ++it) {
+      keys_->release(*it);
+    }
+
+    handles.erase(last, handles.end());
+
+    // the new handles are held before the old ones are released, so that
+    // the keys the cache still holds keep their handles
+    vector<KeyHandle> &old_handles = keys_by_cache_[cache];
+    for (KeyHandle handle : old_handles) {
+      if (!std::binary_search(handles.begin(), handles.end(), handle)) {
+        unlink(cache, handle);
+      }
+
+      keys_->release(handle);
+    }
+
+    for (KeyHandle handle : handles) {
+      caches_by_key_[handle].insert(cache);
+    }
+
+    old_handles.swap(handles);
+  }
+
+  void remove_cache(const Address &cache) {
+    auto it = keys_by_cache_.find(cache);
+    if (it == keys_by_cache_.end()) {
+      return;
+    }
+
+    for (KeyHandle handle : it->second) {
+      unlink(cache, handle);
+      keys_->release(handle);
+    }
+
+    keys_by_cache_.erase(it);
+  }
+
+  // the caches that hold key, or nullptr if none do
+  const set<Address> *caches(const Key &key) const {
+    KeyHandle handle;
+    if (!keys_->find(key, handle)) {
+      return nullptr;
+    }
+
+    auto it = caches_by_key_.find(handle);
+    return it == caches_by_key_.end() ? nullptr : &it->second;
+  }
+};
+
+#endif // INCLUDE_KVS_KEY_INTERNER_HPP_
@@ -15,10 +15,15 @@
 #ifndef INCLUDE_KVS_KVS_HANDLERS_HPP_
 #define INCLUDE_KVS_KVS_HANDLERS_HPP_
 
+#include "disk_io.hpp"
 #include "hash_ring.hpp"
+#include "key_expiry.hpp"
+#include "key_access_tracker.hpp"
+#include "key_interner.hpp"
 #include "metadata.pb.h"
 #include "requests.hpp"
 #include "server_utils.hpp"
+#include "write_ahead_log.hpp"
 
 void node_join_handler(unsigned thread_id, unsigned &seed, Address public_ip,
                        Address private_ip, logger log, string &serialized,
@@ -47,17 +52,20 @@ void self_depart_handler(unsigned thread_id, unsigned &seed, Address public_ip,
 void user_request_handler(
     unsigned &access_count, unsigned &seed, string &serialized, logger log,
     GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
-    map<Key, vector<PendingRequest>> &pending_requests,
-    map<Key, std::multiset<TimePoint>> &key_access_tracker,
+    KeyHandleMap<vector<PendingRequest>> &pending_requests,
+    KeyAccessTracker &key_access_tracker,
     map<Key, KeyProperty> &stored_key_map,
-    map<Key, KeyReplication> &key_replication_map, set<Key> &local_changeset,
-    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers);
+    unsigned long long &storage_consumption,
+    map<Key, KeyReplication> &key_replication_map, KeyHandleSet &local_changeset,
+    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers,
+    AsyncDiskIO *disk_io, WriteAheadLog *wal, bool memory_pressure);
 
 void gossip_handler(unsigned &seed, string &serialized,
                     GlobalRingMap &global_hash_rings,
                     LocalRingMap &local_hash_rings,
-                    map<Key, vector<PendingGossip>> &pending_gossip,
+                    KeyHandleMap<vector<PendingGossip>> &pending_gossip,
                     map<Key, KeyProperty> &stored_key_map,
+                    unsigned long long &storage_consumption,
                     map<Key, KeyReplication> &key_replication_map,
                     ServerThread &wt, SerializerMap &serializers,
                     SocketCache &pushers, logger log);
@@ -65,47 +73,71 @@ void gossip_handler(unsigned &seed, string &serialized,
 void replication_response_handler(
     unsigned &seed, unsigned &access_count, logger log, string &serialized,
     GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
-    map<Key, vector<PendingRequest>> &pending_requests,
-    map<Key, vector<PendingGossip>> &pending_gossip,
-    map<Key, std::multiset<TimePoint>> &key_access_tracker,
+    KeyHandleMap<vector<PendingRequest>> &pending_requests,
+    KeyHandleMap<vector<PendingGossip>> &pending_gossip,
+    KeyAccessTracker &key_access_tracker,
     map<Key, KeyProperty> &stored_key_map,
-    map<Key, KeyReplication> &key_replication_map, set<Key> &local_changeset,
-    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers);
+    unsigned long long &storage_consumption,
+    map<Key, KeyReplication> &key_replication_map, KeyHandleSet &local_changeset,
+    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers,
+    AsyncDiskIO *disk_io, WriteAheadLog *wal);
 
 void replication_change_handler(
     Address public_ip, Address private_ip, unsigned thread_id, unsigned &seed,
     logger log, string &serialized, GlobalRingMap &global_hash_rings,
     LocalRingMap &local_hash_rings, map<Key, KeyProperty> &stored_key_map,
-    map<Key, KeyReplication> &key_replication_map, set<Key> &local_changeset,
-    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers);
+    unsigned long long &storage_consumption,
+    map<Key, KeyReplication> &key_replication_map, KeyHandleSet &local_changeset,
+    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers,
+    AsyncDiskIO *disk_io);
 
 // Postcondition:
-// cache_ip_to_keys, key_to_cache_ips are both updated
-// with the IPs and their fresh list of repsonsible keys
-// in the serialized response.
-void cache_ip_response_handler(string &serialized,
-                               map<Address, set<Key>> &cache_ip_to_keys,
-                               map<Key, set<Address>> &key_to_cache_ips);
+// cache_index is updated with the IPs and their fresh list of responsible
+// keys in the serialized response.
+void cache_ip_response_handler(string &serialized, CacheKeyIndex &cache_index);
 
 void management_node_response_handler(string &serialized,
                                       set<Address> &extant_caches,
-                                      map<Address, set<Key>> &cache_ip_to_keys,
-                                      map<Key, set<Address>> &key_to_cache_ips,
+                                      CacheKeyIndex &cache_index,
                                       GlobalRingMap &global_hash_rings,
                                       LocalRingMap &local_hash_rings,
                                       SocketCache &pushers, ServerThread &wt,
                                       unsigned &rid);
 
+void scan_handler(string &serialized, map<Key, KeyProperty> &stored_key_map,
+                  SocketCache &pushers);
+
+// sends the stored values of the keys to each address; with unpack, values
+// are decompressed first, for caches, which take them as clients do. With
+// disk_io, the values are read on the I/O thread and sent once they are in.
 void send_gossip(AddressKeysetMap &addr_keyset_map, SocketCache &pushers,
                  SerializerMap &serializers,
-                 map<Key, KeyProperty> &stored_key_map);
+                 map<Key, KeyProperty> &stored_key_map,
+                 AsyncDiskIO *disk_io = nullptr, bool unpack = false);
 
 std::pair<string, AnnaError> process_get(const Key &key,
                                          Serializer *serializer);
 
 void process_put(const Key &key, LatticeType lattice_type,
                  const string &payload, Serializer *serializer,
-                 map<Key, KeyProperty> &stored_key_map);
+                 map<Key, KeyProperty> &stored_key_map,
+                 unsigned long long &storage_consumption);
+
+void remove_key(const Key &key, SerializerMap &serializers,
+                map<Key, KeyProperty> &stored_key_map,
+                unsigned long long &storage_consumption);
+
+vector<Key>
+select_cold_keys(unsigned long long bytes, unsigned max_keys,
+                 map<Key, KeyProperty> &stored_key_map,
+                 KeyAccessTracker &key_access_tracker,
+                 const map<Key, SteadyTimePoint> &demotions);
+
+void demote_keys(const vector<Key> &keys, GlobalRingMap &global_hash_rings,
+                 LocalRingMap &local_hash_rings,
+                 map<Key, KeyReplication> &key_replication_map,
+                 vector<Address> &routing_ips, SocketCache &pushers,
+                 unsigned &rid);
 
 bool is_primary_replica(const Key &key,
                         map<Key, KeyReplication> &key_replication_map,
@@ -0,0 +1,107 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_LATTICE_BYTES_HPP_
+#define INCLUDE_KVS_LATTICE_BYTES_HPP_
+
+#include "common.hpp"
+#include "packed_set_lattice.hpp"
+
+// Estimates of the bytes of memory a lattice value holds, for the memory
+// tier's storage accounting. Every estimate is the size of the object itself
+// plus what it owns on the heap, assuming a node-based layout for sets and
+// maps, so that values with many small elements are not undercounted.
+
+// the bookkeeping a node-based container holds for every element, beyond the
+// element itself: the hash or balancing data and two or three links
+const unsigned kContainerNodeOverhead = 4 * sizeof(void *);
+
+// the heap buffer of a string, which short strings store inline
+inline std::size_t string_heap_bytes(const string &s) {
+  return s.capacity() >= sizeof(string) ? s.capacity() + 1 : 0;
+}
+
+inline std::size_t string_bytes(const string &s) {
+  return sizeof(string) + string_heap_bytes(s);
+}
+
+inline std::size_t lattice_bytes(const LWWPairLattice<string> &l) {
+  return sizeof(l) + string_heap_bytes(l.reveal().value);
+}
+
+inline std::size_t lattice_bytes(const PriorityLattice<double, string> &l) {
+  return sizeof(l) + string_heap_bytes(l.reveal().value);
+}
+
+inline std::size_t lattice_bytes(const SetLattice<string> &l) {
+  std::size_t bytes =
+      sizeof(l) + l.reveal().bucket_count() * sizeof(void *);
+
+  for (const string &element : l.reveal()) {
+    bytes += kContainerNodeOverhead + string_bytes(element);
+  }
+
+  return bytes;
+}
+
+inline std::size_t lattice_bytes(const OrderedSetLattice<string> &l) {
+  std::size_t bytes = sizeof(l);
+
+  for (const string &element : l.reveal()) {
+    bytes += kContainerNodeOverhead + string_bytes(element);
+  }
+
+  return bytes;
+}
+
+inline std::size_t lattice_bytes(const PackedSetLattice &l) {
+  return sizeof(l) + l.reveal().heap_bytes();
+}
+
+inline std::size_t vector_clock_bytes(const VectorClock &vc) {
+  std::size_t bytes = sizeof(vc);
+
+  for (const auto &pair : vc.reveal()) {
+    bytes += kContainerNodeOverhead + string_bytes(pair.first) +
+             sizeof(pair.second);
+  }
+
+  return bytes;
+}
+
+inline std::size_t
+lattice_bytes(const SingleKeyCausalLattice<SetLattice<string>> &l) {
+  return sizeof(l) - sizeof(l.reveal().vector_clock) -
+         sizeof(l.reveal().value) + vector_clock_bytes(l.reveal().vector_clock) +
+         lattice_bytes(l.reveal().value);
+}
+
+inline std::size_t
+lattice_bytes(const MultiKeyCausalLattice<SetLattice<string>> &l) {
+  std::size_t bytes = sizeof(l) - sizeof(l.reveal().vector_clock) -
+                      sizeof(l.reveal().dependencies) -
+                      sizeof(l.reveal().value) +
+                      vector_clock_bytes(l.reveal().vector_clock) +
+                      sizeof(l.reveal().dependencies) +
+                      lattice_bytes(l.reveal().value);
+
+  for (const auto &pair : l.reveal().dependencies.reveal()) {
+    bytes += kContainerNodeOverhead + string_bytes(pair.first) +
+             vector_clock_bytes(pair.second);
+  }
+
+  return bytes;
+}
+
+#endif // INCLUDE_KVS_LATTICE_BYTES_HPP_
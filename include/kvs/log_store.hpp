@@ -0,0 +1,502 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_LOG_STORE_HPP_
+#define INCLUDE_KVS_LOG_STORE_HPP_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <set>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "types.hpp"
+
+// The size at which the active segment is sealed and a new one is started
+const uint64_t kLogSegmentSize = 64 << 20;
+
+// A sealed segment is compacted once less than this fraction of its bytes
+// belong to records that are still live
+const double kLogCompactionThreshold = 0.5;
+
+// The number of records LogStore::compact copies per call from the event loop
+const unsigned kLogCompactionBatch = 64;
+
+// Every record is a header followed by the key bytes and the value bytes
+struct LogRecordHeader {
+  uint32_t key_size;
+  uint32_t value_size;
+};
+
+// The value_size of a record that marks its key as removed; tombstones carry
+// no value bytes
+const uint32_t kLogTombstone = UINT32_MAX;
+
+// A log-structured disk engine: all values a thread stores are appended to a
+// sequence of segment files, and an in-memory index maps every key to the
+// location of its latest record. Reads are a single positioned read, writes
+// are a single append, and superseded records are reclaimed by compacting
+// sparse segments a few records at a time. The index is rebuilt at startup by
+// replaying the segments in order.
+class LogStore {
+  struct Segment {
+    int fd;
+    // the number of bytes written to the segment
+    uint64_t size;
+    // the number of bytes that belong to records the index points at
+    uint64_t live_bytes;
+  };
+
+  struct Location {
+    unsigned segment;
+    // the offset of the record header in the segment
+    uint64_t offset;
+    uint32_t value_size;
+  };
+
+public:
+  LogStore(const string &root, uint64_t segment_size = kLogSegmentSize)
+      : root_(root), segment_size_(segment_size), compacting_(false) {
+    if (root_.back() != '/') {
+      root_ += "/";
+    }
+
+    if (mkdir(root_.c_str(), 0755) != 0 && errno != EEXIST) {
+      std::cerr << "Failed to create log directory " << root_ << std::endl;
+    }
+
+    recover();
+  }
+
+  LogStore(const LogStore &) = delete;
+  LogStore &operator=(const LogStore &) = delete;
+
+  ~LogStore() {
+    for (const auto &pair : segments_) {
+      close(pair.second.fd);
+    }
+  }
+
+  // returns false if the key is not stored
+  bool get(const Key &key, string &value) {
+    uint64_t total;
+    return get_prefix(key, std::numeric_limits<std::size_t>::max(), value,
+                      total);
+  }
+
+  // reads at most the first size bytes of a key's value, and sets total to
+  // the value's full size; returns false if the key is not stored
+  bool get_prefix(const Key &key, std::size_t size, string &value,
+                  uint64_t &total) {
+    auto it = index_.find(key);
+
+    if (it == index_.end()) {
+      return false;
+    }
+
+    const Location &location = it->second;
+    total = location.value_size;
+    value.resize(std::min(size, (std::size_t)location.value_size));
+
+    uint64_t offset = location.offset + sizeof(LogRecordHeader) + key.size();
+    if (!read_fully(segments_[location.segment].fd, &value[0], value.size(),
+                    offset)) {
+      std::cerr << "Failed to read payload." << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+
+  // Appends bytes to the end of a key's value and sets size to the value's
+  // new size. Returns false if the key is not stored. Records are never
+  // modified in place, so this writes a new record with the whole value.
+  bool extend(const Key &key, const string &bytes, uint64_t &size) {
+    string value;
+
+    if (!get(key, value)) {
+      return false;
+    }
+
+    value += bytes;
+    put(key, value);
+    size = value.size();
+    return true;
+  }
+
+  void put(const Key &key, const string &value) {
+    uint64_t offset = append(key, value.data(), value.size());
+
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      release(key, it->second);
+    }
+
+    index_[key] = {active_, offset, static_cast<uint32_t>(value.size())};
+    segments_[active_].live_bytes += record_size(key.size(), value.size());
+    roll_if_full();
+  }
+
+  void remove(const Key &key) {
+    auto it = index_.find(key);
+
+    if (it == index_.end()) {
+      return;
+    }
+
+    release(key, it->second);
+    index_.erase(it);
+
+    append(key, nullptr, kLogTombstone);
+    roll_if_full();
+  }
+
+  // Copies up to max_records records out of the sparsest sealed segment and
+  // deletes the segment once all of its live records have been moved to the
+  // active segment. Returns true if there is compaction work left.
+  bool compact(unsigned max_records) {
+    if (!compacting_) {
+      if (candidates_.empty()) {
+        return false;
+      }
+
+      compact_segment_ = *std::min_element(
+          candidates_.begin(), candidates_.end(),
+          [this](unsigned a, unsigned b) {
+            return live_ratio(segments_[a]) < live_ratio(segments_[b]);
+          });
+      candidates_.erase(compact_segment_);
+      compact_offset_ = 0;
+      compacting_ = true;
+    }
+
+    Segment &segment = segments_[compact_segment_];
+
+    // a tombstone has to outlive every older record of its key, so it can
+    // only be dropped once no older segment remains
+    bool has_older_segments = segments_.begin()->first < compact_segment_;
+
+    LogRecordHeader header;
+    string key;
+    string value;
+
+    for (unsigned i = 0; i < max_records && compact_offset_ < segment.size;
+         i++) {
+      uint64_t offset = compact_offset_;
+
+      if (!read_record(segment.fd, offset, header, key, value)) {
+        std::cerr << "Failed to read record from segment " << compact_segment_
+                  << "; abandoning its compaction." << std::endl;
+        compacting_ = false;
+        return !candidates_.empty();
+      }
+
+      compact_offset_ += record_size(header.key_size, header.value_size);
+
+      if (header.value_size == kLogTombstone) {
+        if (has_older_segments && index_.find(key) == index_.end()) {
+          append(key, nullptr, kLogTombstone);
+          roll_if_full();
+        }
+
+        continue;
+      }
+
+      auto it = index_.find(key);
+      if (it != index_.end() && it->second.segment == compact_segment_ &&
+          it->second.offset == offset) {
+        uint64_t new_offset = append(key, value.data(), value.size());
+        uint64_t size = record_size(header.key_size, header.value_size);
+
+        segment.live_bytes -= size;
+        it->second = {active_, new_offset, header.value_size};
+        segments_[active_].live_bytes += size;
+        roll_if_full();
+      }
+    }
+
+    if (compact_offset_ >= segment.size) {
+      close(segment.fd);
+
+      if (std::remove(segment_name(compact_segment_).c_str()) != 0) {
+        std::cerr << "Error deleting segment " << compact_segment_
+                  << std::endl;
+      }
+
+      segments_.erase(compact_segment_);
+      compacting_ = false;
+    }
+
+    return compacting_ || !candidates_.empty();
+  }
+
+  // the number of keys currently stored
+  std::size_t key_count() const { return index_.size(); }
+
+  // the number of segment files on disk
+  std::size_t segment_count() const { return segments_.size(); }
+
+  // the number of bytes the segment files take up on disk
+  uint64_t disk_bytes() const {
+    uint64_t total = 0;
+    for (const auto &pair : segments_) {
+      total += pair.second.size;
+    }
+
+    return total;
+  }
+
+private:
+  static uint64_t record_size(uint32_t key_size, uint32_t value_size) {
+    return sizeof(LogRecordHeader) + key_size +
+           (value_size == kLogTombstone ? 0 : value_size);
+  }
+
+  static double live_ratio(const Segment &segment) {
+    return segment.size == 0 ? 0 : (double)segment.live_bytes / segment.size;
+  }
+
+  string segment_name(unsigned id) const {
+    return root_ + "segment_" + std::to_string(id) + ".log";
+  }
+
+  void open_segment(unsigned id) {
+    int fd = open(segment_name(id).c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+      std::cerr << "Failed to open segment " << id << std::endl;
+    }
+
+    segments_[id] = {fd, 0, 0};
+    active_ = id;
+  }
+
+  // seals the active segment once it reaches segment_size_
+  void roll_if_full() {
+    if (segments_[active_].size < segment_size_) {
+      return;
+    }
+
+    unsigned sealed = active_;
+    open_segment(active_ + 1);
+    consider_for_compaction(sealed);
+  }
+
+  void consider_for_compaction(unsigned id) {
+    if (id == active_ || (compacting_ && id == compact_segment_)) {
+      return;
+    }
+
+    if (live_ratio(segments_[id]) < kLogCompactionThreshold) {
+      candidates_.insert(id);
+    }
+  }
+
+  // marks the record at location as superseded
+  void release(const Key &key, const Location &location) {
+    segments_[location.segment].live_bytes -=
+        record_size(key.size(), location.value_size);
+    consider_for_compaction(location.segment);
+  }
+
+  // appends a record to the active segment and returns its offset
+  uint64_t append(const Key &key, const char *value, uint32_t value_size) {
+    Segment &segment = segments_[active_];
+    LogRecordHeader header = {static_cast<uint32_t>(key.size()), value_size};
+
+    buffer_.clear();
+    buffer_.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    buffer_.append(key);
+    if (value_size != kLogTombstone) {
+      buffer_.append(value, value_size);
+    }
+
+    uint64_t offset = segment.size;
+    if (!write_fully(segment.fd, buffer_.data(), buffer_.size(), offset)) {
+      std::cerr << "Failed to write payload." << std::endl;
+    }
+
+    segment.size += buffer_.size();
+    return offset;
+  }
+
+  static bool write_fully(int fd, const char *data, std::size_t size,
+                          uint64_t offset) {
+    while (size > 0) {
+      ssize_t written = pwrite(fd, data, size, offset);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      } else if (written <= 0) {
+        return false;
+      }
+
+      data += written;
+      size -= written;
+      offset += written;
+    }
+
+    return true;
+  }
+
+  static bool read_fully(int fd, char *data, std::size_t size,
+                         uint64_t offset) {
+    while (size > 0) {
+      ssize_t count = pread(fd, data, size, offset);
+      if (count < 0 && errno == EINTR) {
+        continue;
+      } else if (count <= 0) {
+        return false;
+      }
+
+      data += count;
+      size -= count;
+      offset += count;
+    }
+
+    return true;
+  }
+
+  static bool read_record(int fd, uint64_t offset, LogRecordHeader &header,
+                          string &key, string &value) {
+    if (!read_fully(fd, reinterpret_cast<char *>(&header), sizeof(header),
+                    offset)) {
+      return false;
+    }
+
+    offset += sizeof(header);
+    key.resize(header.key_size);
+    if (!read_fully(fd, &key[0], header.key_size, offset)) {
+      return false;
+    }
+
+    if (header.value_size == kLogTombstone) {
+      value.clear();
+      return true;
+    }
+
+    offset += header.key_size;
+    value.resize(header.value_size);
+    return read_fully(fd, &value[0], header.value_size, offset);
+  }
+
+  // rebuilds the index by replaying every segment in the order it was written
+  void recover() {
+    std::vector<unsigned> ids;
+    DIR *dir = opendir(root_.c_str());
+
+    if (dir != nullptr) {
+      struct dirent *entry;
+      while ((entry = readdir(dir)) != nullptr) {
+        string name = entry->d_name;
+        if (name.size() > 12 && name.compare(0, 8, "segment_") == 0 &&
+            name.compare(name.size() - 4, 4, ".log") == 0) {
+          ids.push_back(std::stoul(name.substr(8)));
+        }
+      }
+
+      closedir(dir);
+    }
+
+    std::sort(ids.begin(), ids.end());
+
+    for (const unsigned &id : ids) {
+      open_segment(id);
+      replay(id);
+    }
+
+    if (ids.empty()) {
+      open_segment(0);
+    }
+
+    for (const auto &pair : segments_) {
+      consider_for_compaction(pair.first);
+    }
+  }
+
+  void replay(unsigned id) {
+    Segment &segment = segments_[id];
+    std::ifstream input(segment_name(id), std::ios::in | std::ios::binary);
+
+    LogRecordHeader header;
+    string key;
+    uint64_t offset = 0;
+
+    while (input.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+      key.resize(header.key_size);
+      if (!input.read(&key[0], header.key_size)) {
+        break;
+      }
+
+      if (header.value_size != kLogTombstone) {
+        input.ignore(header.value_size);
+        if (input.gcount() != header.value_size) {
+          break;
+        }
+      }
+
+      auto it = index_.find(key);
+      if (it != index_.end()) {
+        release(key, it->second);
+      }
+
+      uint64_t size = record_size(header.key_size, header.value_size);
+
+      if (header.value_size == kLogTombstone) {
+        if (it != index_.end()) {
+          index_.erase(it);
+        }
+      } else {
+        index_[key] = {id, offset, header.value_size};
+        segment.live_bytes += size;
+      }
+
+      offset += size;
+    }
+
+    // a crash in the middle of an append leaves a partial record at the end
+    // of the segment, which we drop
+    segment.size = offset;
+    if (ftruncate(segment.fd, offset) != 0) {
+      std::cerr << "Failed to truncate segment " << id << std::endl;
+    }
+  }
+
+  string root_;
+  uint64_t segment_size_;
+
+  std::map<unsigned, Segment> segments_;
+  unsigned active_;
+  std::unordered_map<Key, Location> index_;
+
+  // sealed segments that are sparse enough to be worth compacting
+  std::set<unsigned> candidates_;
+  bool compacting_;
+  unsigned compact_segment_;
+  uint64_t compact_offset_;
+
+  // scratch space used to assemble records before they are written
+  string buffer_;
+};
+
+#endif // INCLUDE_KVS_LOG_STORE_HPP_
@@ -0,0 +1,241 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_PACKED_SET_LATTICE_HPP_
+#define INCLUDE_KVS_PACKED_SET_LATTICE_HPP_
+
+#include "lattices/core_lattices.hpp"
+#include "wire_merge.hpp"
+
+// A set of strings kept sorted bytewise in three flat arrays: the elements
+// back to back in one buffer, the end offset of each element, and the first
+// eight bytes of each element as a big-endian integer. Most comparisons are
+// decided by one integer compare of the prefixes, and a union copies runs of
+// elements with a single memcpy, so merging two large sets neither allocates
+// per element nor chases pointers. The order is the one std::set<string>
+// uses, so the same set serves both SET and ORDERED_SET values.
+class PackedStringSet {
+  string bytes_;
+  vector<uint32_t> ends_;
+  vector<uint64_t> prefixes_;
+
+  static uint64_t prefix(const char *data, std::size_t size) {
+    uint64_t result = 0;
+    std::size_t count = std::min(size, sizeof(result));
+
+    for (std::size_t i = 0; i < count; i++) {
+      result |= (uint64_t)(unsigned char)data[i] << (56 - 8 * i);
+    }
+
+    return result;
+  }
+
+  std::size_t begin(std::size_t i) const { return i == 0 ? 0 : ends_[i - 1]; }
+
+  // orders element i of a before element j of b; equal prefixes of elements
+  // no longer than the prefix only differ in length, so only longer elements
+  // need the full compare
+  static int compare(const PackedStringSet &a, std::size_t i,
+                     const PackedStringSet &b, std::size_t j) {
+    if (a.prefixes_[i] != b.prefixes_[j]) {
+      return a.prefixes_[i] < b.prefixes_[j] ? -1 : 1;
+    }
+
+    WireBytes left = a.at(i);
+    WireBytes right = b.at(j);
+
+    if (left.size > sizeof(uint64_t) && right.size > sizeof(uint64_t)) {
+      int cmp = std::memcmp(left.data + sizeof(uint64_t),
+                            right.data + sizeof(uint64_t),
+                            std::min(left.size, right.size) - sizeof(uint64_t));
+      if (cmp != 0) {
+        return cmp;
+      }
+    }
+
+    return left.size < right.size ? -1 : (left.size > right.size ? 1 : 0);
+  }
+
+  // the end of the run of elements of a, starting at i, that order before
+  // element j of b, found by galloping: probe 1, 2, 4, ... elements ahead,
+  // then binary search the last step
+  static std::size_t run_end(const PackedStringSet &a, std::size_t i,
+                             const PackedStringSet &b, std::size_t j) {
+    std::size_t low = i, step = 1;
+
+    while (low + step < a.size() && compare(a, low + step, b, j) < 0) {
+      low += step;
+      step *= 2;
+    }
+
+    // a[low] < b[j], and b[j] <= a[high] unless high is the end
+    std::size_t high = std::min(low + step, a.size());
+    while (high - low > 1) {
+      std::size_t mid = low + (high - low) / 2;
+      if (compare(a, mid, b, j) < 0) {
+        low = mid;
+      } else {
+        high = mid;
+      }
+    }
+
+    return high;
+  }
+
+  // appends elements [from, to) of other, which must all order after the
+  // last element of this set
+  void append_run(const PackedStringSet &other, std::size_t from,
+                  std::size_t to) {
+    std::size_t start = other.begin(from);
+    std::size_t shift = bytes_.size() - start;
+
+    bytes_.append(other.bytes_, start, other.ends_[to - 1] - start);
+    prefixes_.insert(prefixes_.end(), other.prefixes_.begin() + from,
+                     other.prefixes_.begin() + to);
+
+    for (std::size_t i = from; i < to; i++) {
+      ends_.push_back(other.ends_[i] + shift);
+    }
+  }
+
+public:
+  std::size_t size() const { return ends_.size(); }
+
+  WireBytes at(std::size_t i) const {
+    return {bytes_.data() + begin(i), ends_[i] - begin(i)};
+  }
+
+  // appends an element, which must order after every element in the set
+  void append(const char *data, std::size_t size) {
+    bytes_.append(data, size);
+    ends_.push_back(bytes_.size());
+    prefixes_.push_back(prefix(data, size));
+  }
+
+  bool contains(const string &element) const {
+    PackedStringSet probe;
+    probe.append(element.data(), element.size());
+
+    std::size_t low = 0, high = size();
+    while (low < high) {
+      std::size_t mid = low + (high - low) / 2;
+      if (compare(*this, mid, probe, 0) < 0) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+
+    return low < size() && compare(*this, low, probe, 0) == 0;
+  }
+
+  // replaces this set with the union of this set and other
+  void merge(const PackedStringSet &other) {
+    if (other.size() == 0) {
+      return;
+    } else if (size() == 0) {
+      *this = other;
+      return;
+    }
+
+    PackedStringSet merged;
+    merged.bytes_.reserve(bytes_.size() + other.bytes_.size());
+    merged.ends_.reserve(size() + other.size());
+    merged.prefixes_.reserve(size() + other.size());
+
+    std::size_t i = 0, j = 0;
+
+    while (i < size() && j < other.size()) {
+      int cmp = compare(*this, i, other, j);
+
+      if (cmp < 0) {
+        std::size_t end = run_end(*this, i, other, j);
+        merged.append_run(*this, i, end);
+        i = end;
+      } else if (cmp > 0) {
+        std::size_t end = run_end(other, j, *this, i);
+        merged.append_run(other, j, end);
+        j = end;
+      } else {
+        merged.append_run(*this, i, i + 1);
+        i += 1;
+        j += 1;
+      }
+    }
+
+    if (i < size()) {
+      merged.append_run(*this, i, size());
+    }
+
+    if (j < other.size()) {
+      merged.append_run(other, j, other.size());
+    }
+
+    std::swap(*this, merged);
+  }
+
+  // builds a set from an encoded SetValue, without decoding it into a message
+  static PackedStringSet decode(const string &encoded) {
+    vector<WireBytes> elements;
+    wire_set_elements(encoded, elements);
+
+    PackedStringSet result;
+    result.ends_.reserve(elements.size());
+    result.prefixes_.reserve(elements.size());
+
+    for (const WireBytes &element : elements) {
+      result.append(element.data, element.size);
+    }
+
+    return result;
+  }
+
+  // encodes the set as a SetValue, with its elements in sorted order
+  string encode() const {
+    string encoded;
+    encoded.reserve(bytes_.size() + 2 * size());
+
+    for (std::size_t i = 0; i < size(); i++) {
+      WireBytes element = at(i);
+      encoded.push_back(kWireSetValuesTag);
+      wire_write_varint(encoded, element.size);
+      encoded.append(element.data, element.size);
+    }
+
+    return encoded;
+  }
+
+  // the bytes the set holds on the heap
+  std::size_t heap_bytes() const {
+    return bytes_.capacity() + ends_.capacity() * sizeof(uint32_t) +
+           prefixes_.capacity() * sizeof(uint64_t);
+  }
+};
+
+class PackedSetLattice : public Lattice<PackedStringSet> {
+protected:
+  void do_merge(const PackedStringSet &e) { this->element.merge(e); }
+
+public:
+  PackedSetLattice() : Lattice<PackedStringSet>() {}
+  PackedSetLattice(const PackedStringSet &e) : Lattice<PackedStringSet>(e) {}
+
+  MaxLattice<unsigned> size() const { return this->element.size(); }
+
+  BoolLattice contains(const string &element) const {
+    return this->element.contains(element);
+  }
+};
+
+#endif // INCLUDE_KVS_PACKED_SET_LATTICE_HPP_
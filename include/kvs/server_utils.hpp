@@ -15,14 +15,20 @@
 #ifndef INCLUDE_KVS_SERVER_UTILS_HPP_
 #define INCLUDE_KVS_SERVER_UTILS_HPP_
 
-#include <fstream>
+#include <array>
 #include <string>
-#include <unistd.h> // for ftruncate(2)
 
 #include "base_kv_store.hpp"
 #include "common.hpp"
+#include "file_store.hpp"
+#include "flat_kv_store.hpp"
 #include "kvs_common.hpp"
 #include "lattices/lww_pair_lattice.hpp"
+#include "log_store.hpp"
+#include "packed_set_lattice.hpp"
+#include "value_cache.hpp"
+#include "vector_clock.hpp"
+#include "wire_merge.hpp"
 #include "yaml-cpp/yaml.h"
 
 // Define the garbage collect threshold
@@ -42,6 +48,17 @@ typedef KVStore<Key, SingleKeyCausalLattice<SetLattice<string>>>
 typedef KVStore<Key, MultiKeyCausalLattice<SetLattice<string>>>
     MemoryMultiKeyCausalKVS;
 typedef KVStore<Key, PriorityLattice<double, string>> MemoryPriorityKVS;
+typedef KVStore<Key, PackedSetLattice> MemoryPackedSetKVS;
+
+typedef FlatKVStore<Key, LWWPairLattice<string>> FlatLWWKVS;
+typedef FlatKVStore<Key, SetLattice<string>> FlatSetKVS;
+typedef FlatKVStore<Key, OrderedSetLattice<string>> FlatOrderedSetKVS;
+typedef FlatKVStore<Key, SingleKeyCausalLattice<SetLattice<string>>>
+    FlatSingleKeyCausalKVS;
+typedef FlatKVStore<Key, MultiKeyCausalLattice<SetLattice<string>>>
+    FlatMultiKeyCausalKVS;
+typedef FlatKVStore<Key, PriorityLattice<double, string>> FlatPriorityKVS;
+typedef FlatKVStore<Key, PackedSetLattice> FlatPackedSetKVS;
 
 // a map that represents which keys should be sent to which IP-port combinations
 typedef map<Address, set<Key>> AddressKeysetMap;
@@ -54,111 +71,203 @@ public:
   virtual ~Serializer(){};
 };
 
-class MemoryLWWSerializer : public Serializer {
-  MemoryLWWKVS *kvs_;
+// Common to the memory serializers: a value's encoding is cached in the store
+// the first time it is read and served from there until the next merge
+// replaces it, so a hot key is encoded once per write rather than once per
+// read. The merge keeps the encoding's buffer, and a put counts it in the
+// key's size.
+template <typename KVS> class MemorySerializer : public Serializer {
+protected:
+  KVS *kvs_;
+
+  MemorySerializer(KVS *kvs) : kvs_(kvs) {}
+
+  // the cached encoding of key's value, or nullptr if there is none; it
+  // lives in the value's entry, and is only copied out into the result
+  const string *cache_lookup(const Key &key) { return kvs_->serialized(key); }
+
+  // caches the encoding of a value that was read successfully
+  string cache_fill(const Key &key, string serialized, AnnaError error) {
+    if (error == AnnaError::NO_ERROR) {
+      kvs_->cache_serialized(key, serialized);
+    }
+
+    return serialized;
+  }
+
+public:
+  void remove(const Key &key) { kvs_->remove(key); }
+};
 
+template <typename KVS>
+class BasicMemoryLWWSerializer final : public MemorySerializer<KVS> {
 public:
-  MemoryLWWSerializer(MemoryLWWKVS *kvs) : kvs_(kvs) {}
+  BasicMemoryLWWSerializer(KVS *kvs) : MemorySerializer<KVS>(kvs) {}
 
   string get(const Key &key, AnnaError &error) {
-    auto val = kvs_->get(key, error);
+    const string *cached = this->cache_lookup(key);
+    if (cached != nullptr) {
+      return *cached;
+    }
+
+    auto val = this->kvs_->get(key, error);
 
     if (val.reveal().value == "") {
       error = AnnaError::KEY_DNE;
     }
 
-    return serialize(val);
+    return this->cache_fill(key, serialize(val), error);
   }
 
   unsigned put(const Key &key, const string &serialized) {
     LWWPairLattice<string> val = deserialize_lww(serialized);
-    kvs_->put(key, val);
-    return kvs_->size(key);
+    this->kvs_->put(key, val);
+    return this->kvs_->bytes(key);
   }
-
-  void remove(const Key &key) { kvs_->remove(key); }
 };
 
-class MemorySetSerializer : public Serializer {
-  MemorySetKVS *kvs_;
+typedef BasicMemoryLWWSerializer<MemoryLWWKVS> MemoryLWWSerializer;
+typedef BasicMemoryLWWSerializer<FlatLWWKVS> FlatLWWSerializer;
 
+template <typename KVS>
+class BasicMemorySetSerializer final : public MemorySerializer<KVS> {
 public:
-  MemorySetSerializer(MemorySetKVS *kvs) : kvs_(kvs) {}
+  BasicMemorySetSerializer(KVS *kvs) : MemorySerializer<KVS>(kvs) {}
 
   string get(const Key &key, AnnaError &error) {
-    auto val = kvs_->get(key, error);
+    const string *cached = this->cache_lookup(key);
+    if (cached != nullptr) {
+      return *cached;
+    }
+
+    auto val = this->kvs_->get(key, error);
     if (val.size().reveal() == 0) {
       error = AnnaError::KEY_DNE;
     }
-    return serialize(val);
+    return this->cache_fill(key, serialize(val), error);
   }
 
   unsigned put(const Key &key, const string &serialized) {
     SetLattice<string> sl = deserialize_set(serialized);
-    kvs_->put(key, sl);
-    return kvs_->size(key);
+    this->kvs_->put(key, sl);
+    return this->kvs_->bytes(key);
   }
-
-  void remove(const Key &key) { kvs_->remove(key); }
 };
 
-class MemoryOrderedSetSerializer : public Serializer {
-  MemoryOrderedSetKVS *kvs_;
+typedef BasicMemorySetSerializer<MemorySetKVS> MemorySetSerializer;
+typedef BasicMemorySetSerializer<FlatSetKVS> FlatSetSerializer;
 
+template <typename KVS>
+class BasicMemoryOrderedSetSerializer final : public MemorySerializer<KVS> {
 public:
-  MemoryOrderedSetSerializer(MemoryOrderedSetKVS *kvs) : kvs_(kvs) {}
+  BasicMemoryOrderedSetSerializer(KVS *kvs) : MemorySerializer<KVS>(kvs) {}
 
   string get(const Key &key, AnnaError &error) {
-    auto val = kvs_->get(key, error);
-    return serialize(val);
+    const string *cached = this->cache_lookup(key);
+    if (cached != nullptr) {
+      return *cached;
+    }
+
+    auto val = this->kvs_->get(key, error);
+    return this->cache_fill(key, serialize(val), error);
   }
 
   unsigned put(const Key &key, const string &serialized) {
     OrderedSetLattice<string> sl = deserialize_ordered_set(serialized);
-    kvs_->put(key, sl);
-    return kvs_->size(key);
+    this->kvs_->put(key, sl);
+    return this->kvs_->bytes(key);
   }
-
-  void remove(const Key &key) { kvs_->remove(key); }
 };
 
-class MemorySingleKeyCausalSerializer : public Serializer {
-  MemorySingleKeyCausalKVS *kvs_;
+typedef BasicMemoryOrderedSetSerializer<MemoryOrderedSetKVS>
+    MemoryOrderedSetSerializer;
+typedef BasicMemoryOrderedSetSerializer<FlatOrderedSetKVS>
+    FlatOrderedSetSerializer;
 
+// Serves SET and ORDERED_SET values from a store of packed sets, which are
+// built from and encoded to the wire format directly. Both lattice types
+// share the encoding; only SET reports an empty set as missing.
+template <typename KVS, bool kEmptyIsMissing>
+class BasicMemoryPackedSetSerializer final : public MemorySerializer<KVS> {
 public:
-  MemorySingleKeyCausalSerializer(MemorySingleKeyCausalKVS *kvs) : kvs_(kvs) {}
+  BasicMemoryPackedSetSerializer(KVS *kvs) : MemorySerializer<KVS>(kvs) {}
 
   string get(const Key &key, AnnaError &error) {
-    auto val = kvs_->get(key, error);
+    const string *cached = this->cache_lookup(key);
+    if (cached != nullptr) {
+      return *cached;
+    }
+
+    auto val = this->kvs_->get(key, error);
+    if (kEmptyIsMissing && val.size().reveal() == 0) {
+      error = AnnaError::KEY_DNE;
+    }
+    return this->cache_fill(key, val.reveal().encode(), error);
+  }
+
+  unsigned put(const Key &key, const string &serialized) {
+    this->kvs_->put(key, PackedSetLattice(PackedStringSet::decode(serialized)));
+    return this->kvs_->bytes(key);
+  }
+};
+
+typedef BasicMemoryPackedSetSerializer<MemoryPackedSetKVS, true>
+    MemoryPackedSetSerializer;
+typedef BasicMemoryPackedSetSerializer<FlatPackedSetKVS, true>
+    FlatPackedSetSerializer;
+typedef BasicMemoryPackedSetSerializer<MemoryPackedSetKVS, false>
+    MemoryPackedOrderedSetSerializer;
+typedef BasicMemoryPackedSetSerializer<FlatPackedSetKVS, false>
+    FlatPackedOrderedSetSerializer;
+
+template <typename KVS>
+class BasicMemorySingleKeyCausalSerializer final : public MemorySerializer<KVS> {
+public:
+  BasicMemorySingleKeyCausalSerializer(KVS *kvs) : MemorySerializer<KVS>(kvs) {}
+
+  string get(const Key &key, AnnaError &error) {
+    const string *cached = this->cache_lookup(key);
+    if (cached != nullptr) {
+      return *cached;
+    }
+
+    auto val = this->kvs_->get(key, error);
     if (val.reveal().value.size().reveal() == 0) {
       error = AnnaError::KEY_DNE;
     }
-    return serialize(val);
+    return this->cache_fill(key, serialize(val), error);
   }
 
   unsigned put(const Key &key, const string &serialized) {
     SingleKeyCausalValue causal_value = deserialize_causal(serialized);
     VectorClockValuePair<SetLattice<string>> p =
         to_vector_clock_value_pair(causal_value);
-    kvs_->put(key, SingleKeyCausalLattice<SetLattice<string>>(p));
-    return kvs_->size(key);
+    this->kvs_->put(key, SingleKeyCausalLattice<SetLattice<string>>(p));
+    return this->kvs_->bytes(key);
   }
-
-  void remove(const Key &key) { kvs_->remove(key); }
 };
 
-class MemoryMultiKeyCausalSerializer : public Serializer {
-  MemoryMultiKeyCausalKVS *kvs_;
+typedef BasicMemorySingleKeyCausalSerializer<MemorySingleKeyCausalKVS>
+    MemorySingleKeyCausalSerializer;
+typedef BasicMemorySingleKeyCausalSerializer<FlatSingleKeyCausalKVS>
+    FlatSingleKeyCausalSerializer;
 
+template <typename KVS>
+class BasicMemoryMultiKeyCausalSerializer final : public MemorySerializer<KVS> {
 public:
-  MemoryMultiKeyCausalSerializer(MemoryMultiKeyCausalKVS *kvs) : kvs_(kvs) {}
+  BasicMemoryMultiKeyCausalSerializer(KVS *kvs) : MemorySerializer<KVS>(kvs) {}
 
   string get(const Key &key, AnnaError &error) {
-    auto val = kvs_->get(key, error);
+    const string *cached = this->cache_lookup(key);
+    if (cached != nullptr) {
+      return *cached;
+    }
+
+    auto val = this->kvs_->get(key, error);
     if (val.reveal().value.size().reveal() == 0) {
       error = AnnaError::KEY_DNE;
     }
-    return serialize(val);
+    return this->cache_fill(key, serialize(val), error);
   }
 
   unsigned put(const Key &key, const string &serialized) {
@@ -166,344 +275,422 @@ public:
         deserialize_multi_key_causal(serialized);
     MultiKeyCausalPayload<SetLattice<string>> p =
         to_multi_key_causal_payload(multi_key_causal_value);
-    kvs_->put(key, MultiKeyCausalLattice<SetLattice<string>>(p));
-    return kvs_->size(key);
+    this->kvs_->put(key, MultiKeyCausalLattice<SetLattice<string>>(p));
+    return this->kvs_->bytes(key);
   }
-
-  void remove(const Key &key) { kvs_->remove(key); }
 };
 
-class MemoryPrioritySerializer : public Serializer {
-  MemoryPriorityKVS *kvs_;
+typedef BasicMemoryMultiKeyCausalSerializer<MemoryMultiKeyCausalKVS>
+    MemoryMultiKeyCausalSerializer;
+typedef BasicMemoryMultiKeyCausalSerializer<FlatMultiKeyCausalKVS>
+    FlatMultiKeyCausalSerializer;
 
+template <typename KVS>
+class BasicMemoryPrioritySerializer final : public MemorySerializer<KVS> {
 public:
-  MemoryPrioritySerializer(MemoryPriorityKVS *kvs) : kvs_(kvs) {}
+  BasicMemoryPrioritySerializer(KVS *kvs) : MemorySerializer<KVS>(kvs) {}
 
   string get(const Key &key, AnnaError &error) {
-    auto val = kvs_->get(key, error);
+    const string *cached = this->cache_lookup(key);
+    if (cached != nullptr) {
+      return *cached;
+    }
+
+    auto val = this->kvs_->get(key, error);
     if (val.reveal().value == "") {
       error = AnnaError::KEY_DNE;
     }
-    return serialize(val);
+    return this->cache_fill(key, serialize(val), error);
   }
 
   unsigned put(const Key &key, const string &serialized) {
     PriorityLattice<double, string> val = deserialize_priority(serialized);
-    kvs_->put(key, val);
-    return kvs_->size(key);
+    this->kvs_->put(key, val);
+    return this->kvs_->bytes(key);
   }
-
-  void remove(const Key &key) { kvs_->remove(key); }
 };
 
-class DiskLWWSerializer : public Serializer {
-  unsigned tid_;
-  string ebs_root_;
+typedef BasicMemoryPrioritySerializer<MemoryPriorityKVS>
+    MemoryPrioritySerializer;
+typedef BasicMemoryPrioritySerializer<FlatPriorityKVS> FlatPrioritySerializer;
 
-public:
-  DiskLWWSerializer(unsigned &tid) : tid_(tid) {
-    YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
+// The disk serializers only differ in how they merge values; reading and
+// writing the bytes goes through the storage backend, and GETs are served
+// from an optional per-thread cache of values that were already read from
+// disk and validated.
+template <typename Store> class DiskSerializer : public Serializer {
+protected:
+  Store *store_;
+  ValueCache *cache_;
+
+  DiskSerializer(Store *store, ValueCache *cache)
+      : store_(store), cache_(cache) {}
 
-    ebs_root_ = conf["ebs"].as<string>();
+  bool cache_lookup(const Key &key, string &value) {
+    return cache_ != nullptr && cache_->get(key, value);
+  }
+
+  void cache_fill(const Key &key, const string &value) {
+    if (cache_ != nullptr) {
+      cache_->put(key, value);
+    }
+  }
+
+  // writes a new value for key, invalidating any cached copy
+  void write(const Key &key, const string &value) {
+    if (cache_ != nullptr) {
+      cache_->remove(key);
+    }
+
+    store_->put(key, value);
+  }
 
-    if (ebs_root_.back() != '/') {
-      ebs_root_ += "/";
+  // appends bytes to key's value, invalidating any cached copy; returns
+  // false if the key is not stored
+  bool extend(const Key &key, const string &bytes, uint64_t &size) {
+    if (cache_ != nullptr) {
+      cache_->remove(key);
     }
+
+    return store_->extend(key, bytes, size);
+  }
+
+public:
+  void remove(const Key &key) {
+    if (cache_ != nullptr) {
+      cache_->remove(key);
+    }
+
+    store_->remove(key);
   }
+};
+
+template <typename Store>
+class BasicDiskLWWSerializer final : public DiskSerializer<Store> {
+public:
+  BasicDiskLWWSerializer(Store *store, ValueCache *cache = nullptr)
+      : DiskSerializer<Store>(store, cache) {}
 
   string get(const Key &key, AnnaError &error) {
     string res;
     LWWValue value;
 
-    // open a new filestream for reading in a binary
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+    if (this->cache_lookup(key, res)) {
+      return res;
+    }
 
-    if (!input) {
+    if (!this->store_->get(key, res)) {
       error = AnnaError::KEY_DNE;
-    } else if (!value.ParseFromIstream(&input)) {
+    } else if (!value.ParseFromString(res)) {
       std::cerr << "Failed to parse payload." << std::endl;
       error = AnnaError::KEY_DNE;
+      res.clear();
+    } else if (value.value() == "") {
+      // a tombstone; it is returned as the memory tier returns it, so that
+      // it can be gossiped
+      error = AnnaError::KEY_DNE;
     } else {
-      if (value.value() == "") {
-        error = AnnaError::KEY_DNE;
-      } else {
-        value.SerializeToString(&res);
-      }
+      this->cache_fill(key, res);
     }
+
     return res;
   }
 
   unsigned put(const Key &key, const string &serialized) {
-    LWWValue input_value;
-    input_value.ParseFromString(serialized);
-
-    LWWValue original_value;
-
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
-
-    if (!input) { // in this case, this key has never been seen before, so we
-                  // attempt to create a new file for it
+    // only the timestamps are compared, so neither value is decoded
+    uint64_t input_timestamp;
+    string original;
+    uint64_t original_timestamp;
 
-      // ios::trunc means that we overwrite the existing file
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
-      if (!input_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload." << std::endl;
-      }
-      return output.tellp();
-    } else if (!original_value.ParseFromIstream(
-                   &input)) { // if we have seen the key before, attempt to
-                              // parse what was there before
+    if (!wire_lww_timestamp(serialized, input_timestamp)) {
+      // a malformed payload never replaces the stored value
+      std::cerr << "Failed to parse payload." << std::endl;
+      return this->store_->get(key, original) ? original.size() : 0;
+    } else if (!this->store_->get(key, original)) {
+      // in this case, this key has never been seen before
+      this->write(key, serialized);
+      return serialized.size();
+    } else if (!wire_lww_timestamp(original, original_timestamp)) {
       std::cerr << "Failed to parse payload." << std::endl;
       return 0;
+    } else if (input_timestamp >= original_timestamp) {
+      this->write(key, serialized);
+      return serialized.size();
     } else {
-      if (input_value.timestamp() >= original_value.timestamp()) {
-        std::fstream output(fname,
-                            std::ios::out | std::ios::trunc | std::ios::binary);
-        if (!input_value.SerializeToOstream(&output)) {
-          std::cerr << "Failed to write payload" << std::endl;
-        }
-        return output.tellp();
-      } else {
-        return input.tellp();
-      }
+      return original.size();
     }
   }
 
-  void remove(const Key &key) {
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-
-    if (std::remove(fname.c_str()) != 0) {
-      std::cerr << "Error deleting file" << std::endl;
-    }
-  }
 };
 
-class DiskSetSerializer : public Serializer {
-  unsigned tid_;
-  string ebs_root_;
+typedef BasicDiskLWWSerializer<FileStore> DiskLWWSerializer;
+typedef BasicDiskLWWSerializer<LogStore> LogLWWSerializer;
+
+// Disk SET and ORDERED_SET values are stored as a base image followed by a
+// log of deltas: a header of kSetDeltaMagic and the base's size, the base as
+// a SetValue with sorted elements, and then every put since the base was
+// written, appended as it arrived. Concatenated SetValue encodings are
+// themselves a SetValue, so the deltas need no framing of their own. Values
+// written before this layout (a bare SetValue, which never starts with
+// kSetDeltaMagic) are read as a base without deltas.
+const char kSetDeltaMagic = '\xff';
+const std::size_t kSetDeltaHeaderSize = 1 + sizeof(uint64_t);
+
+// The deltas are folded into a new base once they reach this fraction of
+// the base's size
+const double kSetDeltaRatio = 0.5;
+
+// Bases smaller than this are rewritten on every put, since rewriting them
+// costs about as much as appending
+const uint64_t kSetDeltaMinBase = 4096;
+
+template <typename Store>
+class DiskDeltaSetSerializer : public DiskSerializer<Store> {
+protected:
+  DiskDeltaSetSerializer(Store *store, ValueCache *cache)
+      : DiskSerializer<Store>(store, cache) {}
+
+  static bool parse_header(const string &stored, uint64_t &base_size) {
+    if (stored.size() < kSetDeltaHeaderSize || stored[0] != kSetDeltaMagic) {
+      return false;
+    }
 
-public:
-  DiskSetSerializer(unsigned &tid) : tid_(tid) {
-    YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
+    std::memcpy(&base_size, stored.data() + 1, sizeof(base_size));
+    return true;
+  }
 
-    ebs_root_ = conf["ebs"].as<string>();
+  // reads a key's set as a SetValue, with its deltas folded into the base;
+  // returns false if the key is not stored
+  bool read(const Key &key, string &value) {
+    string stored;
+    uint64_t base_size;
 
-    if (ebs_root_.back() != '/') {
-      ebs_root_ += "/";
+    if (!this->store_->get(key, stored)) {
+      return false;
+    } else if (!parse_header(stored, base_size) ||
+               base_size > stored.size() - kSetDeltaHeaderSize) {
+      value = std::move(stored);
+      return true;
     }
-  }
 
-  string get(const Key &key, AnnaError &error) {
-    string res;
-    SetValue value;
+    value.assign(stored, kSetDeltaHeaderSize, base_size);
 
-    // open a new filestream for reading in a binary
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+    if (stored.size() > kSetDeltaHeaderSize + base_size) {
+      string base = std::move(value);
+      string deltas = stored.substr(kSetDeltaHeaderSize + base_size);
 
-    if (!input) {
-      error = AnnaError::KEY_DNE;
-    } else if (!value.ParseFromIstream(&input)) {
-      std::cerr << "Failed to parse payload." << std::endl;
-      error = AnnaError::KEY_DNE;
-    } else {
-      if (value.values_size() == 0) {
-        error = AnnaError::KEY_DNE;
-      } else {
-        value.SerializeToString(&res);
+      if (!wire_set_union(base, deltas, value)) {
+        std::cerr << "Failed to parse payload." << std::endl;
+        value = std::move(base);
       }
     }
-    return res;
+
+    return true;
   }
 
+public:
   unsigned put(const Key &key, const string &serialized) {
-    SetValue input_value;
-    input_value.ParseFromString(serialized);
-
-    SetValue original_value;
-
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
-
-    if (!input) { // in this case, this key has never been seen before, so we
-                  // attempt to create a new file for it
-      // ios::trunc means that we overwrite the existing file
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
-      if (!input_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload." << std::endl;
-      }
-      return output.tellp();
-    } else if (!original_value.ParseFromIstream(
-                   &input)) { // if we have seen the key before, attempt to
-                              // parse what was there before
+    if (!wire_for_each_field(serialized, [](uint64_t, unsigned, const char *,
+                                            std::size_t) {})) {
       std::cerr << "Failed to parse payload." << std::endl;
       return 0;
-    } else {
-      // get the existing value that we have and merge
-      set<string> set_union;
-      for (auto &val : original_value.values()) {
-        set_union.emplace(std::move(val));
-      }
-      for (auto &val : input_value.values()) {
-        set_union.emplace(std::move(val));
-      }
+    }
 
-      SetValue new_value;
-      for (auto &val : set_union) {
-        new_value.add_values(std::move(val));
-      }
+    string header;
+    uint64_t base_size, stored_size, size;
+
+    // a large base takes the put as a delta, without being read, as long as
+    // its deltas stay within the ratio
+    if (this->store_->get_prefix(key, kSetDeltaHeaderSize, header,
+                                 stored_size) &&
+        parse_header(header, base_size) && base_size >= kSetDeltaMinBase &&
+        stored_size + serialized.size() <=
+            kSetDeltaHeaderSize + base_size * (1 + kSetDeltaRatio) &&
+        this->extend(key, serialized, size)) {
+      return size;
+    }
 
-      // write out the new payload.
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
+    // otherwise the stored set, if any, and the put are folded into a new
+    // base, kept sorted so that the next fold is a single pass over it; the
+    // put is never both appended and folded
+    string original, merged;
+    this->read(key, original);
 
-      if (!new_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload" << std::endl;
-      }
-      return output.tellp();
+    if (!wire_set_union(original, serialized, merged)) {
+      std::cerr << "Failed to parse payload." << std::endl;
+      return 0;
     }
-  }
 
-  void remove(const Key &key) {
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
+    base_size = merged.size();
+    string stored(1, kSetDeltaMagic);
+    stored.append(reinterpret_cast<const char *>(&base_size),
+                  sizeof(base_size));
+    stored += merged;
 
-    if (std::remove(fname.c_str()) != 0) {
-      std::cerr << "Error deleting file" << std::endl;
-    }
+    this->write(key, stored);
+    return stored.size();
   }
 };
 
-class DiskOrderedSetSerializer : public Serializer {
-  unsigned tid_;
-  string ebs_root_;
-
+template <typename Store>
+class BasicDiskSetSerializer final : public DiskDeltaSetSerializer<Store> {
 public:
-  DiskOrderedSetSerializer(unsigned &tid) : tid_(tid) {
-    YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
-
-    ebs_root_ = conf["ebs"].as<string>();
-
-    if (ebs_root_.back() != '/') {
-      ebs_root_ += "/";
-    }
-  }
+  BasicDiskSetSerializer(Store *store, ValueCache *cache = nullptr)
+      : DiskDeltaSetSerializer<Store>(store, cache) {}
 
   string get(const Key &key, AnnaError &error) {
     string res;
     SetValue value;
 
-    // open a new filestream for reading in a binary
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+    if (this->cache_lookup(key, res)) {
+      return res;
+    }
 
-    if (!input) {
+    if (!this->read(key, res)) {
       error = AnnaError::KEY_DNE;
-    } else if (!value.ParseFromIstream(&input)) {
+    } else if (!value.ParseFromString(res)) {
       std::cerr << "Failed to parse payload." << std::endl;
       error = AnnaError::KEY_DNE;
+      res.clear();
+    } else if (value.values_size() == 0) {
+      error = AnnaError::KEY_DNE;
+      res.clear();
     } else {
-      value.SerializeToString(&res);
+      this->cache_fill(key, res);
     }
+
     return res;
   }
+};
 
-  unsigned put(const Key &key, const string &serialized) {
-    SetValue input_value;
-    input_value.ParseFromString(serialized);
+typedef BasicDiskSetSerializer<FileStore> DiskSetSerializer;
+typedef BasicDiskSetSerializer<LogStore> LogSetSerializer;
+
+template <typename Store>
+class BasicDiskOrderedSetSerializer final
+    : public DiskDeltaSetSerializer<Store> {
+public:
+  BasicDiskOrderedSetSerializer(Store *store, ValueCache *cache = nullptr)
+      : DiskDeltaSetSerializer<Store>(store, cache) {}
 
-    SetValue original_value;
+  string get(const Key &key, AnnaError &error) {
+    string res;
+    SetValue value;
 
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+    if (this->cache_lookup(key, res)) {
+      return res;
+    }
 
-    if (!input) { // in this case, this key has never been seen before, so we
-                  // attempt to create a new file for it
-      // ios::trunc means that we overwrite the existing file
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
-      if (!input_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload." << std::endl;
-      }
-      return output.tellp();
-    } else if (!original_value.ParseFromIstream(
-                   &input)) { // if we have seen the key before, attempt to
-                              // parse what was there before
+    if (!this->read(key, res)) {
+      error = AnnaError::KEY_DNE;
+    } else if (!value.ParseFromString(res)) {
       std::cerr << "Failed to parse payload." << std::endl;
-      return 0;
+      error = AnnaError::KEY_DNE;
+      res.clear();
     } else {
-      // get the existing value that we have and merge
-      ordered_set<string> set_union;
-      for (auto &val : original_value.values()) {
-        set_union.emplace(std::move(val));
-      }
-      for (auto &val : input_value.values()) {
-        set_union.emplace(std::move(val));
-      }
-
-      SetValue new_value;
-      for (auto &val : set_union) {
-        new_value.add_values(std::move(val));
-      }
+      this->cache_fill(key, res);
+    }
 
-      // write out the new payload.
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
+    return res;
+  }
+};
 
-      if (!new_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload" << std::endl;
-      }
-      return output.tellp();
+typedef BasicDiskOrderedSetSerializer<FileStore> DiskOrderedSetSerializer;
+typedef BasicDiskOrderedSetSerializer<LogStore> LogOrderedSetSerializer;
+
+// Common to the disk causal serializers: vector clocks are merged as
+// CompactVectorClocks over interned client ids, which also lets clock
+// entries of retired clients be pruned (see ClientTable).
+template <typename Store>
+class DiskCausalSerializer : public DiskSerializer<Store> {
+protected:
+  ClientTable clients_;
+
+  DiskCausalSerializer(Store *store, ValueCache *cache, unsigned prune_after)
+      : DiskSerializer<Store>(store, cache), clients_(prune_after) {}
+
+  // Which version of a key a causal merge keeps, as the causal lattices
+  // decide it: the one whose clock dominates the other's, or both when the
+  // clocks are concurrent.
+  enum class Winner { INPUT, ORIGINAL, BOTH };
+
+  template <typename ProtoMap>
+  Winner merge_clocks(const ProtoMap &original, const ProtoMap &input,
+                      ProtoMap *merged, const TimePoint &now) {
+    CompactVectorClock clock, input_clock;
+    clock.parse(original, clients_);
+    input_clock.parse(input, clients_);
+    bool changed = clock.merge(input_clock, clients_, now);
+    clock.write(merged, clients_);
+
+    if (clock == input_clock) {
+      return Winner::INPUT;
+    } else if (!changed) {
+      return Winner::ORIGINAL;
+    } else {
+      return Winner::BOTH;
     }
   }
 
-  void remove(const Key &key) {
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
+  template <typename Values, typename Message>
+  static void merge_values(Winner winner, const Values &original,
+                           const Values &input, Message &merged) {
+    set<string> values;
 
-    if (std::remove(fname.c_str()) != 0) {
-      std::cerr << "Error deleting file" << std::endl;
+    if (winner != Winner::INPUT) {
+      values.insert(original.begin(), original.end());
     }
-  }
-};
 
-class DiskSingleKeyCausalSerializer : public Serializer {
-  unsigned tid_;
-  string ebs_root_;
-
-public:
-  DiskSingleKeyCausalSerializer(unsigned &tid) : tid_(tid) {
-    YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
+    if (winner != Winner::ORIGINAL) {
+      values.insert(input.begin(), input.end());
+    }
 
-    ebs_root_ = conf["ebs"].as<string>();
+    for (const string &val : values) {
+      merged.add_values(val);
+    }
+  }
 
-    if (ebs_root_.back() != '/') {
-      ebs_root_ += "/";
+  unsigned write_merged(const Key &key,
+                        const google::protobuf::Message &merged) {
+    string serialized;
+    if (!merged.SerializeToString(&serialized)) {
+      std::cerr << "Failed to write payload" << std::endl;
     }
+
+    this->write(key, serialized);
+    return serialized.size();
   }
+};
+
+template <typename Store>
+class BasicDiskSingleKeyCausalSerializer final
+    : public DiskCausalSerializer<Store> {
+public:
+  BasicDiskSingleKeyCausalSerializer(Store *store, ValueCache *cache = nullptr,
+                                     unsigned prune_after = 0)
+      : DiskCausalSerializer<Store>(store, cache, prune_after) {}
 
   string get(const Key &key, AnnaError &error) {
     string res;
     SingleKeyCausalValue value;
 
-    // open a new filestream for reading in a binary
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+    if (this->cache_lookup(key, res)) {
+      return res;
+    }
 
-    if (!input) {
+    if (!this->store_->get(key, res)) {
       error = AnnaError::KEY_DNE;
-    } else if (!value.ParseFromIstream(&input)) {
+    } else if (!value.ParseFromString(res)) {
       std::cerr << "Failed to parse payload." << std::endl;
       error = AnnaError::KEY_DNE;
+      res.clear();
+    } else if (value.values_size() == 0) {
+      error = AnnaError::KEY_DNE;
+      res.clear();
     } else {
-      if (value.values_size() == 0) {
-        error = AnnaError::KEY_DNE;
-      } else {
-        value.SerializeToString(&res);
-      }
+      this->cache_fill(key, res);
     }
+
     return res;
   }
 
@@ -511,116 +698,67 @@ public:
     SingleKeyCausalValue input_value;
     input_value.ParseFromString(serialized);
 
+    // a key that has never been seen before is merged into an empty value,
+    // so that its clock is pruned like any other
+    string original;
     SingleKeyCausalValue original_value;
 
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
-
-    if (!input) { // in this case, this key has never been seen before, so we
-                  // attempt to create a new file for it
-      // ios::trunc means that we overwrite the existing file
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
-      if (!input_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload." << std::endl;
-      }
-      return output.tellp();
-    } else if (!original_value.ParseFromIstream(
-                   &input)) { // if we have seen the key before, attempt to
-                              // parse what was there before
+    if (this->store_->get(key, original) &&
+        !original_value.ParseFromString(original)) {
       std::cerr << "Failed to parse payload." << std::endl;
       return 0;
-    } else {
-      // get the existing value that we have and merge
-      VectorClockValuePair<SetLattice<string>> orig_pair;
-      for (const auto &pair : original_value.vector_clock()) {
-        orig_pair.vector_clock.insert(pair.first, pair.second);
-      }
-      for (auto &val : original_value.values()) {
-        orig_pair.value.insert(std::move(val));
-      }
-      SingleKeyCausalLattice<SetLattice<string>> orig(orig_pair);
-
-      VectorClockValuePair<SetLattice<string>> input_pair;
-      for (const auto &pair : input_value.vector_clock()) {
-        input_pair.vector_clock.insert(pair.first, pair.second);
-      }
-      for (auto &val : input_value.values()) {
-        input_pair.value.insert(std::move(val));
-      }
-      SingleKeyCausalLattice<SetLattice<string>> input(input_pair);
-
-      orig.merge(input);
-
-      SingleKeyCausalValue new_value;
-      auto ptr = new_value.mutable_vector_clock();
-      // serialize vector clock
-      for (const auto &pair : orig.reveal().vector_clock.reveal()) {
-        (*ptr)[pair.first] = pair.second.reveal();
-      }
-
-      // serialize values
-      // note that this creates unnecessary copy of val, but
-      // we have to since the reveal() method is marked as "const"
-      for (const string &val : orig.reveal().value.reveal()) {
-        new_value.add_values(val);
-      }
-
-      // write out the new payload.
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
-
-      if (!new_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload" << std::endl;
-      }
-      return output.tellp();
     }
-  }
 
-  void remove(const Key &key) {
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
+    auto now = std::chrono::system_clock::now();
+    this->clients_.expire(now);
 
-    if (std::remove(fname.c_str()) != 0) {
-      std::cerr << "Error deleting file" << std::endl;
-    }
+    SingleKeyCausalValue new_value;
+    auto winner = this->merge_clocks(original_value.vector_clock(),
+                                     input_value.vector_clock(),
+                                     new_value.mutable_vector_clock(), now);
+    this->merge_values(winner, original_value.values(), input_value.values(),
+                       new_value);
+
+    return this->write_merged(key, new_value);
   }
 };
 
-class DiskMultiKeyCausalSerializer : public Serializer {
-  unsigned tid_;
-  string ebs_root_;
+typedef BasicDiskSingleKeyCausalSerializer<FileStore>
+    DiskSingleKeyCausalSerializer;
+typedef BasicDiskSingleKeyCausalSerializer<LogStore>
+    LogSingleKeyCausalSerializer;
 
-public:
-  DiskMultiKeyCausalSerializer(unsigned &tid) : tid_(tid) {
-    YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
+template <typename Store>
+class BasicDiskMultiKeyCausalSerializer final
+    : public DiskCausalSerializer<Store> {
+  typedef typename DiskCausalSerializer<Store>::Winner Winner;
 
-    ebs_root_ = conf["ebs"].as<string>();
-
-    if (ebs_root_.back() != '/') {
-      ebs_root_ += "/";
-    }
-  }
+public:
+  BasicDiskMultiKeyCausalSerializer(Store *store, ValueCache *cache = nullptr,
+                                    unsigned prune_after = 0)
+      : DiskCausalSerializer<Store>(store, cache, prune_after) {}
 
   string get(const Key &key, AnnaError &error) {
     string res;
     MultiKeyCausalValue value;
 
-    // open a new filestream for reading in a binary
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+    if (this->cache_lookup(key, res)) {
+      return res;
+    }
 
-    if (!input) {
+    if (!this->store_->get(key, res)) {
       error = AnnaError::KEY_DNE;
-    } else if (!value.ParseFromIstream(&input)) {
+    } else if (!value.ParseFromString(res)) {
       std::cerr << "Failed to parse payload." << std::endl;
       error = AnnaError::KEY_DNE;
+      res.clear();
+    } else if (value.values_size() == 0) {
+      error = AnnaError::KEY_DNE;
+      res.clear();
     } else {
-      if (value.values_size() == 0) {
-        error = AnnaError::KEY_DNE;
-      } else {
-        value.SerializeToString(&res);
-      }
+      this->cache_fill(key, res);
     }
+
     return res;
   }
 
@@ -628,190 +766,157 @@ public:
     MultiKeyCausalValue input_value;
     input_value.ParseFromString(serialized);
 
+    string original;
     MultiKeyCausalValue original_value;
 
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
-
-    if (!input) { // in this case, this key has never been seen before, so we
-                  // attempt to create a new file for it
-      // ios::trunc means that we overwrite the existing file
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
-
-      if (!input_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload." << std::endl;
-      }
-      return output.tellp();
-    } else if (!original_value.ParseFromIstream(
-                   &input)) { // if we have seen the key before, attempt to
-                              // parse what was there before
+    if (this->store_->get(key, original) &&
+        !original_value.ParseFromString(original)) {
       std::cerr << "Failed to parse payload." << std::endl;
       return 0;
-    } else {
-      // get the existing value that we have and merge
-      MultiKeyCausalPayload<SetLattice<string>> orig_payload;
-      for (const auto &pair : original_value.vector_clock()) {
-        orig_payload.vector_clock.insert(pair.first, pair.second);
-      }
-
-      for (const auto &dep : original_value.dependencies()) {
-        VectorClock vc;
-        for (const auto &pair : dep.vector_clock()) {
-          vc.insert(pair.first, pair.second);
-        }
-
-        orig_payload.dependencies.insert(dep.key(), vc);
-      }
-
-      for (auto &val : original_value.values()) {
-        orig_payload.value.insert(std::move(val));
-      }
-
-      MultiKeyCausalLattice<SetLattice<string>> orig(orig_payload);
-      MultiKeyCausalPayload<SetLattice<string>> input_payload;
-
-      for (const auto &pair : input_value.vector_clock()) {
-        input_payload.vector_clock.insert(pair.first, pair.second);
-      }
-
-      for (const auto &dep : input_value.dependencies()) {
-        VectorClock vc;
-        for (const auto &pair : dep.vector_clock()) {
-          vc.insert(pair.first, pair.second);
-        }
-        input_payload.dependencies.insert(dep.key(), vc);
-      }
-
-      for (auto &val : input_value.values()) {
-        input_payload.value.insert(std::move(val));
-      }
+    }
 
-      MultiKeyCausalLattice<SetLattice<string>> input(input_payload);
-      orig.merge(input);
+    auto now = std::chrono::system_clock::now();
+    this->clients_.expire(now);
 
-      MultiKeyCausalValue new_value;
-      auto ptr = new_value.mutable_vector_clock();
+    MultiKeyCausalValue new_value;
+    auto winner = this->merge_clocks(original_value.vector_clock(),
+                                     input_value.vector_clock(),
+                                     new_value.mutable_vector_clock(), now);
 
-      // serialize vector clock
-      for (const auto &pair : orig.reveal().vector_clock.reveal()) {
-        (*ptr)[pair.first] = pair.second.reveal();
-      }
+    // the stored dependencies are taken as they are, and only the input's
+    // can advance a client
+    map<Key, CompactVectorClock> dependencies;
 
-      // serialize dependencies
-      for (const auto &pair : orig.reveal().dependencies.reveal()) {
-        auto dep = new_value.add_dependencies();
-        dep->set_key(pair.first);
-        auto vc_ptr = dep->mutable_vector_clock();
-
-        for (const auto &vc_pair : pair.second.reveal()) {
-          (*vc_ptr)[vc_pair.first] = vc_pair.second.reveal();
+    if (winner != Winner::INPUT) {
+      for (const auto &dep : original_value.dependencies()) {
+        CompactVectorClock clock;
+        clock.parse(dep.vector_clock(), this->clients_);
+
+        auto it = dependencies.find(dep.key());
+        if (it == dependencies.end()) {
+          dependencies[dep.key()] = std::move(clock);
+        } else {
+          it->second.merge(clock, this->clients_, now);
         }
       }
+    }
 
-      // note that this creates unnecessary copy of val, but
-      // we have to since the reveal() method is marked as "const"
-      for (const string &val : orig.reveal().value.reveal()) {
-        new_value.add_values(val);
-      }
-
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
-
-      if (!new_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload" << std::endl;
+    if (winner != Winner::ORIGINAL) {
+      for (const auto &dep : input_value.dependencies()) {
+        CompactVectorClock clock;
+        clock.parse(dep.vector_clock(), this->clients_);
+        dependencies[dep.key()].merge(clock, this->clients_, now);
       }
+    }
 
-      return output.tellp();
+    for (const auto &pair : dependencies) {
+      auto dep = new_value.add_dependencies();
+      dep->set_key(pair.first);
+      pair.second.write(dep->mutable_vector_clock(), this->clients_);
     }
-  }
 
-  void remove(const Key &key) {
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
+    this->merge_values(winner, original_value.values(), input_value.values(),
+                       new_value);
 
-    if (std::remove(fname.c_str()) != 0) {
-      std::cerr << "Error deleting file" << std::endl;
-    }
+    return this->write_merged(key, new_value);
   }
 };
 
-class DiskPrioritySerializer : public Serializer {
-  unsigned tid_;
-  string ebs_root_;
-
-  //! Compute the name of the file that stores a value for a given key
-  string fname(const Key &key) const {
-    return ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-  }
+typedef BasicDiskMultiKeyCausalSerializer<FileStore>
+    DiskMultiKeyCausalSerializer;
+typedef BasicDiskMultiKeyCausalSerializer<LogStore>
+    LogMultiKeyCausalSerializer;
 
+template <typename Store>
+class BasicDiskPrioritySerializer final : public DiskSerializer<Store> {
 public:
-  DiskPrioritySerializer(unsigned tid) : tid_(tid) {
-    YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
-
-    ebs_root_ = conf["ebs"].as<string>();
-
-    if (ebs_root_.back() != '/')
-      ebs_root_ += "/";
-  }
+  BasicDiskPrioritySerializer(Store *store, ValueCache *cache = nullptr)
+      : DiskSerializer<Store>(store, cache) {}
 
   string get(const Key &key, AnnaError &error) override {
     string res;
     PriorityValue value;
 
-    std::fstream input(fname(key), std::ios::in | std::ios::binary);
+    if (this->cache_lookup(key, res)) {
+      return res;
+    }
 
-    if (!input) {
+    if (!this->store_->get(key, res)) {
       error = AnnaError::KEY_DNE;
-    } else if (!value.ParseFromIstream(&input)) {
+    } else if (!value.ParseFromString(res)) {
       std::cerr << "Failed to parse payload." << std::endl;
       error = AnnaError::KEY_DNE;
+      res.clear();
     } else if (value.value() == "") {
       error = AnnaError::KEY_DNE;
+      res.clear();
     } else {
-      value.SerializeToString(&res);
+      this->cache_fill(key, res);
     }
+
     return res;
   }
 
   unsigned put(const Key &key, const string &serialized) override {
-    PriorityValue input_value;
-    input_value.ParseFromString(serialized);
+    // only the priorities are compared, so neither value is decoded
+    double input_priority;
+    string original;
+    double original_priority;
 
-    int fd = open(fname(key).c_str(), O_RDWR | O_CREAT);
-    if (fd == -1) {
-      std::cerr << "Failed to open file" << std::endl;
-      return 0;
+    if (!wire_priority(serialized, input_priority)) {
+      // a malformed payload never replaces the stored value
+      std::cerr << "Failed to parse payload." << std::endl;
+      return this->store_->get(key, original) ? original.size() : 0;
     }
 
-    PriorityValue original_value;
-    if (!original_value.ParseFromFileDescriptor(fd) ||
-        input_value.priority() < original_value.priority()) {
-      // resize the file to 0
-      ftruncate(fd, 0);
-      // ftruncate does not change the fd's file offset, so we set it to 0
-      lseek(fd, 0, SEEK_SET);
-      if (!input_value.SerializeToFileDescriptor(fd))
-        std::cerr << "Failed to write payload" << std::endl;
+    if (!this->store_->get(key, original) ||
+        !wire_priority(original, original_priority) ||
+        input_priority < original_priority) {
+      this->write(key, serialized);
+      return serialized.size();
     }
 
-    unsigned pos = lseek(fd, 0, SEEK_CUR);
+    return original.size();
+  }
+
+};
+
+typedef BasicDiskPrioritySerializer<FileStore> DiskPrioritySerializer;
+typedef BasicDiskPrioritySerializer<LogStore> LogPrioritySerializer;
 
-    if (close(fd) == -1)
-      std::cerr << "Problem closing file" << std::endl;
+// A thread's serializers, indexed directly by lattice type, so that finding
+// the serializer for a tuple is an array access rather than a hash lookup.
+// Lattice types without a serializer, and any value outside the LatticeType
+// enum, map to a null slot.
+class SerializerMap {
+  std::array<Serializer *, LatticeType_ARRAYSIZE> serializers_;
 
-    return pos;
+  static unsigned index(LatticeType type) {
+    return LatticeType_IsValid(type) ? type : LatticeType::NONE;
   }
 
-  void remove(const Key &key) override {
-    if (std::remove(fname(key).c_str()) != 0) {
-      std::cerr << "Error deleting file" << std::endl;
+public:
+  SerializerMap() { serializers_.fill(nullptr); }
+
+  Serializer *&operator[](LatticeType type) {
+    return serializers_[index(type)];
+  }
+
+  Serializer *operator[](LatticeType type) const {
+    return serializers_[index(type)];
+  }
+
+  // calls f(type, serializer) for every lattice type with a serializer;
+  // f may replace the serializer, e.g. to wrap it
+  template <typename F> void for_each(F f) {
+    for (int type = LatticeType_MIN; type <= LatticeType_MAX; type++) {
+      if (serializers_[type] != nullptr) {
+        f(static_cast<LatticeType>(type), serializers_[type]);
+      }
     }
   }
 };
 
-using SerializerMap =
-    std::unordered_map<LatticeType, Serializer *, lattice_type_hash>;
-
 struct PendingRequest {
   PendingRequest() {}
   PendingRequest(RequestType type, LatticeType lattice_type, string payload,
@@ -0,0 +1,259 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_VALUE_CACHE_HPP_
+#define INCLUDE_KVS_VALUE_CACHE_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "types.hpp"
+
+// The fraction of the cache capacity given to the admission window
+const double kCacheWindowRatio = 0.01;
+
+// The fraction of the main region given to the protected segment
+const double kCacheProtectedRatio = 0.8;
+
+// The bookkeeping overhead charged against the capacity for every entry
+const unsigned kCacheEntryOverhead = 64;
+
+// The average entry size we assume when sizing the frequency sketch
+const unsigned kCacheExpectedEntrySize = 256;
+
+// The largest value a frequency sketch counter holds
+const uint8_t kSketchMaxCount = 15;
+
+// A count-min sketch that estimates how often each key has been accessed
+// recently. Once the number of recorded accesses reaches ten times the width,
+// every counter is halved, so old popularity fades.
+class FrequencySketch {
+  static const unsigned kRows = 4;
+
+public:
+  FrequencySketch(std::size_t width) : width_(64), additions_(0) {
+    while (width_ < width) {
+      width_ <<= 1;
+    }
+
+    table_.assign(kRows * width_, 0);
+    sample_size_ = 10 * width_;
+  }
+
+  void increment(const Key &key) {
+    uint64_t hash = std::hash<Key>{}(key);
+
+    for (unsigned row = 0; row < kRows; row++) {
+      uint8_t &counter = table_[index(hash, row)];
+      if (counter < kSketchMaxCount) {
+        counter += 1;
+      }
+    }
+
+    additions_ += 1;
+    if (additions_ >= sample_size_) {
+      reset();
+    }
+  }
+
+  unsigned frequency(const Key &key) const {
+    uint64_t hash = std::hash<Key>{}(key);
+    unsigned result = kSketchMaxCount;
+
+    for (unsigned row = 0; row < kRows; row++) {
+      result = std::min(result, (unsigned)table_[index(hash, row)]);
+    }
+
+    return result;
+  }
+
+private:
+  std::size_t index(uint64_t hash, unsigned row) const {
+    uint64_t h = (hash ^ (row + 1) * 0x9e3779b97f4a7c15ULL) *
+                 0xff51afd7ed558ccdULL;
+    return row * width_ + ((h >> 32) & (width_ - 1));
+  }
+
+  void reset() {
+    for (uint8_t &counter : table_) {
+      counter >>= 1;
+    }
+
+    additions_ /= 2;
+  }
+
+  std::size_t width_;
+  std::vector<uint8_t> table_;
+  std::size_t additions_;
+  std::size_t sample_size_;
+};
+
+// A bounded cache of serialized values, charged by size, with W-TinyLFU
+// eviction: new entries enter a small LRU window, and an entry leaving the
+// window only displaces an entry of the main region if the frequency sketch
+// says it is accessed more often. The main region is a segmented LRU, where
+// entries hit a second time move from the probation to the protected
+// segment. A one-off scan therefore cycles through the window without
+// flushing the hot keys out of the main region.
+class ValueCache {
+  enum Segment { WINDOW = 0, PROBATION = 1, PROTECTED = 2 };
+
+  struct Entry {
+    Key key;
+    string value;
+    std::size_t charge;
+    Segment segment;
+  };
+
+  typedef std::list<Entry> EntryList;
+
+public:
+  ValueCache(std::size_t capacity)
+      : capacity_(capacity), window_capacity_(capacity * kCacheWindowRatio),
+        main_capacity_(capacity - window_capacity_),
+        protected_capacity_(main_capacity_ * kCacheProtectedRatio),
+        sketch_(capacity / kCacheExpectedEntrySize), hits_(0), misses_(0) {
+    std::fill(bytes_, bytes_ + 3, 0);
+  }
+
+  ValueCache(const ValueCache &) = delete;
+  ValueCache &operator=(const ValueCache &) = delete;
+
+  // returns false and counts a miss if the key is not cached
+  bool get(const Key &key, string &value) {
+    sketch_.increment(key);
+    auto it = index_.find(key);
+
+    if (it == index_.end()) {
+      misses_ += 1;
+      return false;
+    }
+
+    hits_ += 1;
+    EntryList::iterator entry = it->second;
+    value = entry->value;
+
+    if (entry->segment == PROBATION) {
+      move(entry, PROTECTED);
+
+      // the protected segment overflows into the head of probation
+      while (bytes_[PROTECTED] > protected_capacity_) {
+        move(std::prev(lists_[PROTECTED].end()), PROBATION);
+      }
+    } else {
+      move(entry, entry->segment);
+    }
+
+    return true;
+  }
+
+  // caches a value that was just read from disk
+  void put(const Key &key, const string &value) {
+    std::size_t charge = key.size() + value.size() + kCacheEntryOverhead;
+
+    if (charge > main_capacity_) {
+      return;
+    }
+
+    remove(key);
+
+    lists_[WINDOW].push_front({key, value, charge, WINDOW});
+    index_[key] = lists_[WINDOW].begin();
+    bytes_[WINDOW] += charge;
+
+    while (bytes_[WINDOW] > window_capacity_) {
+      admit(std::prev(lists_[WINDOW].end()));
+    }
+  }
+
+  void remove(const Key &key) {
+    auto it = index_.find(key);
+
+    if (it != index_.end()) {
+      erase(it->second);
+    }
+  }
+
+  unsigned long long hits() const { return hits_; }
+
+  unsigned long long misses() const { return misses_; }
+
+  void reset_counters() {
+    hits_ = 0;
+    misses_ = 0;
+  }
+
+  // the number of bytes charged against the capacity
+  std::size_t bytes() const {
+    return bytes_[WINDOW] + bytes_[PROBATION] + bytes_[PROTECTED];
+  }
+
+private:
+  // moves an entry to the head of a segment
+  void move(EntryList::iterator entry, Segment segment) {
+    bytes_[entry->segment] -= entry->charge;
+    lists_[segment].splice(lists_[segment].begin(), lists_[entry->segment],
+                           entry);
+    entry->segment = segment;
+    bytes_[segment] += entry->charge;
+  }
+
+  void erase(EntryList::iterator entry) {
+    bytes_[entry->segment] -= entry->charge;
+    index_.erase(entry->key);
+    lists_[entry->segment].erase(entry);
+  }
+
+  // moves the candidate from the window into probation if it is accessed
+  // more often than the entries it has to displace, and drops it otherwise
+  void admit(EntryList::iterator candidate) {
+    unsigned frequency = sketch_.frequency(candidate->key);
+
+    while (bytes_[PROBATION] + bytes_[PROTECTED] + candidate->charge >
+           main_capacity_) {
+      EntryList &victims = lists_[PROBATION].empty() ? lists_[PROTECTED]
+                                                     : lists_[PROBATION];
+      EntryList::iterator victim = std::prev(victims.end());
+
+      if (frequency <= sketch_.frequency(victim->key)) {
+        erase(candidate);
+        return;
+      }
+
+      erase(victim);
+    }
+
+    move(candidate, PROBATION);
+  }
+
+  std::size_t capacity_;
+  std::size_t window_capacity_;
+  std::size_t main_capacity_;
+  std::size_t protected_capacity_;
+
+  EntryList lists_[3];
+  std::size_t bytes_[3];
+  std::unordered_map<Key, EntryList::iterator> index_;
+
+  FrequencySketch sketch_;
+  unsigned long long hits_;
+  unsigned long long misses_;
+};
+
+#endif // INCLUDE_KVS_VALUE_CACHE_HPP_
@@ -0,0 +1,249 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_VALUE_COMPRESSION_HPP_
+#define INCLUDE_KVS_VALUE_COMPRESSION_HPP_
+
+#include <iostream>
+
+#ifdef ANNA_WITH_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef ANNA_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "anna.pb.h"
+#include "wire_merge.hpp"
+
+// Large LWW values are compressed when a client puts them, and are stored,
+// gossiped and written to disk that way; they are only decompressed when they
+// are returned to a client. A compressed value takes the place of the
+// LWWValue's value as a frame: kCompressedMagic, the codec, the uncompressed
+// size as a varint, and the compressed bytes. A client value that happens to
+// start with kCompressedMagic is stored in a frame of codec NONE, so that
+// every stored value reads back unambiguously. Tombstones are empty, and so
+// are never framed.
+const string kCompressedMagic("\xfe"
+                              "AZ",
+                              3);
+
+enum class ValueCodec : char { NONE = 0, LZ4 = 1, ZSTD = 2 };
+
+// a compressed value is only kept if it is at most this fraction of the
+// original's size; otherwise the value is stored as it is
+const double kMaxCompressionRatio = 0.875;
+
+const int kZstdLevel = 3;
+
+// the largest size a frame may claim for its value, so that a corrupt frame
+// cannot make unpack allocate without bound
+const uint64_t kMaxUncompressedSize = (uint64_t)1 << 32;
+
+inline bool parse_value_codec(const string &name, ValueCodec &codec) {
+  if (name == "none") {
+    codec = ValueCodec::NONE;
+  } else if (name == "lz4") {
+    codec = ValueCodec::LZ4;
+  } else if (name == "zstd") {
+    codec = ValueCodec::ZSTD;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+// whether this build can compress and decompress with codec
+inline bool value_codec_available(ValueCodec codec) {
+  switch (codec) {
+  case ValueCodec::NONE:
+    return true;
+#ifdef ANNA_WITH_LZ4
+  case ValueCodec::LZ4:
+    return true;
+#endif
+#ifdef ANNA_WITH_ZSTD
+  case ValueCodec::ZSTD:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+class ValueCompressor {
+  ValueCodec codec_;
+  unsigned threshold_;
+
+  static bool framed(const WireBytes &value) {
+    return value.size >= kCompressedMagic.size() &&
+           std::memcmp(value.data, kCompressedMagic.data(),
+                       kCompressedMagic.size()) == 0;
+  }
+
+  // appends data compressed with codec to out; returns false if the codec is
+  // not available or fails
+  static bool compress(ValueCodec codec, const string &data, string &out) {
+    std::size_t offset = out.size();
+
+    switch (codec) {
+#ifdef ANNA_WITH_LZ4
+    case ValueCodec::LZ4: {
+      if (data.size() > LZ4_MAX_INPUT_SIZE) {
+        return false;
+      }
+
+      out.resize(offset + LZ4_compressBound(data.size()));
+      int size = LZ4_compress_default(data.data(), &out[offset], data.size(),
+                                      out.size() - offset);
+      out.resize(offset + std::max(size, 0));
+      return size > 0;
+    }
+#endif
+#ifdef ANNA_WITH_ZSTD
+    case ValueCodec::ZSTD: {
+      out.resize(offset + ZSTD_compressBound(data.size()));
+      std::size_t size = ZSTD_compress(&out[offset], out.size() - offset,
+                                       data.data(), data.size(), kZstdLevel);
+      if (ZSTD_isError(size)) {
+        out.resize(offset);
+        return false;
+      }
+
+      out.resize(offset + size);
+      return true;
+    }
+#endif
+    default:
+      return false;
+    }
+  }
+
+  // decompresses [pos, end) into out, which must be sized to the
+  // uncompressed size already
+  static bool decompress(ValueCodec codec, const char *pos, const char *end,
+                         string &out) {
+    switch (codec) {
+    case ValueCodec::NONE:
+      if ((std::size_t)(end - pos) != out.size()) {
+        return false;
+      }
+
+      out.assign(pos, end);
+      return true;
+#ifdef ANNA_WITH_LZ4
+    case ValueCodec::LZ4:
+      return out.size() <= LZ4_MAX_INPUT_SIZE &&
+             LZ4_decompress_safe(pos, &out[0], end - pos, out.size()) ==
+                 (int)out.size();
+#endif
+#ifdef ANNA_WITH_ZSTD
+    case ValueCodec::ZSTD:
+      return ZSTD_decompress(&out[0], out.size(), pos, end - pos) ==
+             out.size();
+#endif
+    default:
+      return false;
+    }
+  }
+
+public:
+  ValueCompressor() : codec_(ValueCodec::NONE), threshold_(0) {}
+
+  // compresses LWW values of at least threshold bytes with codec
+  ValueCompressor(ValueCodec codec, unsigned threshold)
+      : codec_(codec), threshold_(threshold) {}
+
+  ValueCodec codec() const { return codec_; }
+
+  // prepares a payload a client put for storage; only LWW values that are
+  // large or look like a frame are re-encoded
+  string pack(LatticeType type, string serialized) const {
+    WireBytes value;
+    if (type != LatticeType::LWW || !wire_lww_value(serialized, value)) {
+      return serialized;
+    }
+
+    bool large = codec_ != ValueCodec::NONE && value.size >= threshold_;
+    bool ambiguous = framed(value);
+
+    LWWValue lww;
+    if ((!large && !ambiguous) || !lww.ParseFromString(serialized)) {
+      return serialized;
+    }
+
+    string frame = kCompressedMagic;
+    frame.push_back((char)codec_);
+    wire_write_varint(frame, lww.value().size());
+    std::size_t header_size = frame.size();
+
+    if (!large || !compress(codec_, lww.value(), frame) ||
+        frame.size() > lww.value().size() * kMaxCompressionRatio) {
+      if (!ambiguous) {
+        return serialized;
+      }
+
+      frame.resize(header_size);
+      frame[kCompressedMagic.size()] = (char)ValueCodec::NONE;
+      frame += lww.value();
+    }
+
+    lww.set_value(std::move(frame));
+    return lww.SerializeAsString();
+  }
+
+  // restores a stored payload for a client, whatever codec it was packed
+  // with; payloads that fail to decompress are returned as they are stored
+  string unpack(LatticeType type, string serialized) const {
+    WireBytes value;
+    if (type != LatticeType::LWW || !wire_lww_value(serialized, value) ||
+        !framed(value)) {
+      return serialized;
+    }
+
+    LWWValue lww;
+    if (!lww.ParseFromString(serialized)) {
+      return serialized;
+    }
+
+    const string &frame = lww.value();
+    const char *pos = frame.data() + kCompressedMagic.size();
+    const char *end = frame.data() + frame.size();
+
+    if (pos < end) {
+      ValueCodec codec = (ValueCodec)*pos++;
+      uint64_t size;
+
+      if (wire_read_varint(pos, end, size) && size <= kMaxUncompressedSize) {
+        string raw(size, '\0');
+
+        if (decompress(codec, pos, end, raw)) {
+          lww.set_value(std::move(raw));
+          return lww.SerializeAsString();
+        }
+      }
+    }
+
+    std::cerr << "Failed to decompress value." << std::endl;
+    return serialized;
+  }
+};
+
+// how large LWW values are compressed on this node, from the storage
+// configuration
+extern ValueCompressor kValueCompressor;
+
+#endif // INCLUDE_KVS_VALUE_COMPRESSION_HPP_
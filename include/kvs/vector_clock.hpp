@@ -0,0 +1,253 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_VECTOR_CLOCK_HPP_
+#define INCLUDE_KVS_VECTOR_CLOCK_HPP_
+
+#include <algorithm>
+#include <cstdint>
+
+#include "kvs_types.hpp"
+
+// How often a ClientTable looks for clients to retire or forget
+const std::chrono::seconds kClientExpiryPeriod(1);
+
+// Interns the client ids that appear in vector clocks as small integers, so
+// that clocks can be merged by comparing integers rather than strings, and
+// tracks when each client last advanced an entry.
+//
+// With a nonzero prune horizon, a client that has not advanced any entry for
+// that long is retired: its entries are pruned from every clock this thread
+// merges, and entries for it that arrive from other replicas are dropped
+// rather than re-added. The horizon is meant to be far longer than the gossip
+// period, so that by the time a client is retired, every replica has seen its
+// writes and prunes them too. Only the entries the client had when it was
+// retired are dropped, though: an entry with a higher counter is a new write,
+// which brings the client back, so a client that pauses for longer than the
+// horizon does not lose its next write. Each thread's serializers retire
+// clients on their own, and this holds for each of them. A retired client is
+// forgotten after another horizon, and its id reused.
+class ClientTable {
+  struct Client {
+    string name;
+    TimePoint last_advanced;
+    bool retired;
+
+    // the highest counter seen for the client, which is what its entries
+    // were pruned up to once it is retired
+    uint32_t high_water;
+  };
+
+public:
+  ClientTable(unsigned prune_after)
+      : prune_after_(prune_after),
+        last_expiry_(std::chrono::system_clock::now()) {}
+
+  uint32_t intern(const string &name) {
+    auto it = ids_.find(name);
+    if (it != ids_.end()) {
+      return it->second;
+    }
+
+    uint32_t id;
+    Client client = {name, std::chrono::system_clock::now(), false, 0};
+
+    if (free_ids_.empty()) {
+      id = clients_.size();
+      clients_.push_back(client);
+    } else {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+      clients_[id] = client;
+    }
+
+    ids_[name] = id;
+    return id;
+  }
+
+  const string &name(uint32_t id) const { return clients_[id].name; }
+
+  bool retired(uint32_t id) const { return clients_[id].retired; }
+
+  // Records that a clock has an entry with count for the client, and returns
+  // whether the entry is kept. A retired client's entries are dropped up to
+  // its high water mark; a higher count brings it back.
+  bool observe(uint32_t id, uint32_t count) {
+    Client &client = clients_[id];
+
+    if (client.retired) {
+      if (count <= client.high_water) {
+        return false;
+      }
+
+      client.retired = false;
+      client.last_advanced = std::chrono::system_clock::now();
+    }
+
+    client.high_water = std::max(client.high_water, count);
+    return true;
+  }
+
+  void advanced(uint32_t id, const TimePoint &now) {
+    clients_[id].last_advanced = now;
+  }
+
+  // the number of clients with an id, retired or not
+  std::size_t size() const { return ids_.size(); }
+
+  // retires clients that have been idle for the horizon, and forgets those
+  // that have been retired for as long; does nothing if pruning is off or it
+  // ran less than kClientExpiryPeriod ago
+  void expire(const TimePoint &now) {
+    if (prune_after_ == 0 || now - last_expiry_ < kClientExpiryPeriod) {
+      return;
+    }
+
+    last_expiry_ = now;
+    std::chrono::seconds horizon(prune_after_);
+
+    for (uint32_t id = 0; id < clients_.size(); id++) {
+      Client &client = clients_[id];
+
+      if (client.name.empty() || now - client.last_advanced < horizon) {
+        continue;
+      }
+
+      if (!client.retired) {
+        // retirement counts as the start of the second horizon
+        client.retired = true;
+        client.last_advanced = now;
+      } else {
+        ids_.erase(client.name);
+        client.name.clear();
+        free_ids_.push_back(id);
+      }
+    }
+  }
+
+private:
+  unsigned prune_after_;
+  TimePoint last_expiry_;
+  hmap<string, uint32_t> ids_;
+  vector<Client> clients_;
+  vector<uint32_t> free_ids_;
+};
+
+// A vector clock as two parallel arrays, the interned client ids in
+// ascending order and their counters. Merging is a linear pass over both
+// clocks; when they have the same clients, which is the common case once a
+// key's writers are known to every replica, it is a pointwise max over the
+// counters that the compiler vectorizes.
+class CompactVectorClock {
+  vector<uint32_t> ids_;
+  vector<uint32_t> counts_;
+
+public:
+  // builds the clock from a protobuf map of client id to counter, leaving out
+  // the pruned entries of retired clients
+  template <typename ProtoMap>
+  void parse(const ProtoMap &clock, ClientTable &clients) {
+    vector<std::pair<uint32_t, uint32_t>> entries;
+    entries.reserve(clock.size());
+
+    for (const auto &pair : clock) {
+      uint32_t id = clients.intern(pair.first);
+      if (clients.observe(id, pair.second)) {
+        entries.push_back({id, pair.second});
+      }
+    }
+
+    std::sort(entries.begin(), entries.end());
+
+    ids_.resize(entries.size());
+    counts_.resize(entries.size());
+
+    for (std::size_t i = 0; i < entries.size(); i++) {
+      ids_[i] = entries[i].first;
+      counts_[i] = entries[i].second;
+    }
+  }
+
+  // writes the clock into a protobuf map of client id to counter
+  template <typename ProtoMap>
+  void write(ProtoMap *clock, const ClientTable &clients) const {
+    for (std::size_t i = 0; i < ids_.size(); i++) {
+      (*clock)[clients.name(ids_[i])] = counts_[i];
+    }
+  }
+
+  // Merges other into this clock, taking the larger counter of every client.
+  // Clients whose counters other advances are recorded as active. Returns
+  // whether other advanced any counter, i.e. whether this clock changed.
+  bool merge(const CompactVectorClock &other, ClientTable &clients,
+             const TimePoint &now) {
+    bool changed = false;
+
+    if (ids_ == other.ids_) {
+      for (std::size_t i = 0; i < ids_.size(); i++) {
+        if (other.counts_[i] > counts_[i]) {
+          clients.advanced(ids_[i], now);
+          changed = true;
+        }
+      }
+
+      uint32_t *counts = counts_.data();
+      const uint32_t *other_counts = other.counts_.data();
+      for (std::size_t i = 0; i < counts_.size(); i++) {
+        counts[i] = std::max(counts[i], other_counts[i]);
+      }
+
+      return changed;
+    }
+
+    vector<uint32_t> ids, counts;
+    ids.reserve(ids_.size() + other.ids_.size());
+    counts.reserve(ids_.size() + other.ids_.size());
+
+    std::size_t i = 0, j = 0;
+    while (i < ids_.size() || j < other.ids_.size()) {
+      if (j == other.ids_.size() ||
+          (i < ids_.size() && ids_[i] < other.ids_[j])) {
+        ids.push_back(ids_[i]);
+        counts.push_back(counts_[i++]);
+      } else if (i == ids_.size() || other.ids_[j] < ids_[i]) {
+        clients.advanced(other.ids_[j], now);
+        changed = true;
+        ids.push_back(other.ids_[j]);
+        counts.push_back(other.counts_[j++]);
+      } else {
+        if (other.counts_[j] > counts_[i]) {
+          clients.advanced(ids_[i], now);
+          changed = true;
+        }
+
+        ids.push_back(ids_[i]);
+        counts.push_back(std::max(counts_[i++], other.counts_[j++]));
+      }
+    }
+
+    ids_.swap(ids);
+    counts_.swap(counts);
+    return changed;
+  }
+
+  bool operator==(const CompactVectorClock &other) const {
+    return ids_ == other.ids_ && counts_ == other.counts_;
+  }
+
+  // the number of clients in the clock
+  std::size_t size() const { return ids_.size(); }
+};
+
+#endif // INCLUDE_KVS_VECTOR_CLOCK_HPP_
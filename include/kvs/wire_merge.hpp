@@ -0,0 +1,253 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_WIRE_MERGE_HPP_
+#define INCLUDE_KVS_WIRE_MERGE_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "types.hpp"
+
+// Merge kernels that work directly on the protobuf encodings of LWWValue,
+// PriorityValue and SetValue, so that the disk tier can merge a put into the
+// stored value without building message objects or copying every element.
+// They rely on the field numbers in anna.proto: the timestamp and priority
+// are field 1 of their messages, and the set elements are field 1 of
+// SetValue.
+
+// protobuf wire types
+const unsigned kWireVarint = 0;
+const unsigned kWireFixed64 = 1;
+const unsigned kWireLengthDelimited = 2;
+const unsigned kWireFixed32 = 5;
+
+// the tag of SetValue's values field: field 1, length-delimited
+const char kWireSetValuesTag = (1 << 3) | kWireLengthDelimited;
+
+// A view of one set element inside an encoded SetValue
+struct WireBytes {
+  const char *data;
+  std::size_t size;
+
+  bool operator<(const WireBytes &other) const {
+    int cmp = std::memcmp(data, other.data, std::min(size, other.size));
+    return cmp < 0 || (cmp == 0 && size < other.size);
+  }
+
+  bool operator==(const WireBytes &other) const {
+    return size == other.size && std::memcmp(data, other.data, size) == 0;
+  }
+};
+
+inline bool wire_read_varint(const char *&pos, const char *end,
+                             uint64_t &value) {
+  value = 0;
+
+  for (unsigned shift = 0; shift < 64 && pos < end; shift += 7) {
+    uint8_t byte = *pos++;
+    value |= (uint64_t)(byte & 0x7f) << shift;
+
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+inline void wire_write_varint(string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back((char)(value | 0x80));
+    value >>= 7;
+  }
+
+  out.push_back((char)value);
+}
+
+// Calls visit(field, wire_type, pos, size) for every top-level field of an
+// encoded message, where [pos, pos + size) holds the field's value (for
+// length-delimited fields, without the length prefix). Returns false if the
+// encoding is malformed.
+template <typename Visit>
+bool wire_for_each_field(const string &encoded, Visit visit) {
+  const char *pos = encoded.data();
+  const char *end = pos + encoded.size();
+
+  while (pos < end) {
+    uint64_t tag, size;
+    if (!wire_read_varint(pos, end, tag)) {
+      return false;
+    }
+
+    unsigned wire_type = tag & 0x7;
+    const char *start = pos;
+
+    switch (wire_type) {
+    case kWireVarint:
+      if (!wire_read_varint(pos, end, size)) {
+        return false;
+      }
+      size = pos - start;
+      break;
+    case kWireFixed64:
+      size = 8;
+      break;
+    case kWireFixed32:
+      size = 4;
+      break;
+    case kWireLengthDelimited:
+      if (!wire_read_varint(pos, end, size)) {
+        return false;
+      }
+      start = pos;
+      break;
+    default:
+      return false;
+    }
+
+    if (size > (uint64_t)(end - start)) {
+      return false;
+    }
+
+    visit(tag >> 3, wire_type, start, size);
+    pos = start + size;
+  }
+
+  return true;
+}
+
+// reads the timestamp of an encoded LWWValue, which is 0 if it is unset
+inline bool wire_lww_timestamp(const string &encoded, uint64_t &timestamp) {
+  timestamp = 0;
+
+  return wire_for_each_field(encoded, [&timestamp](uint64_t field,
+                                                   unsigned wire_type,
+                                                   const char *pos,
+                                                   std::size_t size) {
+    if (field == 1 && wire_type == kWireVarint) {
+      wire_read_varint(pos, pos + size, timestamp);
+    }
+  });
+}
+
+// finds the value of an encoded LWWValue, which is empty if it is unset
+inline bool wire_lww_value(const string &encoded, WireBytes &value) {
+  value = {encoded.data(), 0};
+
+  return wire_for_each_field(encoded, [&value](uint64_t field,
+                                               unsigned wire_type,
+                                               const char *pos,
+                                               std::size_t size) {
+    if (field == 2 && wire_type == kWireLengthDelimited) {
+      value = {pos, size};
+    }
+  });
+}
+
+// whether an encoded LWWValue is a tombstone, i.e. its value is empty; a
+// deleted key is written as one, with the time of the delete
+inline bool wire_lww_tombstone(const string &encoded) {
+  bool empty = true;
+
+  wire_for_each_field(encoded, [&empty](uint64_t field, unsigned wire_type,
+                                        const char *pos, std::size_t size) {
+    if (field == 2 && wire_type == kWireLengthDelimited && size > 0) {
+      empty = false;
+    }
+  });
+
+  return empty;
+}
+
+// reads the priority of an encoded PriorityValue, which is 0 if it is unset
+inline bool wire_priority(const string &encoded, double &priority) {
+  priority = 0;
+
+  return wire_for_each_field(encoded, [&priority](uint64_t field,
+                                                  unsigned wire_type,
+                                                  const char *pos,
+                                                  std::size_t size) {
+    if (field == 1 && wire_type == kWireFixed64) {
+      std::memcpy(&priority, pos, sizeof(priority));
+    }
+  });
+}
+
+// collects views of the elements of an encoded SetValue, sorted bytewise and
+// without duplicates; values the set tier wrote itself are already sorted,
+// so this is a single pass for them
+inline bool wire_set_elements(const string &encoded,
+                              vector<WireBytes> &elements) {
+  elements.clear();
+
+  bool parsed = wire_for_each_field(
+      encoded, [&elements](uint64_t field, unsigned wire_type,
+                           const char *pos, std::size_t size) {
+        if (field == 1 && wire_type == kWireLengthDelimited) {
+          elements.push_back({pos, size});
+        }
+      });
+
+  if (!std::is_sorted(elements.begin(), elements.end())) {
+    std::sort(elements.begin(), elements.end());
+  }
+
+  elements.erase(std::unique(elements.begin(), elements.end()),
+                 elements.end());
+  return parsed;
+}
+
+// Writes the union of two encoded SetValues to merged, as a SetValue whose
+// elements are sorted bytewise. The order is the one std::set<string> uses,
+// so the result is also a valid encoding of an ORDERED_SET.
+inline bool wire_set_union(const string &left, const string &right,
+                           string &merged) {
+  vector<WireBytes> left_elements, right_elements;
+
+  if (!wire_set_elements(left, left_elements) ||
+      !wire_set_elements(right, right_elements)) {
+    return false;
+  }
+
+  merged.clear();
+  merged.reserve(left.size() + right.size());
+
+  auto append = [&merged](const WireBytes &element) {
+    merged.push_back(kWireSetValuesTag);
+    wire_write_varint(merged, element.size);
+    merged.append(element.data, element.size);
+  };
+
+  auto l = left_elements.begin();
+  auto r = right_elements.begin();
+
+  while (l != left_elements.end() && r != right_elements.end()) {
+    if (*l < *r) {
+      append(*l++);
+    } else if (*r < *l) {
+      append(*r++);
+    } else {
+      append(*l++);
+      r++;
+    }
+  }
+
+  std::for_each(l, left_elements.end(), append);
+  std::for_each(r, right_elements.end(), append);
+  return true;
+}
+
+#endif // INCLUDE_KVS_WIRE_MERGE_HPP_
@@ -0,0 +1,502 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_WRITE_AHEAD_LOG_HPP_
+#define INCLUDE_KVS_WRITE_AHEAD_LOG_HPP_
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash_ring.hpp"
+#include "server_utils.hpp"
+
+// Group commit: buffered log records are written and synced once this many
+// bytes have accumulated...
+const unsigned kWalCommitBytes = 1 << 20;
+
+// ...or once the oldest buffered record is this old (in microseconds)
+const unsigned kWalCommitInterval = 5000;
+
+// The number of keys written to a snapshot per event loop iteration
+const unsigned kSnapshotBatch = 1000;
+
+// Every log and snapshot record is a header followed by the key and the
+// serialized payload; a record with lattice type NONE removes its key
+struct WalRecordHeader {
+  uint32_t key_size;
+  uint32_t payload_size;
+  uint32_t lattice_type;
+  uint32_t checksum;
+};
+
+// A per-thread write-ahead log for the memory tier. Every put and remove is
+// appended to the current log segment and synced in groups. The response to a
+// PUT is held until the commit that covers it has synced, so a write is only
+// acknowledged once it is durable. A snapshot of
+// all stored keys is written in the background a batch of keys at a time;
+// it starts a new log segment when it begins, so once it is complete every
+// older segment can be deleted. Recovery loads the newest snapshot and
+// replays the segments written since it began. Since lattice merges are
+// idempotent, replaying puts that the snapshot already contains is harmless.
+class WriteAheadLog {
+public:
+  WriteAheadLog(const string &root)
+      : root_(root), segment_fd_(-1), snapshot_id_(0), snapshotting_(false),
+        snapshot_failed_(false) {
+    if (root_.back() != '/') {
+      root_ += "/";
+    }
+
+    if (mkdir(root_.c_str(), 0755) != 0 && errno != EEXIST) {
+      std::cerr << "Failed to create log directory " << root_ << std::endl;
+    }
+  }
+
+  WriteAheadLog(const WriteAheadLog &) = delete;
+  WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+  ~WriteAheadLog() {
+    commit();
+    close(segment_fd_);
+  }
+
+  // Rebuilds the contents of the serializers from the newest snapshot and the
+  // log segments written after it, then opens a fresh segment for new
+  // records. The serializers passed in must not log their puts.
+  void recover(SerializerMap &serializers,
+               map<Key, KeyProperty> &stored_key_map) {
+    vector<unsigned> segments;
+    vector<unsigned> snapshots;
+    list_files(segments, snapshots);
+
+    unsigned latest_snapshot = 0;
+    if (snapshots.size() > 0) {
+      latest_snapshot = snapshots.back();
+      replay(snapshot_name(latest_snapshot), serializers, stored_key_map);
+    }
+
+    unsigned next_segment = latest_snapshot;
+    for (const unsigned &id : segments) {
+      if (id >= latest_snapshot) {
+        replay(segment_name(id), serializers, stored_key_map);
+      }
+
+      next_segment = std::max(next_segment, id + 1);
+    }
+
+    open_segment(next_segment);
+  }
+
+  void log_put(const Key &key, LatticeType lattice_type,
+               const string &payload) {
+    if (buffer_.empty()) {
+      oldest_record_ = std::chrono::steady_clock::now();
+    }
+
+    encode(buffer_, key, lattice_type, payload);
+
+    if (buffer_.size() >= kWalCommitBytes) {
+      commit();
+    }
+  }
+
+  void log_remove(const Key &key) { log_put(key, LatticeType::NONE, ""); }
+
+  // Holds a response to a request that wrote to the log until the buffered
+  // records are committed. Returns false if nothing is buffered, in which
+  // case the caller sends the response itself.
+  bool hold(const Address &address, const string &serialized) {
+    if (buffer_.empty()) {
+      return false;
+    }
+
+    held_.push_back(std::make_pair(address, serialized));
+    return true;
+  }
+
+  // sends the responses whose records have been committed since the last call
+  void release(SocketCache &pushers) {
+    for (const auto &response : committed_) {
+      kZmqUtil->send_string(response.second, &pushers[response.first]);
+    }
+
+    committed_.clear();
+  }
+
+  // commits the buffered records if the group commit interval has passed
+  // by now
+  void commit_if_due(const SteadyTimePoint &now) {
+    if (!buffer_.empty() &&
+        std::chrono::duration_cast<std::chrono::microseconds>(now -
+                                                              oldest_record_)
+                .count() >= kWalCommitInterval) {
+      commit();
+    }
+  }
+
+  // when the buffered records are due to be committed, if there are any
+  bool commit_deadline(SteadyTimePoint &deadline) const {
+    if (buffer_.empty()) {
+      return false;
+    }
+
+    deadline = oldest_record_ + std::chrono::microseconds(kWalCommitInterval);
+    return true;
+  }
+
+  // writes the buffered records to the current segment and syncs it; the
+  // responses held on them are then ready to be released. If the commit
+  // fails, they are dropped instead, and the clients retry on a timeout.
+  void commit() {
+    if (buffer_.empty()) {
+      return;
+    }
+
+    off_t end = lseek(segment_fd_, 0, SEEK_END);
+
+    if (!write_fully(segment_fd_, buffer_) || fdatasync(segment_fd_) != 0) {
+      std::cerr << "Failed to commit write-ahead log." << std::endl;
+      held_.clear();
+
+      // cut off the group, so that later commits do not land behind a torn
+      // record, where recovery would never reach them
+      if (end >= 0 && ftruncate(segment_fd_, end) != 0) {
+        std::cerr << "Failed to truncate write-ahead log." << std::endl;
+      }
+    }
+
+    for (auto &response : held_) {
+      committed_.push_back(std::move(response));
+    }
+
+    held_.clear();
+    buffer_.clear();
+  }
+
+  bool snapshotting() const { return snapshotting_; }
+
+  // Starts a snapshot of every key currently stored. New records go to a
+  // fresh segment from here on, which is the first segment recovery replays
+  // on top of this snapshot.
+  void begin_snapshot(const map<Key, KeyProperty> &stored_key_map) {
+    commit();
+    close(segment_fd_);
+    open_segment(segment_id_ + 1);
+
+    snapshot_id_ = segment_id_;
+    snapshot_fd_ = open(temporary_snapshot_name(snapshot_id_).c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (snapshot_fd_ == -1) {
+      std::cerr << "Failed to open snapshot " << snapshot_id_ << std::endl;
+      return;
+    }
+
+    snapshot_keys_.clear();
+    for (const auto &key_pair : stored_key_map) {
+      snapshot_keys_.push_back(key_pair.first);
+    }
+
+    snapshot_cursor_ = 0;
+    snapshot_failed_ = false;
+    snapshotting_ = true;
+  }
+
+  // Writes the next batch of keys to the snapshot in progress; once every
+  // key is written, the snapshot is made durable and the log segments it
+  // supersedes are deleted. A snapshot that could not be written in full is
+  // discarded, and the segments are kept.
+  void continue_snapshot(SerializerMap &serializers,
+                         map<Key, KeyProperty> &stored_key_map) {
+    if (!snapshotting_) {
+      return;
+    }
+
+    string batch;
+    unsigned end = std::min(snapshot_cursor_ + kSnapshotBatch,
+                            (unsigned)snapshot_keys_.size());
+
+    for (; snapshot_cursor_ < end; snapshot_cursor_++) {
+      const Key &key = snapshot_keys_[snapshot_cursor_];
+      auto it = stored_key_map.find(key);
+
+      // the key may have been removed since the snapshot began
+      if (it == stored_key_map.end() ||
+          it->second.type_ == LatticeType::NONE) {
+        continue;
+      }
+
+      // tombstones read back as KEY_DNE but must be kept, or the segments
+      // deleted below would take the deletes with them
+      AnnaError error = AnnaError::NO_ERROR;
+      string payload = serializers[it->second.type_]->get(key, error);
+
+      if (!payload.empty()) {
+        encode(batch, key, it->second.type_, payload);
+      }
+    }
+
+    if (!snapshot_failed_ && !write_fully(snapshot_fd_, batch)) {
+      std::cerr << "Failed to write snapshot " << snapshot_id_ << std::endl;
+      snapshot_failed_ = true;
+    }
+
+    if (snapshot_cursor_ < snapshot_keys_.size()) {
+      return;
+    }
+
+    if (!snapshot_failed_ && fdatasync(snapshot_fd_) != 0) {
+      std::cerr << "Failed to sync snapshot " << snapshot_id_ << std::endl;
+      snapshot_failed_ = true;
+    }
+
+    close(snapshot_fd_);
+    snapshot_keys_.clear();
+    snapshotting_ = false;
+
+    if (!snapshot_failed_ &&
+        rename(temporary_snapshot_name(snapshot_id_).c_str(),
+               snapshot_name(snapshot_id_).c_str()) != 0) {
+      std::cerr << "Failed to rename snapshot " << snapshot_id_ << std::endl;
+      snapshot_failed_ = true;
+    }
+
+    if (snapshot_failed_) {
+      std::remove(temporary_snapshot_name(snapshot_id_).c_str());
+      return;
+    }
+
+    // everything before this snapshot is now redundant
+    vector<unsigned> segments;
+    vector<unsigned> snapshots;
+    list_files(segments, snapshots);
+
+    for (const unsigned &id : segments) {
+      if (id < snapshot_id_) {
+        std::remove(segment_name(id).c_str());
+      }
+    }
+
+    for (const unsigned &id : snapshots) {
+      if (id < snapshot_id_) {
+        std::remove(snapshot_name(id).c_str());
+      }
+    }
+  }
+
+private:
+  string segment_name(unsigned id) const {
+    return root_ + "log_" + std::to_string(id) + ".wal";
+  }
+
+  string snapshot_name(unsigned id) const {
+    return root_ + "snapshot_" + std::to_string(id) + ".snap";
+  }
+
+  string temporary_snapshot_name(unsigned id) const {
+    return root_ + "snapshot_" + std::to_string(id) + ".tmp";
+  }
+
+  // collects the ids of the log segments and complete snapshots in the
+  // directory in ascending order, and deletes unfinished snapshots
+  void list_files(vector<unsigned> &segments, vector<unsigned> &snapshots) {
+    DIR *dir = opendir(root_.c_str());
+    if (dir == nullptr) {
+      return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      string name = entry->d_name;
+
+      if (has_affixes(name, "log_", ".wal")) {
+        segments.push_back(std::stoul(name.substr(4)));
+      } else if (has_affixes(name, "snapshot_", ".snap")) {
+        snapshots.push_back(std::stoul(name.substr(9)));
+      } else if (has_affixes(name, "snapshot_", ".tmp") && !snapshotting_) {
+        std::remove((root_ + name).c_str());
+      }
+    }
+
+    closedir(dir);
+
+    std::sort(segments.begin(), segments.end());
+    std::sort(snapshots.begin(), snapshots.end());
+  }
+
+  static bool has_affixes(const string &name, const string &prefix,
+                          const string &suffix) {
+    return name.size() > prefix.size() + suffix.size() &&
+           name.compare(0, prefix.size(), prefix) == 0 &&
+           name.compare(name.size() - suffix.size(), suffix.size(), suffix) ==
+               0;
+  }
+
+  void open_segment(unsigned id) {
+    segment_id_ = id;
+    segment_fd_ =
+        open(segment_name(id).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+    if (segment_fd_ == -1) {
+      std::cerr << "Failed to open log segment " << id << std::endl;
+    }
+  }
+
+  // FNV-1a over the lattice type, key and payload, to detect records that
+  // were only partially written before a crash
+  static uint32_t checksum(const Key &key, uint32_t lattice_type,
+                           const char *payload, std::size_t payload_size) {
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](const char *data, std::size_t size) {
+      for (std::size_t i = 0; i < size; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+      }
+    };
+
+    mix(reinterpret_cast<const char *>(&lattice_type), sizeof(lattice_type));
+    mix(key.data(), key.size());
+    mix(payload, payload_size);
+    return hash;
+  }
+
+  static void encode(string &buffer, const Key &key, LatticeType lattice_type,
+                     const string &payload) {
+    WalRecordHeader header;
+    header.key_size = key.size();
+    header.payload_size = payload.size();
+    header.lattice_type = lattice_type;
+    header.checksum =
+        checksum(key, lattice_type, payload.data(), payload.size());
+
+    buffer.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    buffer.append(key);
+    buffer.append(payload);
+  }
+
+  static bool write_fully(int fd, const string &data) {
+    std::size_t written = 0;
+
+    while (written < data.size()) {
+      ssize_t count = write(fd, data.data() + written, data.size() - written);
+      if (count < 0 && errno == EINTR) {
+        continue;
+      } else if (count <= 0) {
+        return false;
+      }
+
+      written += count;
+    }
+
+    return true;
+  }
+
+  // applies every intact record of a file; a torn or corrupt record ends
+  // the file, since it is from a commit that never finished syncing, and
+  // neither it nor anything after it was acknowledged
+  static void replay(const string &fname, SerializerMap &serializers,
+                     map<Key, KeyProperty> &stored_key_map) {
+    std::ifstream input(fname, std::ios::in | std::ios::binary);
+
+    WalRecordHeader header;
+    string key;
+    string payload;
+
+    while (input.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+      key.resize(header.key_size);
+      payload.resize(header.payload_size);
+
+      if (!input.read(&key[0], header.key_size) ||
+          !input.read(&payload[0], header.payload_size) ||
+          header.checksum != checksum(key, header.lattice_type,
+                                      payload.data(), payload.size())) {
+        std::cerr << "Ignoring torn record at the end of " << fname
+                  << std::endl;
+        break;
+      }
+
+      LatticeType lattice_type = static_cast<LatticeType>(header.lattice_type);
+
+      if (lattice_type == LatticeType::NONE) {
+        auto it = stored_key_map.find(key);
+        if (it != stored_key_map.end()) {
+          serializers[it->second.type_]->remove(key);
+          stored_key_map.erase(it);
+        }
+      } else {
+        stored_key_map[key].size_ = serializers[lattice_type]->put(key, payload);
+        stored_key_map[key].type_ = lattice_type;
+      }
+    }
+  }
+
+  string root_;
+
+  // records that have not been written to the current segment yet
+  string buffer_;
+  SteadyTimePoint oldest_record_;
+
+  // responses, by address, waiting for the buffered records to be committed,
+  // and those whose records have been
+  vector<std::pair<Address, string>> held_;
+  vector<std::pair<Address, string>> committed_;
+
+  unsigned segment_id_;
+  int segment_fd_;
+
+  // the snapshot in progress, if any
+  unsigned snapshot_id_;
+  int snapshot_fd_;
+  bool snapshotting_;
+  vector<Key> snapshot_keys_;
+  unsigned snapshot_cursor_;
+
+  // set once a write to the snapshot in progress fails
+  bool snapshot_failed_;
+};
+
+// Logs every put and remove of the serializer it wraps to a write-ahead log
+class LoggedSerializer final : public Serializer {
+  Serializer *serializer_;
+  LatticeType lattice_type_;
+  WriteAheadLog *wal_;
+
+public:
+  LoggedSerializer(Serializer *serializer, LatticeType lattice_type,
+                   WriteAheadLog *wal)
+      : serializer_(serializer), lattice_type_(lattice_type), wal_(wal) {}
+
+  string get(const Key &key, AnnaError &error) {
+    return serializer_->get(key, error);
+  }
+
+  unsigned put(const Key &key, const string &serialized) {
+    wal_->log_put(key, lattice_type_, serialized);
+    return serializer_->put(key, serialized);
+  }
+
+  void remove(const Key &key) {
+    wal_->log_remove(key);
+    serializer_->remove(key);
+  }
+};
+
+#endif // INCLUDE_KVS_WRITE_AHEAD_LOG_HPP_
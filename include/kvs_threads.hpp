@@ -49,6 +49,9 @@ const unsigned kCacheIpResponsePort = 7050;
 // request for the list of all existing function nodes.
 const unsigned kManagementNodeResponsePort = 7100;
 
+// The port on which KVS servers listen for key range scans.
+const unsigned kScanRequestPort = 7400;
+
 // The port on which routing servers listen for cluster membership requests.
 const unsigned kSeedPort = 6350;
 
@@ -62,6 +65,16 @@ const unsigned kRoutingReplicationResponsePort = 6500;
 // announcements from the monitoring system.
 const unsigned kRoutingReplicationChangePort = 6550;
 
+// The port on which routing servers listen for key range scans from clients.
+const unsigned kRoutingScanPort = 7450;
+
+// The port on which routing servers listen for the parts of a scan that KVS
+// servers return.
+const unsigned kRoutingScanResponsePort = 7500;
+
+// The port on which clients listen for the answers to their key range scans.
+const unsigned kUserScanResponsePort = 7550;
+
 // The port on which the monitoring system listens for cluster membership
 // changes.
 const unsigned kMonitoringNotifyPort = 6600;
@@ -200,6 +213,14 @@ public:
   Address replication_change_bind_address() const {
     return kBindBase + std::to_string(tid_ + kServerReplicationChangePort);
   }
+
+  Address scan_request_connect_address() const {
+    return private_base_ + std::to_string(tid_ + kScanRequestPort);
+  }
+
+  Address scan_request_bind_address() const {
+    return kBindBase + std::to_string(tid_ + kScanRequestPort);
+  }
 };
 
 inline bool operator==(const ServerThread &l, const ServerThread &r) {
@@ -264,6 +285,22 @@ public:
   Address replication_change_bind_address() const {
     return kBindBase + std::to_string(tid_ + kRoutingReplicationChangePort);
   }
+
+  Address scan_connect_address() const {
+    return ip_base_ + std::to_string(tid_ + kRoutingScanPort);
+  }
+
+  Address scan_bind_address() const {
+    return kBindBase + std::to_string(tid_ + kRoutingScanPort);
+  }
+
+  Address scan_response_connect_address() const {
+    return ip_base_ + std::to_string(tid_ + kRoutingScanResponsePort);
+  }
+
+  Address scan_response_bind_address() const {
+    return kBindBase + std::to_string(tid_ + kRoutingScanResponsePort);
+  }
 };
 
 class MonitoringThread {
@@ -27,6 +27,9 @@ using AccessStats = map<Address, map<unsigned, unsigned>>;
 
 using TimePoint = std::chrono::time_point<std::chrono::system_clock>;
 
+// a point in time on a clock that never jumps, for timers and timeouts
+using SteadyTimePoint = std::chrono::steady_clock::time_point;
+
 using ServerThreadList = vector<ServerThread>;
 
 using ServerThreadSet = std::unordered_set<ServerThread, ThreadHash>;
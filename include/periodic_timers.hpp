@@ -0,0 +1,85 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_PERIODIC_TIMERS_HPP_
+#define INCLUDE_PERIODIC_TIMERS_HPP_
+
+#include <algorithm>
+#include <functional>
+
+#include "kvs_types.hpp"
+
+// The periodic work of an event loop. Each task runs once per period, and
+// the timers are kept in a min-heap on their deadlines, so the loop only
+// compares the time it already read after polling against the earliest
+// deadline, and knows how long it may block for. A task that comes due
+// late runs once, not once for every period it missed, and next runs a
+// full period later.
+class PeriodicTimers {
+public:
+  typedef std::function<void(const SteadyTimePoint &now)> Task;
+
+  // runs task every period, the first time one period after now
+  void add(std::chrono::steady_clock::duration period,
+           const SteadyTimePoint &now, Task task) {
+    timers_.push_back({now + period, period, std::move(task)});
+    heap_.push_back(timers_.size() - 1);
+    std::push_heap(heap_.begin(), heap_.end(), Later(timers_));
+  }
+
+  // runs the tasks that are due at now; tasks must not add timers
+  void run_due(const SteadyTimePoint &now) {
+    while (!heap_.empty() && timers_[heap_.front()].due <= now) {
+      std::pop_heap(heap_.begin(), heap_.end(), Later(timers_));
+
+      Timer &timer = timers_[heap_.back()];
+      timer.task(now);
+      timer.due = now + timer.period;
+
+      std::push_heap(heap_.begin(), heap_.end(), Later(timers_));
+    }
+  }
+
+  // when the next task is due, or SteadyTimePoint::max() if there are none
+  SteadyTimePoint next_deadline() const {
+    return heap_.empty() ? SteadyTimePoint::max() : timers_[heap_.front()].due;
+  }
+
+  std::size_t size() const { return timers_.size(); }
+
+private:
+  struct Timer {
+    SteadyTimePoint due;
+    std::chrono::steady_clock::duration period;
+    Task task;
+  };
+
+  // orders the heap so that the earliest deadline is at its front
+  struct Later {
+    const vector<Timer> &timers;
+
+    Later(const vector<Timer> &timers) : timers(timers) {}
+
+    bool operator()(std::size_t a, std::size_t b) const {
+      return timers[a].due > timers[b].due;
+    }
+  };
+
+  vector<Timer> timers_;
+
+  // the indices of the timers in timers_, as a heap
+  vector<std::size_t> heap_;
+};
+
+#endif // INCLUDE_PERIODIC_TIMERS_HPP_
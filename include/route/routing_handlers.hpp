@@ -18,6 +18,37 @@
 #include "hash_ring.hpp"
 #include "metadata.pb.h"
 
+// the number of keys a scan returns per response if the request sets no limit,
+// and the most it returns whatever the limit
+const unsigned kDefaultScanLimit = 1000;
+const unsigned kMaxScanLimit = 10000;
+
+// how long (in milliseconds) a routing thread waits for every storage thread
+// to answer a scan before it responds with what it has
+const unsigned kScanTimeout = 5000;
+
+// how often (in milliseconds) a routing thread looks for scans that have
+// timed out
+const unsigned kScanExpiryPeriod = 500;
+
+// A scan that has been sent to the storage threads and is waiting for their
+// answers, which are merged as they arrive
+struct PendingScan {
+  Address response_address_;
+  string request_id_;
+  unsigned limit_;
+
+  // the storage threads that have not answered yet
+  unsigned outstanding_;
+
+  // set if some storage thread stopped at the limit, so that there may be
+  // more keys than it returned
+  bool truncated_;
+
+  ordered_set<Key> keys_;
+  SteadyTimePoint deadline_;
+};
+
 string seed_handler(logger log, GlobalRingMap &global_hash_rings);
 
 void membership_handler(logger log, string &serialized, SocketCache &pushers,
@@ -42,4 +73,14 @@ void address_handler(logger log, string &serialized, SocketCache &pushers,
                      map<Key, vector<pair<Address, string>>> &pending_requests,
                      unsigned &seed);
 
+void scan_handler(logger log, string &serialized, SocketCache &pushers,
+                  RoutingThread &rt, GlobalRingMap &global_hash_rings,
+                  map<string, PendingScan> &pending_scans, unsigned &scan_id);
+
+void scan_response_handler(string &serialized, SocketCache &pushers,
+                           map<string, PendingScan> &pending_scans);
+
+void expire_scans(logger log, SocketCache &pushers,
+                  map<string, PendingScan> &pending_scans);
+
 #endif // INCLUDE_ROUTE_ROUTING_HANDLERS_HPP_
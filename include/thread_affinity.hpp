@@ -0,0 +1,182 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_THREAD_AFFINITY_HPP_
+#define INCLUDE_THREAD_AFFINITY_HPP_
+
+#include <cctype>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+#include "types.hpp"
+
+// Each server and routing thread owns its sockets and stores, so it keeps
+// its caches warm, and its memory near, only if it stays on one core. With
+// an affinity list configured, a thread pins itself to its core as the first
+// thing it does. Its memory policy is then set to allocate locally. The
+// kernel places a page on the node of the core that first touches it, and
+// the thread builds its stores itself, so they end up on its own NUMA node
+// even if the process was started with another policy, e.g. interleaving.
+//
+// A thread starts on the CPUs of the thread that creates it, so a helper that
+// a pinned thread starts, such as its disk I/O thread, would otherwise share
+// its one core and take turns with it. Helpers are moved onto helper_cpus
+// instead: the CPUs the process was started on, less those of the pinned
+// threads. They keep the local memory policy, which then follows whichever
+// core they run on.
+
+// the memory policy that allocates on the node of the allocating core, from
+// linux/mempolicy.h
+const int kLocalMemoryPolicy = 4;
+
+// Parses a list of CPUs such as "0-3,8,10-11" into the CPUs in the order
+// they are listed. Returns false if the list is malformed.
+inline bool parse_cpu_list(const string &list, vector<unsigned> &cpus) {
+  std::size_t pos = 0;
+
+  while (true) {
+    std::size_t end = list.find(',', pos);
+    if (end == string::npos) {
+      end = list.size();
+    }
+
+    string range = list.substr(pos, end - pos);
+    std::size_t dash = range.find('-');
+    unsigned first, last;
+
+    try {
+      std::size_t used;
+      first = std::stoul(range, &used);
+      last = first;
+
+      if (dash != string::npos) {
+        if (used != dash) {
+          return false;
+        }
+
+        last = std::stoul(range.substr(dash + 1), &used);
+        if (used != range.size() - dash - 1) {
+          return false;
+        }
+      } else if (used != range.size()) {
+        return false;
+      }
+    } catch (const std::exception &) {
+      return false;
+    }
+
+    if (last < first) {
+      return false;
+    }
+
+    for (unsigned cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+
+    if (end == list.size()) {
+      return true;
+    }
+
+    pos = end + 1;
+  }
+}
+
+// the CPU a thread is pinned to, by its index among the threads of its kind;
+// threads beyond the end of the list wrap around
+inline unsigned thread_cpu(const vector<unsigned> &cpus, unsigned thread_id) {
+  return cpus[thread_id % cpus.size()];
+}
+
+// the NUMA node of cpu, or -1 if it is not known
+inline int cpu_numa_node(unsigned cpu) {
+  string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+  DIR *dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    return -1;
+  }
+
+  int node = -1;
+  struct dirent *entry;
+
+  while ((entry = readdir(dir)) != nullptr) {
+    string name = entry->d_name;
+    if (name.compare(0, 4, "node") == 0 && name.size() > 4 &&
+        std::isdigit(name[4])) {
+      node = std::stoi(name.substr(4));
+      break;
+    }
+  }
+
+  closedir(dir);
+  return node;
+}
+
+// pins the calling thread to cpu and has it allocate memory on the cpu's
+// node from here on; returns false if the thread could not be pinned
+inline bool pin_thread(unsigned cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+
+  int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (error != 0) {
+    std::cerr << "Failed to pin thread to CPU " << cpu << ": "
+              << strerror(error) << std::endl;
+    return false;
+  }
+
+  // the policy only matters on NUMA machines, and the call fails on kernels
+  // built without NUMA support, where all memory is local anyway
+  syscall(SYS_set_mempolicy, kLocalMemoryPolicy, nullptr, 0);
+  return true;
+}
+
+// the CPUs for helper threads: those the calling thread may run on, less the
+// CPUs in pinned, or all of them if that leaves none; called before any
+// thread pins itself, so that it sees the CPUs the process was started on
+inline cpu_set_t helper_cpus(const vector<unsigned> &pinned) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  sched_getaffinity(0, sizeof(cpus), &cpus);
+
+  cpu_set_t helpers = cpus;
+  for (unsigned cpu : pinned) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_CLR(cpu, &helpers);
+    }
+  }
+
+  return CPU_COUNT(&helpers) > 0 ? helpers : cpus;
+}
+
+// lets thread run on any of cpus; returns false if it could not be moved
+inline bool set_thread_cpus(std::thread &thread, const cpu_set_t &cpus) {
+  int error =
+      pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+  if (error != 0) {
+    std::cerr << "Failed to set the CPUs of a helper thread: "
+              << strerror(error) << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+#endif // INCLUDE_THREAD_AFFINITY_HPP_
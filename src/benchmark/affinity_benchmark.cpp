@@ -0,0 +1,142 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <stdlib.h>
+#include <thread>
+
+#include "kvs/server_utils.hpp"
+#include "thread_affinity.hpp"
+
+// Measures what pinning buys the storage threads. One thread runs per CPU in
+// the list; each builds its own store, as a server thread does, and then
+// looks up random keys in it. The threads run three ways:
+//  - unpinned, left to the scheduler;
+//  - local, pinned to their CPU before they build their store, as with an
+//    affinity section in the config;
+//  - remote, with each store built on the CPU half the list away and then
+//    used from the thread's own CPU.
+// On a two-socket box, list the CPUs of one socket and then those of the
+// other (e.g. "0-7,8-15" where 0-7 are on node 0), so that half the list
+// away is the other socket and the remote run reads across the
+// interconnect. The NUMA node of each CPU is printed to check this.
+
+string generate_key(unsigned n) {
+  return string(8 - std::to_string(n).length(), '0') + std::to_string(n);
+}
+
+enum Placement { UNPINNED, LOCAL, REMOTE };
+
+void run_thread(Placement placement, unsigned build_cpu, unsigned run_cpu,
+                unsigned num_keys, unsigned value_size, unsigned lookups,
+                unsigned seed, double &gets_per_second) {
+  if (placement != UNPINNED) {
+    pin_thread(build_cpu);
+  }
+
+  FlatLWWKVS *kvs = new FlatLWWKVS();
+  TimestampValuePair<string> p(0, string(value_size, 'a'));
+  LWWPairLattice<string> value(p);
+
+  for (unsigned i = 0; i < num_keys; i++) {
+    kvs->put(generate_key(i), value);
+  }
+
+  if (placement == REMOTE) {
+    pin_thread(run_cpu);
+  }
+
+  vector<Key> keys;
+  keys.reserve(lookups);
+  for (unsigned i = 0; i < lookups; i++) {
+    keys.push_back(generate_key(rand_r(&seed) % num_keys));
+  }
+
+  unsigned found = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const Key &key : keys) {
+    AnnaError error = AnnaError::NO_ERROR;
+    kvs->get(key, error);
+    if (error == AnnaError::NO_ERROR) {
+      found += 1;
+    }
+  }
+  auto get_time = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+
+  if (found != lookups) {
+    std::cerr << "Missed " << lookups - found << " keys." << std::endl;
+  }
+
+  gets_per_second = lookups / (get_time / 1000000.0);
+  delete kvs;
+}
+
+void run(const string &name, Placement placement, const vector<unsigned> &cpus,
+         unsigned num_keys, unsigned value_size, unsigned lookups,
+         unsigned seed) {
+  vector<double> rates(cpus.size());
+  vector<std::thread> threads;
+
+  for (unsigned i = 0; i < cpus.size(); i++) {
+    unsigned build_cpu = placement == REMOTE
+                             ? cpus[(i + cpus.size() / 2) % cpus.size()]
+                             : cpus[i];
+    threads.push_back(std::thread(run_thread, placement, build_cpu, cpus[i],
+                                  num_keys, value_size, lookups, seed + i,
+                                  std::ref(rates[i])));
+  }
+
+  double total = 0;
+  for (unsigned i = 0; i < cpus.size(); i++) {
+    threads[i].join();
+    total += rates[i];
+  }
+
+  std::cout << name << ": " << total << " gets/s, " << total / cpus.size()
+            << " gets/s per thread" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 5) {
+    std::cerr << "Usage: " << argv[0]
+              << " <cpu-list> <keys-per-thread> <value-size> <lookups>"
+              << std::endl;
+    return 1;
+  }
+
+  vector<unsigned> cpus;
+  if (!parse_cpu_list(argv[1], cpus)) {
+    std::cerr << "Invalid CPU list " << argv[1] << "." << std::endl;
+    return 1;
+  }
+
+  unsigned num_keys = std::stoi(argv[2]);
+  unsigned value_size = std::stoi(argv[3]);
+  unsigned lookups = std::stoi(argv[4]);
+  unsigned seed = time(NULL);
+
+  for (unsigned i = 0; i < cpus.size(); i++) {
+    unsigned remote = cpus[(i + cpus.size() / 2) % cpus.size()];
+    std::cout << "CPU " << cpus[i] << " (node " << cpu_numa_node(cpus[i])
+              << ") builds its remote store on CPU " << remote << " (node "
+              << cpu_numa_node(remote) << ")" << std::endl;
+  }
+
+  run("unpinned", UNPINNED, cpus, num_keys, value_size, lookups, seed);
+  run("local", LOCAL, cpus, num_keys, value_size, lookups, seed);
+  run("remote", REMOTE, cpus, num_keys, value_size, lookups, seed);
+
+  return 0;
+}
@@ -0,0 +1,124 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <stdlib.h>
+
+#include "kvs/server_utils.hpp"
+
+// Compares merging the vector clock of a causal put into a stored clock as a
+// map lattice keyed by client id strings (the previous disk tier path) with
+// merging it as a CompactVectorClock, both starting from the clock's protobuf
+// map, for clocks with many clients.
+
+typedef google::protobuf::Map<string, uint32_t> ProtoClock;
+
+std::size_t map_lattice_merge(const ProtoClock &stored, const ProtoClock &input,
+                              ClientTable &clients, const TimePoint &now) {
+  VectorClock clock, input_clock;
+  for (const auto &pair : stored) {
+    clock.insert(pair.first, pair.second);
+  }
+  for (const auto &pair : input) {
+    input_clock.insert(pair.first, pair.second);
+  }
+
+  clock.merge(input_clock);
+
+  SingleKeyCausalValue merged;
+  auto ptr = merged.mutable_vector_clock();
+  for (const auto &pair : clock.reveal()) {
+    (*ptr)[pair.first] = pair.second.reveal();
+  }
+
+  return merged.vector_clock().size();
+}
+
+std::size_t compact_merge(const ProtoClock &stored, const ProtoClock &input,
+                          ClientTable &clients, const TimePoint &now) {
+  CompactVectorClock clock, input_clock;
+  clock.parse(stored, clients);
+  input_clock.parse(input, clients);
+  clock.merge(input_clock, clients, now);
+
+  SingleKeyCausalValue merged;
+  clock.write(merged.mutable_vector_clock(), clients);
+  return merged.vector_clock().size();
+}
+
+// merges every input into the stored clock in turn, and reports merges/s
+void run(const string &name,
+         std::size_t (*merge)(const ProtoClock &, const ProtoClock &,
+                              ClientTable &, const TimePoint &),
+         const SingleKeyCausalValue &stored,
+         const vector<SingleKeyCausalValue> &inputs) {
+  ClientTable clients(0);
+  auto now = std::chrono::system_clock::now();
+  std::size_t checksum = 0;
+
+  auto start = std::chrono::system_clock::now();
+  for (const SingleKeyCausalValue &input : inputs) {
+    checksum += merge(stored.vector_clock(), input.vector_clock(), clients, now);
+  }
+  auto time = std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::system_clock::now() - start)
+                  .count();
+
+  std::cout << name << ": " << inputs.size() / (time / 1000000.0)
+            << " merges/s (" << checksum / inputs.size() << " entries/merge)"
+            << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <clock-entries> <merges>"
+              << std::endl;
+    return 1;
+  }
+
+  unsigned entries = std::stoi(argv[1]);
+  unsigned merges = std::stoi(argv[2]);
+  unsigned seed = time(NULL);
+
+  SingleKeyCausalValue stored;
+  vector<SingleKeyCausalValue> inputs(merges);
+
+  for (unsigned i = 0; i < entries; i++) {
+    string client = "client-" + std::to_string(i);
+    (*stored.mutable_vector_clock())[client] = rand_r(&seed) % 100;
+  }
+
+  // every put carries the same clients as the stored clock, as once a key's
+  // writers are known to every replica
+  for (unsigned i = 0; i < merges; i++) {
+    for (const auto &pair : stored.vector_clock()) {
+      (*inputs[i].mutable_vector_clock())[pair.first] = rand_r(&seed) % 100;
+    }
+  }
+
+  run("same clients (map lattice)", map_lattice_merge, stored, inputs);
+  run("same clients (compact)", compact_merge, stored, inputs);
+
+  // every put also carries a few clients the stored clock has not seen
+  for (unsigned i = 0; i < merges; i++) {
+    for (unsigned j = 0; j < 4; j++) {
+      string client = "client-" + std::to_string(entries + rand_r(&seed) % 64);
+      (*inputs[i].mutable_vector_clock())[client] = 1;
+    }
+  }
+
+  run("new clients (map lattice)", map_lattice_merge, stored, inputs);
+  run("new clients (compact)", compact_merge, stored, inputs);
+
+  return 0;
+}
@@ -0,0 +1,121 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <algorithm>
+#include <stdlib.h>
+
+#include "kvs/file_store.hpp"
+
+// Measures the latency of gets and puts on the file engine once it holds a
+// given number of keys (e.g. 1M or 10M, which is where the flat layout used
+// to slow down), with and without a descriptor cache. Keys are read and
+// overwritten uniformly at random, then drawn from a hot set that fits in the
+// descriptor cache. The data is left in the given directory, so a later run
+// with the same number of keys skips the load.
+
+string generate_key(unsigned n) {
+  return string(10 - std::to_string(n).length(), '0') + std::to_string(n);
+}
+
+void report(const string &name, vector<double> &latencies) {
+  std::sort(latencies.begin(), latencies.end());
+
+  double total = 0;
+  for (double latency : latencies) {
+    total += latency;
+  }
+
+  std::cout << name << ": mean " << total / latencies.size() << "us, p50 "
+            << latencies[latencies.size() / 2] << "us, p99 "
+            << latencies[latencies.size() * 99 / 100] << "us" << std::endl;
+}
+
+void run(const string &name, FileStore &store, unsigned key_range,
+         unsigned value_size, unsigned ops, unsigned &seed) {
+  vector<double> get_latencies, put_latencies;
+  string value(value_size, 'b');
+  string result;
+
+  for (unsigned i = 0; i < ops; i++) {
+    Key key = generate_key(rand_r(&seed) % key_range);
+
+    auto start = std::chrono::steady_clock::now();
+    store.get(key, result);
+    get_latencies.push_back(
+        std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+
+    start = std::chrono::steady_clock::now();
+    store.put(key, value);
+    put_latencies.push_back(
+        std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+  }
+
+  report(name + " get", get_latencies);
+  report(name + " put", put_latencies);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 6) {
+    std::cerr << "Usage: " << argv[0]
+              << " <dir> <num-keys> <value-size> <ops> <fd-cache>"
+              << std::endl;
+    return 1;
+  }
+
+  string dir = argv[1];
+  unsigned num_keys = std::stoi(argv[2]);
+  unsigned value_size = std::stoi(argv[3]);
+  unsigned ops = std::stoi(argv[4]);
+  unsigned fd_cache = std::stoi(argv[5]);
+  unsigned seed = time(NULL);
+
+  {
+    FileStore store(dir);
+    string value(value_size, 'a');
+    string result;
+
+    auto start = std::chrono::steady_clock::now();
+    unsigned loaded = 0;
+
+    for (unsigned i = 0; i < num_keys; i++) {
+      Key key = generate_key(i);
+      if (!store.get(key, result)) {
+        store.put(key, value);
+        loaded += 1;
+      }
+    }
+
+    auto time = std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    std::cout << "loaded " << loaded << " of " << num_keys << " keys in "
+              << time << "s" << std::endl;
+  }
+
+  unsigned hot_keys = std::max(1u, std::min(fd_cache, num_keys));
+
+  FileStore uncached(dir);
+  run("uniform, no fd cache", uncached, num_keys, value_size, ops, seed);
+  run("hot, no fd cache", uncached, hot_keys, value_size, ops, seed);
+
+  FileStore cached(dir, fd_cache);
+  run("uniform, fd cache", cached, num_keys, value_size, ops, seed);
+  run("hot, fd cache", cached, hot_keys, value_size, ops, seed);
+
+  return 0;
+}
@@ -0,0 +1,126 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <stdlib.h>
+
+#include "kvs/server_utils.hpp"
+
+// Measures what the handlers pay to reach a serializer, per tuple, for the
+// same stream of LWW puts and gets on a flat memory store:
+//  - static: through the concrete serializer type, which is final, so the
+//    compiler can devirtualize and inline the call, as a handler templated on
+//    the lattice type would;
+//  - table: a SerializerMap slot and a virtual call, as the handlers do now;
+//  - hash: an unordered_map lookup on the lattice type and a virtual call, as
+//    the handlers did before.
+// The difference between static and table is what compile-time dispatch
+// could still save.
+
+// the number of times each variant is run
+const unsigned kTrials = 7;
+
+string generate_key(unsigned n) {
+  return string(8 - std::to_string(n).length(), '0') + std::to_string(n);
+}
+
+// runs the workload once, reaching the serializer through lookup, and returns
+// the number of operations per second
+template <typename F>
+double run(F lookup, const vector<Key> &keys, const vector<LatticeType> &types,
+           const string &payload, unsigned rounds, unsigned long long &bytes) {
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned r = 0; r < rounds; r++) {
+    for (unsigned i = 0; i < keys.size(); i++) {
+      AnnaError error = AnnaError::NO_ERROR;
+
+      if (i % 2 == 0) {
+        bytes += lookup(types[i])->put(keys[i], payload);
+      } else {
+        bytes += lookup(types[i])->get(keys[i], error).size();
+      }
+    }
+  }
+
+  double seconds = std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count() /
+                   1000000.0;
+  return keys.size() * (double)rounds / seconds;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 4) {
+    std::cerr << "Usage: " << argv[0] << " <num-keys> <value-size> <rounds>"
+              << std::endl;
+    return 1;
+  }
+
+  unsigned num_keys = std::stoi(argv[1]);
+  unsigned value_size = std::stoi(argv[2]);
+  unsigned rounds = std::stoi(argv[3]);
+  unsigned seed = time(NULL);
+
+  vector<Key> keys;
+  vector<LatticeType> types;
+  for (unsigned i = 0; i < num_keys; i++) {
+    keys.push_back(generate_key(rand_r(&seed) % num_keys));
+    types.push_back(LatticeType::LWW);
+  }
+
+  string payload = serialize(
+      LWWPairLattice<string>(TimestampValuePair<string>(0, string(value_size,
+                                                                  'a'))));
+
+  FlatLWWKVS *kvs = new FlatLWWKVS();
+  FlatLWWSerializer *serializer = new FlatLWWSerializer(kvs);
+
+  SerializerMap table;
+  table[LatticeType::LWW] = serializer;
+
+  hmap<int, Serializer *> hash;
+  hash[LatticeType::LWW] = serializer;
+
+  auto by_static = [serializer](LatticeType) { return serializer; };
+  auto by_table = [&table](LatticeType type) { return table[type]; };
+  auto by_hash = [&hash](LatticeType type) { return hash[type]; };
+
+  // warm the store, so every run sees the same keys and cached encodings
+  unsigned long long bytes = 0;
+  run(by_static, keys, types, payload, 1, bytes);
+
+  // the three are interleaved and the best of several trials is kept, since
+  // the differences are small next to the noise of a single run
+  double static_rate = 0, table_rate = 0, hash_rate = 0;
+
+  for (unsigned trial = 0; trial < kTrials; trial++) {
+    static_rate = std::max(static_rate,
+                           run(by_static, keys, types, payload, rounds, bytes));
+    table_rate = std::max(table_rate,
+                          run(by_table, keys, types, payload, rounds, bytes));
+    hash_rate = std::max(hash_rate,
+                         run(by_hash, keys, types, payload, rounds, bytes));
+  }
+
+  std::cout << "static: " << 1000000000.0 / static_rate << " ns/op"
+            << std::endl;
+  std::cout << "table: " << 1000000000.0 / table_rate << " ns/op"
+            << std::endl;
+  std::cout << "hash: " << 1000000000.0 / hash_rate << " ns/op" << std::endl;
+  std::cout << "(" << bytes << " bytes moved)" << std::endl;
+
+  delete serializer;
+  delete kvs;
+  return 0;
+}
@@ -0,0 +1,212 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <stdlib.h>
+
+#include "kvs/server_utils.hpp"
+
+// Compares the disk tier's merge of a put into a stored value when both are
+// decoded into protobuf messages (the previous path) with the wire-level
+// kernels in wire_merge.hpp, for LWW, PRIORITY, SET and ORDERED_SET values.
+// For the memory tier, it compares decoding a set put and merging it into a
+// node-based set lattice with doing the same for a packed set lattice.
+
+string decoded_lww(const string &original, const string &input) {
+  LWWValue input_value, original_value;
+  input_value.ParseFromString(input);
+  original_value.ParseFromString(original);
+  return input_value.timestamp() >= original_value.timestamp() ? input
+                                                               : original;
+}
+
+string wire_lww(const string &original, const string &input) {
+  uint64_t input_timestamp, original_timestamp;
+  wire_lww_timestamp(input, input_timestamp);
+  wire_lww_timestamp(original, original_timestamp);
+  return input_timestamp >= original_timestamp ? input : original;
+}
+
+string decoded_priority(const string &original, const string &input) {
+  PriorityValue input_value, original_value;
+  input_value.ParseFromString(input);
+  original_value.ParseFromString(original);
+  return input_value.priority() < original_value.priority() ? input
+                                                            : original;
+}
+
+string wire_priority_merge(const string &original, const string &input) {
+  double input_priority, original_priority;
+  wire_priority(input, input_priority);
+  wire_priority(original, original_priority);
+  return input_priority < original_priority ? input : original;
+}
+
+template <typename S>
+string decoded_set(const string &original, const string &input) {
+  SetValue input_value, original_value;
+  input_value.ParseFromString(input);
+  original_value.ParseFromString(original);
+
+  S set_union;
+  for (auto &val : original_value.values()) {
+    set_union.emplace(std::move(val));
+  }
+  for (auto &val : input_value.values()) {
+    set_union.emplace(std::move(val));
+  }
+
+  SetValue new_value;
+  for (auto &val : set_union) {
+    new_value.add_values(std::move(val));
+  }
+
+  string merged;
+  new_value.SerializeToString(&merged);
+  return merged;
+}
+
+string wire_set(const string &original, const string &input) {
+  string merged;
+  wire_set_union(original, input, merged);
+  return merged;
+}
+
+// merges every input into the stored value in turn, and reports merges/s
+void run(const string &name, string (*merge)(const string &, const string &),
+         const string &stored, const vector<string> &inputs) {
+  std::size_t checksum = 0;
+
+  auto start = std::chrono::system_clock::now();
+  for (const string &input : inputs) {
+    checksum += merge(stored, input).size();
+  }
+  auto time = std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::system_clock::now() - start)
+                  .count();
+
+  std::cout << name << ": " << inputs.size() / (time / 1000000.0)
+            << " merges/s (" << checksum / inputs.size() << " bytes/merge)"
+            << std::endl;
+}
+
+SetLattice<string> decode_node_set(const string &input) {
+  return deserialize_set(input);
+}
+
+PackedSetLattice decode_packed_set(const string &input) {
+  return PackedSetLattice(PackedStringSet::decode(input));
+}
+
+// merges every input into one lattice, which starts out as the stored value
+// and grows as the memory tier's would, and reports merges/s
+template <typename L>
+void run_lattice(const string &name, L (*decode)(const string &),
+                 const string &stored, const vector<string> &inputs) {
+  L lattice = decode(stored);
+
+  auto start = std::chrono::system_clock::now();
+  for (const string &input : inputs) {
+    lattice.merge(decode(input));
+  }
+  auto time = std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::system_clock::now() - start)
+                  .count();
+
+  std::cout << name << ": " << inputs.size() / (time / 1000000.0)
+            << " merges/s (" << lattice.size().reveal() << " elements)"
+            << std::endl;
+}
+
+string encode_set(unsigned count, unsigned element_size, unsigned &seed) {
+  SetValue value;
+  for (unsigned i = 0; i < count; i++) {
+    string element = std::to_string(rand_r(&seed));
+    element.resize(element_size, 'a');
+    value.add_values(element);
+  }
+
+  string serialized;
+  value.SerializeToString(&serialized);
+  return serialized;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 4) {
+    std::cerr << "Usage: " << argv[0]
+              << " <value-size> <set-elements> <merges>" << std::endl;
+    return 1;
+  }
+
+  unsigned value_size = std::stoi(argv[1]);
+  unsigned set_elements = std::stoi(argv[2]);
+  unsigned merges = std::stoi(argv[3]);
+  unsigned seed = time(NULL);
+
+  vector<string> inputs(merges);
+  string stored;
+
+  LWWValue lww;
+  lww.set_timestamp(merges / 2);
+  lww.set_value(string(value_size, 'a'));
+  lww.SerializeToString(&stored);
+
+  for (unsigned i = 0; i < merges; i++) {
+    lww.set_timestamp(i);
+    lww.SerializeToString(&inputs[i]);
+  }
+
+  run("lww (decoded)", decoded_lww, stored, inputs);
+  run("lww (wire)", wire_lww, stored, inputs);
+
+  PriorityValue priority;
+  priority.set_priority(merges / 2);
+  priority.set_value(string(value_size, 'a'));
+  priority.SerializeToString(&stored);
+
+  for (unsigned i = 0; i < merges; i++) {
+    priority.set_priority(i);
+    priority.SerializeToString(&inputs[i]);
+  }
+
+  run("priority (decoded)", decoded_priority, stored, inputs);
+  run("priority (wire)", wire_priority_merge, stored, inputs);
+
+  // the stored set is kept sorted, as the set tier writes it; each put adds
+  // a few unsorted elements, as a client sends them
+  wire_set_union(encode_set(set_elements, 16, seed), "", stored);
+  for (unsigned i = 0; i < merges; i++) {
+    inputs[i] = encode_set(4, 16, seed);
+  }
+
+  run("set (decoded)", decoded_set<set<string>>, stored, inputs);
+  run("set (wire)", wire_set, stored, inputs);
+  run("ordered set (decoded)", decoded_set<ordered_set<string>>, stored,
+      inputs);
+  run("ordered set (wire)", wire_set, stored, inputs);
+
+  run_lattice("set lattice (node)", decode_node_set, stored, inputs);
+  run_lattice("set lattice (packed)", decode_packed_set, stored, inputs);
+
+  // puts that carry as many elements as the stored set, as when replicas
+  // gossip whole values to each other
+  for (unsigned i = 0; i < merges / 100 + 1; i++) {
+    inputs[i] = encode_set(set_elements, 16, seed);
+  }
+  inputs.resize(merges / 100 + 1);
+
+  run_lattice("large set lattice (node)", decode_node_set, stored, inputs);
+  run_lattice("large set lattice (packed)", decode_packed_set, stored, inputs);
+
+  return 0;
+}
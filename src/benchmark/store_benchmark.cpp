@@ -0,0 +1,132 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <malloc.h>
+#include <stdlib.h>
+
+#include "kvs/server_utils.hpp"
+
+// Compares the map-backed KVStore with the arena-backed FlatKVStore on a
+// workload of small LWW values: put throughput, lookup throughput, the
+// throughput of GETs through the serializer (which serves cached encodings),
+// and the number of heap bytes each store holds per key.
+
+// every allocation in this process goes through the counters below, so we can
+// attribute live heap bytes to the store under test
+static size_t live_heap_bytes = 0;
+
+void *operator new(size_t size) {
+  void *ptr = malloc(size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+
+  live_heap_bytes += malloc_usable_size(ptr);
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+  if (ptr != nullptr) {
+    live_heap_bytes -= malloc_usable_size(ptr);
+    free(ptr);
+  }
+}
+
+void operator delete(void *ptr, size_t) noexcept { operator delete(ptr); }
+
+string generate_key(unsigned n) {
+  return string(8 - std::to_string(n).length(), '0') + std::to_string(n);
+}
+
+template <typename KVS>
+void run(const string &name, const vector<Key> &keys, unsigned value_size,
+         unsigned lookups, unsigned &seed) {
+  size_t heap_before = live_heap_bytes;
+  KVS *kvs = new KVS();
+
+  TimestampValuePair<string> p(0, string(value_size, 'a'));
+  LWWPairLattice<string> value(p);
+
+  auto start = std::chrono::system_clock::now();
+  for (const Key &key : keys) {
+    kvs->put(key, value);
+  }
+  auto put_time = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::system_clock::now() - start)
+                      .count();
+
+  size_t heap_bytes = live_heap_bytes - heap_before;
+
+  unsigned found = 0;
+  start = std::chrono::system_clock::now();
+  for (unsigned i = 0; i < lookups; i++) {
+    AnnaError error = AnnaError::NO_ERROR;
+    kvs->get(keys[rand_r(&seed) % keys.size()], error);
+    if (error == AnnaError::NO_ERROR) {
+      found += 1;
+    }
+  }
+  auto get_time = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::system_clock::now() - start)
+                      .count();
+
+  BasicMemoryLWWSerializer<KVS> serializer(kvs);
+  start = std::chrono::system_clock::now();
+  for (unsigned i = 0; i < lookups; i++) {
+    AnnaError error = AnnaError::NO_ERROR;
+    serializer.get(keys[rand_r(&seed) % keys.size()], error);
+  }
+  auto serialized_get_time =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now() - start)
+          .count();
+
+  std::cout << name << ": " << keys.size() / (put_time / 1000000.0)
+            << " puts/s, " << lookups / (get_time / 1000000.0)
+            << " gets/s (" << found << " hits), "
+            << lookups / (serialized_get_time / 1000000.0)
+            << " serialized gets/s, "
+            << (double)heap_bytes / keys.size() << " bytes/key" << std::endl;
+
+  delete kvs;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 4) {
+    std::cerr << "Usage: " << argv[0] << " <num-keys> <value-size> <lookups>"
+              << std::endl;
+    return 1;
+  }
+
+  unsigned num_keys = std::stoi(argv[1]);
+  unsigned value_size = std::stoi(argv[2]);
+  unsigned lookups = std::stoi(argv[3]);
+  unsigned seed = time(NULL);
+
+  vector<Key> keys;
+  keys.reserve(num_keys);
+  for (unsigned i = 0; i < num_keys; i++) {
+    keys.push_back(generate_key(i));
+  }
+
+  // insert in random order so neither store benefits from sorted input
+  for (unsigned i = num_keys; i > 1; i--) {
+    std::swap(keys[i - 1], keys[rand_r(&seed) % i]);
+  }
+
+  run<MemoryLWWKVS>("map", keys, value_size, lookups, seed);
+  run<FlatLWWKVS>("flat", keys, value_size, lookups, seed);
+
+  return 0;
+}
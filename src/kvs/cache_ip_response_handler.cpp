@@ -14,9 +14,7 @@
 
 #include "kvs/kvs_handlers.hpp"
 
-void cache_ip_response_handler(string &serialized,
-                               map<Address, set<Key>> &cache_ip_to_keys,
-                               map<Key, set<Address>> &key_to_cache_ips) {
+void cache_ip_response_handler(string &serialized, CacheKeyIndex &cache_index) {
   // The response will be a list of cache IPs and their responsible keys.
   KeyResponse response;
   response.ParseFromString(serialized);
@@ -37,32 +35,9 @@ void cache_ip_response_handler(string &serialized,
       StringSet key_set;
       key_set.ParseFromString(lww_value.value());
 
-      // First, update key_to_cache_ips with dropped keys for this cache.
-
-      // Figure out which keys are in the old set of keys for this IP
-      // that are not in the new fresh set of keys for this IP.
-      // (We can do this by destructively modifying the old set of keys
-      // since we don't need it anymore.)
-      set<Key> &old_keys_for_ip = cache_ip_to_keys[cache_ip];
-      for (const auto &cache_key : key_set.keys()) {
-        old_keys_for_ip.erase(cache_key);
-      }
-      set<Key> &deleted_keys = old_keys_for_ip;
-
-      // For the keys that have been deleted from this cache,
-      // remove them from the key->caches mapping too.
-      for (const auto &key : deleted_keys) {
-        key_to_cache_ips[key].erase(cache_ip);
-      }
-
-      cache_ip_to_keys[cache_ip].clear();
-
-      // Now we can update cache_ip_to_keys,
-      // as well as add new keys to key_to_cache_ips.
-      for (const auto &cache_key : key_set.keys()) {
-        cache_ip_to_keys[cache_ip].emplace(std::move(cache_key));
-        key_to_cache_ips[cache_key].insert(cache_ip);
-      }
+      // Replace the keys we had for this cache with its fresh list; keys
+      // that were dropped no longer map to this cache.
+      cache_index.update(cache_ip, key_set.keys());
     }
 
     // We can also get error 1 (key does not exist)
@@ -0,0 +1,57 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/file_store.hpp"
+
+// Moves the data of every disk thread under an ebs root from the flat layout,
+// where each thread's directory holds one file per key, into the sharded
+// layout the file engine now uses. A disk node also migrates its own
+// directories when it starts; this tool does the same work offline, so that
+// a node with many keys does not spend its startup renaming files.
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <ebs-root>" << std::endl;
+    return 1;
+  }
+
+  string root = argv[1];
+  if (root.back() != '/') {
+    root += "/";
+  }
+
+  DIR *dir = opendir(root.c_str());
+  if (dir == nullptr) {
+    std::cerr << "Failed to open " << root << std::endl;
+    return 1;
+  }
+
+  vector<string> thread_dirs;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    string name = entry->d_name;
+    if (name.compare(0, 4, "ebs_") == 0) {
+      thread_dirs.push_back(root + name + "/");
+    }
+  }
+
+  closedir(dir);
+
+  for (const string &thread_dir : thread_dirs) {
+    unsigned moved = FileStore::migrate(thread_dir);
+    std::cout << thread_dir << ": moved " << moved << " files" << std::endl;
+  }
+
+  return 0;
+}
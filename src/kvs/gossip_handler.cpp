@@ -17,8 +17,9 @@
 void gossip_handler(unsigned &seed, string &serialized,
                     GlobalRingMap &global_hash_rings,
                     LocalRingMap &local_hash_rings,
-                    map<Key, vector<PendingGossip>> &pending_gossip,
+                    KeyHandleMap<vector<PendingGossip>> &pending_gossip,
                     map<Key, KeyProperty> &stored_key_map,
+                    unsigned long long &storage_consumption,
                     map<Key, KeyReplication> &key_replication_map,
                     ServerThread &wt, SerializerMap &serializers,
                     SocketCache &pushers, logger log) {
@@ -30,7 +31,7 @@ void gossip_handler(unsigned &seed, string &serialized,
 
   for (const KeyTuple &tuple : gossip.tuples()) {
     // first check if the thread is responsible for the key
-    Key key = tuple.key();
+    const Key &key = tuple.key();
     ServerThreadList threads = kHashRingUtil->get_responsible_threads(
         wt.replication_response_connect_address(), key, is_metadata(key),
         global_hash_rings, local_hash_rings, key_replication_map, pushers,
@@ -47,7 +48,8 @@ void gossip_handler(unsigned &seed, string &serialized,
                      stored_key_map[key].type_);
         } else {
           process_put(tuple.key(), tuple.lattice_type(), tuple.payload(),
-                      serializers[tuple.lattice_type()], stored_key_map);
+                      serializers[tuple.lattice_type()], stored_key_map,
+                      storage_consumption);
         }
       } else {
         if (is_metadata(key)) { // forward the gossip
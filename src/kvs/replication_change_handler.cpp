@@ -18,8 +18,10 @@ void replication_change_handler(
     Address public_ip, Address private_ip, unsigned thread_id, unsigned &seed,
     logger log, string &serialized, GlobalRingMap &global_hash_rings,
     LocalRingMap &local_hash_rings, map<Key, KeyProperty> &stored_key_map,
-    map<Key, KeyReplication> &key_replication_map, set<Key> &local_changeset,
-    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers) {
+    unsigned long long &storage_consumption,
+    map<Key, KeyReplication> &key_replication_map, KeyHandleSet &local_changeset,
+    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers,
+    AsyncDiskIO *disk_io) {
   log->info("Received a replication factor change.");
   if (thread_id == 0) {
     // tell all worker threads about the replication factor change
@@ -141,12 +143,12 @@ void replication_change_handler(
     }
   }
 
-  send_gossip(addr_keyset_map, pushers, serializers, stored_key_map);
+  send_gossip(addr_keyset_map, pushers, serializers, stored_key_map, disk_io);
 
-  // remove keys
+  // remove keys; with asynchronous disk I/O, the removes are queued behind the
+  // gossip reads above
   for (const string &key : remove_set) {
-    serializers[stored_key_map[key].type_]->remove(key);
-    stored_key_map.erase(key);
+    remove_key(key, serializers, stored_key_map, storage_consumption);
     local_changeset.erase(key);
   }
 }
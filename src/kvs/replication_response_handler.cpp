@@ -17,12 +17,14 @@
 void replication_response_handler(
     unsigned &seed, unsigned &access_count, logger log, string &serialized,
     GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
-    map<Key, vector<PendingRequest>> &pending_requests,
-    map<Key, vector<PendingGossip>> &pending_gossip,
-    map<Key, std::multiset<TimePoint>> &key_access_tracker,
+    KeyHandleMap<vector<PendingRequest>> &pending_requests,
+    KeyHandleMap<vector<PendingGossip>> &pending_gossip,
+    KeyAccessTracker &key_access_tracker,
     map<Key, KeyProperty> &stored_key_map,
-    map<Key, KeyReplication> &key_replication_map, set<Key> &local_changeset,
-    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers) {
+    unsigned long long &storage_consumption,
+    map<Key, KeyReplication> &key_replication_map, KeyHandleSet &local_changeset,
+    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers,
+    AsyncDiskIO *disk_io, WriteAheadLog *wal) {
   KeyResponse response;
   response.ParseFromString(serialized);
 
@@ -67,7 +69,8 @@ void replication_response_handler(
 
   bool succeed;
 
-  if (pending_requests.find(key) != pending_requests.end()) {
+  vector<PendingRequest> *requests = pending_requests.find(key);
+  if (requests != nullptr) {
     ServerThreadList threads = kHashRingUtil->get_responsible_threads(
         wt.replication_response_connect_address(), key, is_metadata(key),
         global_hash_rings, local_hash_rings, key_replication_map, pushers,
@@ -77,7 +80,7 @@ void replication_response_handler(
       bool responsible =
           std::find(threads.begin(), threads.end(), wt) != threads.end();
 
-      for (const PendingRequest &request : pending_requests[key]) {
+      for (const PendingRequest &request : *requests) {
         auto now = std::chrono::system_clock::now();
 
         if (!responsible && request.addr_ != "") {
@@ -112,8 +115,9 @@ void replication_response_handler(
                   LatticeType_Name(stored_key_map[key].type_));
             } else {
               process_put(key, request.lattice_type_, request.payload_,
-                          serializers[request.lattice_type_], stored_key_map);
-              key_access_tracker[key].insert(now);
+                          serializers[request.lattice_type_], stored_key_map,
+                          storage_consumption);
+              key_access_tracker.record(key, now);
 
               access_count += 1;
               local_changeset.insert(key);
@@ -137,11 +141,15 @@ void replication_response_handler(
             if (stored_key_map.find(key) == stored_key_map.end() ||
                 stored_key_map[key].type_ == LatticeType::NONE) {
               tp->set_error(AnnaError::KEY_DNE);
+            } else if (disk_io != nullptr) {
+              tp->set_lattice_type(stored_key_map[key].type_);
+              disk_io->get(key, stored_key_map[key].type_, 0);
             } else {
               auto res =
                   process_get(key, serializers[stored_key_map[key].type_]);
               tp->set_lattice_type(stored_key_map[key].type_);
-              tp->set_payload(res.first);
+              tp->set_payload(kValueCompressor.unpack(
+                  stored_key_map[key].type_, std::move(res.first)));
               tp->set_error(res.second);
             }
           } else {
@@ -155,19 +163,36 @@ void replication_response_handler(
                   "expected.",
                   key, LatticeType_Name(request.lattice_type_),
                   LatticeType_Name(stored_key_map[key].type_));
+            } else if (disk_io != nullptr) {
+              stored_key_map[key].type_ = request.lattice_type_;
+              disk_io->put(key, request.lattice_type_, request.payload_, 0);
+              tp->set_lattice_type(request.lattice_type_);
             } else {
               process_put(key, request.lattice_type_, request.payload_,
-                          serializers[request.lattice_type_], stored_key_map);
+                          serializers[request.lattice_type_], stored_key_map,
+                          storage_consumption);
               tp->set_lattice_type(request.lattice_type_);
               local_changeset.insert(key);
             }
           }
-          key_access_tracker[key].insert(now);
+          key_access_tracker.record(key, now);
           access_count += 1;
 
-          string serialized_response;
-          response.SerializeToString(&serialized_response);
-          kZmqUtil->send_string(serialized_response, &pushers[request.addr_]);
+          // with asynchronous disk I/O, the request is queued behind every
+          // operation the event loop has already issued, as if it had been
+          // handled when it arrived, and answered once it has run; with the
+          // write-ahead log on, a PUT is answered once it is durable
+          if (disk_io == nullptr ||
+              !disk_io->defer(response, request.addr_)) {
+            string serialized_response;
+            response.SerializeToString(&serialized_response);
+
+            if (wal == nullptr || request.type_ != RequestType::PUT ||
+                !wal->hold(request.addr_, serialized_response)) {
+              kZmqUtil->send_string(serialized_response,
+                                    &pushers[request.addr_]);
+            }
+          }
         }
       }
     } else {
@@ -178,7 +203,8 @@ void replication_response_handler(
     pending_requests.erase(key);
   }
 
-  if (pending_gossip.find(key) != pending_gossip.end()) {
+  vector<PendingGossip> *gossips = pending_gossip.find(key);
+  if (gossips != nullptr) {
     ServerThreadList threads = kHashRingUtil->get_responsible_threads(
         wt.replication_response_connect_address(), key, is_metadata(key),
         global_hash_rings, local_hash_rings, key_replication_map, pushers,
@@ -186,7 +212,7 @@ void replication_response_handler(
 
     if (succeed) {
       if (std::find(threads.begin(), threads.end(), wt) != threads.end()) {
-        for (const PendingGossip &gossip : pending_gossip[key]) {
+        for (const PendingGossip &gossip : *gossips) {
           if (stored_key_map.find(key) != stored_key_map.end() &&
               stored_key_map[key].type_ != LatticeType::NONE &&
               stored_key_map[key].type_ != gossip.lattice_type_) {
@@ -196,7 +222,8 @@ void replication_response_handler(
                        LatticeType_Name(stored_key_map[key].type_));
           } else {
             process_put(key, gossip.lattice_type_, gossip.payload_,
-                        serializers[gossip.lattice_type_], stored_key_map);
+                        serializers[gossip.lattice_type_], stored_key_map,
+                        storage_consumption);
           }
         }
       } else {
@@ -207,7 +234,7 @@ void replication_response_handler(
           gossip_map[thread.gossip_connect_address()].set_type(
               RequestType::PUT);
 
-          for (const PendingGossip &gossip : pending_gossip[key]) {
+          for (const PendingGossip &gossip : *gossips) {
             prepare_put_tuple(gossip_map[thread.gossip_connect_address()], key,
                               gossip.lattice_type_, gossip.payload_);
           }
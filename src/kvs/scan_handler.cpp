@@ -0,0 +1,62 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/kvs_handlers.hpp"
+
+// Answers a scan with the first keys in the range that this thread stores,
+// read off stored_key_map, which is kept in key order. The routing thread
+// that sent the request merges the answers of every storage thread.
+void scan_handler(string &serialized, map<Key, KeyProperty> &stored_key_map,
+                  SocketCache &pushers) {
+  ScanRequest request;
+  request.ParseFromString(serialized);
+
+  ScanResponse response;
+  response.set_request_id(request.request_id());
+
+  const string &prefix = request.prefix();
+  const string &end = request.end();
+  Key start = std::max(request.start(), prefix);
+
+  const string &continuation = request.continuation();
+  int limit = request.limit();
+
+  auto it = !continuation.empty() && continuation >= start
+                ? stored_key_map.upper_bound(continuation)
+                : stored_key_map.lower_bound(start);
+
+  for (; it != stored_key_map.end() && response.keys_size() < limit; ++it) {
+    const Key &key = it->first;
+
+    // the keys with a prefix are contiguous, and start is not before them
+    if ((!end.empty() && key >= end) ||
+        key.compare(0, prefix.size(), prefix) != 0) {
+      break;
+    }
+
+    if (!is_metadata(key) && it->second.type_ != LatticeType::NONE) {
+      response.add_keys(key);
+    }
+  }
+
+  // with the limit reached, there may be more keys in the range
+  if (response.keys_size() > 0 && response.keys_size() == limit) {
+    response.set_continuation(response.keys(response.keys_size() - 1));
+  }
+
+  string serialized_response;
+  response.SerializeToString(&serialized_response);
+  kZmqUtil->send_string(serialized_response,
+                        &pushers[request.response_address()]);
+}
@@ -12,7 +12,10 @@
 //  See the License for the specific language governing permissions and
 //  limitations under the License.
 
+#include "adaptive_poller.hpp"
 #include "kvs/kvs_handlers.hpp"
+#include "periodic_timers.hpp"
+#include "thread_affinity.hpp"
 #include "yaml-cpp/yaml.h"
 
 // define server report threshold (in second)
@@ -21,6 +24,23 @@ const unsigned kServerReportThreshold = 15;
 // define server's key monitoring threshold (in second)
 const unsigned kKeyMonitoringThreshold = 60;
 
+// how often memory threads check the node's memory use (in milliseconds)
+const unsigned kMemoryCheckPeriod = 1000;
+
+// above this fraction of its capacity, a memory node demotes its coldest keys
+// to the disk tier and turns PUTs away...
+const double kMemoryHighWaterMark = 0.9;
+
+// ...until demotion has brought it back down to this fraction
+const double kMemoryLowWaterMark = 0.8;
+
+// the most keys a memory thread demotes per check
+const unsigned kMaxDemotionBatch = 1000;
+
+// a key still stored this long after its demotion was requested is taken to
+// have been missed, and may be picked again (in milliseconds)
+const unsigned kDemotionTimeout = 10000;
+
 unsigned kThreadNum;
 
 Tier kSelfTier;
@@ -32,6 +52,80 @@ unsigned kEbsThreadCount;
 unsigned kMemoryNodeCapacity;
 unsigned kEbsNodeCapacity;
 
+// the number of bytes each disk node devotes to caching values, split evenly
+// between its threads
+unsigned long long kEbsCacheCapacity;
+
+// the storage engine backing the memory tier, either "map" or "flat"
+string kMemoryEngine;
+
+// how the memory tier holds SET and ORDERED_SET values, either "node" (one
+// heap node per element) or "packed" (sorted flat arrays)
+string kSetLayout;
+
+// the storage engine backing the disk tier, either "file" or "log"
+string kDiskEngine;
+
+// the directory under which each disk thread keeps its data
+string kEbsRoot;
+
+// the number of file descriptors each disk thread keeps open with the file
+// engine
+unsigned kFdCacheCapacity;
+
+// how long (in seconds) a client must go without writing before the disk
+// tier prunes its entries from causal vector clocks; 0 never prunes them
+unsigned kCausalPruneAfter;
+
+// the number of seconds keys live after their last put, by key prefix; keys
+// that match no prefix never expire
+vector<std::pair<string, unsigned>> kTtlRules;
+
+// how long (in seconds) the tombstone of a deleted key is kept, so that the
+// delete reaches every replica, before the key's space is reclaimed; 0 keeps
+// tombstones forever
+unsigned kTombstoneGrace;
+
+// how LWW values that clients put are compressed; values below the threshold
+// are stored as they are
+ValueCompressor kValueCompressor;
+
+// how the disk tier serves user requests, either "sync" (on the event loop)
+// or "async" (on a dedicated I/O thread)
+string kDiskIO;
+
+// whether memory threads log their writes to survive a restart, where the
+// logs are kept, and how often (in seconds) the logs are compacted into a
+// snapshot
+bool kEnableWal;
+string kWalRoot;
+unsigned kSnapshotPeriod;
+
+// how long (in microseconds) the event loop keeps polling without blocking
+// after its last event; a negative value never blocks
+int kPollSpin;
+
+// the most messages the event loop takes from the request socket, and from
+// the gossip socket, before it turns to its other work
+unsigned kPollBatch;
+
+// the most replication factor responses the event loop takes per iteration;
+// they release user requests that wait on them, so they come right after
+// user requests, with a quarter of their share
+unsigned kReplicationResponseBatch;
+
+// how long (in microseconds) each event loop iteration may spend on gossip
+// and on redistributing keys after a node join; 0 leaves them unbounded
+unsigned kBackgroundBudget;
+
+// the CPUs storage threads are pinned to, by thread id; empty leaves
+// threads unpinned
+vector<unsigned> kServerCpus;
+
+// the CPUs the threads that storage threads start run on, so that they do not
+// share the core of the thread that started them
+cpu_set_t kHelperCpus;
+
 unsigned kDefaultGlobalMemoryReplication;
 unsigned kDefaultGlobalEbsReplication;
 unsigned kDefaultLocalReplication;
@@ -47,11 +141,21 @@ HashRingUtilInterface *kHashRingUtil = &hash_ring_util;
 void run(unsigned thread_id, Address public_ip, Address private_ip,
          Address seed_ip, vector<Address> routing_ips,
          vector<Address> monitoring_ips, Address management_ip) {
+  // pin the thread before it allocates anything of its own, so that its
+  // stores are on its NUMA node
+  bool pinned = !kServerCpus.empty() &&
+                pin_thread(thread_cpu(kServerCpus, thread_id));
+
   string log_file = "log_" + std::to_string(thread_id) + ".txt";
   string log_name = "server_log_" + std::to_string(thread_id);
   auto log = spdlog::basic_logger_mt(log_name, log_file, true);
   log->flush_on(spdlog::level::info);
 
+  if (pinned) {
+    unsigned cpu = thread_cpu(kServerCpus, thread_id);
+    log->info("Pinned to CPU {} on NUMA node {}.", cpu, cpu_numa_node(cpu));
+  }
+
   // each thread has a handle to itself
   ServerThread wt = ServerThread(public_ip, private_ip, thread_id);
 
@@ -86,26 +190,27 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
   // for tracking IP addresses of extant caches
   set<Address> extant_caches;
 
-  // For tracking the keys each extant cache is responsible for.
-  // This is just our thread's cache of this.
-  map<Address, set<Key>> cache_ip_to_keys;
+  // the keys of the cache index, the pending events and the changeset, which
+  // keep them by handle, so that a key they share is stored once
+  KeyInterner key_interner;
 
-  // For tracking the caches that hold a given key.
-  // Inverse of cache_ip_to_keys.
-  // We need the two structures because
-  // key->caches is the one necessary for gossiping upon key updates,
-  // but the mapping is provided to us in the form cache->keys,
-  // so we need a local copy of this mapping in order to update key->caches
-  // with dropped keys when we receive a fresh cache->keys record.
-  map<Key, set<Address>> key_to_cache_ips;
+  // For tracking the keys each extant cache is responsible for, and the
+  // caches that hold a given key. key->caches is the one necessary for
+  // gossiping upon key updates, but the mapping is provided to us in the
+  // form cache->keys, so the index keeps both.
+  CacheKeyIndex cache_index(&key_interner);
 
   // pending events for asynchrony
-  map<Key, vector<PendingRequest>> pending_requests;
-  map<Key, vector<PendingGossip>> pending_gossip;
+  KeyHandleMap<vector<PendingRequest>> pending_requests(&key_interner);
+  KeyHandleMap<vector<PendingGossip>> pending_gossip(&key_interner);
 
   // this map contains all keys that are actually stored in the KVS
   map<Key, KeyProperty> stored_key_map;
 
+  // the total size of the keys in stored_key_map, kept up to date as keys
+  // are written and removed
+  unsigned long long storage_consumption = 0;
+
   map<Key, KeyReplication> key_replication_map;
 
   // request server addresses from the seed node
@@ -157,36 +262,6 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
     }
   }
 
-  // thread 0 notifies other servers that it has joined
-  if (thread_id == 0) {
-    string msg = Tier_Name(kSelfTier) + ":" + public_ip + ":" + private_ip +
-                 ":" + count_str;
-
-    for (const auto &pair : global_hash_rings) {
-      GlobalHashRing hash_ring = pair.second;
-
-      for (const ServerThread &st : hash_ring.get_unique_servers()) {
-        if (st.private_ip().compare(private_ip) != 0) {
-          kZmqUtil->send_string(msg, &pushers[st.node_join_connect_address()]);
-        }
-      }
-    }
-
-    msg = "join:" + msg;
-
-    // notify proxies that this node has joined
-    for (const string &address : routing_ips) {
-      kZmqUtil->send_string(
-          msg, &pushers[RoutingThread(address, 0).notify_connect_address()]);
-    }
-
-    // notify monitoring nodes that this node has joined
-    for (const string &address : monitoring_ips) {
-      kZmqUtil->send_string(
-          msg, &pushers[MonitoringThread(address).notify_connect_address()]);
-    }
-  }
-
   SerializerMap serializers;
 
   Serializer *lww_serializer;
@@ -196,15 +271,59 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
   Serializer *mk_causal_serializer;
   Serializer *priority_serializer;
 
-  if (kSelfTier == Tier::MEMORY) {
+  // the disk tier keeps each thread's data in its own directory
+  string ebs_dir = kEbsRoot + "ebs_" + std::to_string(thread_id) + "/";
+
+  // only set when the disk tier runs the log-structured engine
+  LogStore *log_store = nullptr;
+
+  // only set on disk threads with a nonzero cache capacity
+  ValueCache *value_cache = nullptr;
+
+  if (kSelfTier == Tier::DISK && kEbsCacheCapacity > 0) {
+    value_cache = new ValueCache(kEbsCacheCapacity / kEbsThreadCount);
+  }
+
+  if (kSelfTier == Tier::MEMORY && kMemoryEngine == "flat") {
+    FlatLWWKVS *lww_kvs = new FlatLWWKVS();
+    lww_serializer = new FlatLWWSerializer(lww_kvs);
+
+    if (kSetLayout == "packed") {
+      set_serializer = new FlatPackedSetSerializer(new FlatPackedSetKVS());
+      ordered_set_serializer =
+          new FlatPackedOrderedSetSerializer(new FlatPackedSetKVS());
+    } else {
+      FlatSetKVS *set_kvs = new FlatSetKVS();
+      set_serializer = new FlatSetSerializer(set_kvs);
+
+      FlatOrderedSetKVS *ordered_set_kvs = new FlatOrderedSetKVS();
+      ordered_set_serializer = new FlatOrderedSetSerializer(ordered_set_kvs);
+    }
+
+    FlatSingleKeyCausalKVS *causal_kvs = new FlatSingleKeyCausalKVS();
+    sk_causal_serializer = new FlatSingleKeyCausalSerializer(causal_kvs);
+
+    FlatMultiKeyCausalKVS *multi_key_causal_kvs = new FlatMultiKeyCausalKVS();
+    mk_causal_serializer =
+        new FlatMultiKeyCausalSerializer(multi_key_causal_kvs);
+
+    FlatPriorityKVS *priority_kvs = new FlatPriorityKVS();
+    priority_serializer = new FlatPrioritySerializer(priority_kvs);
+  } else if (kSelfTier == Tier::MEMORY) {
     MemoryLWWKVS *lww_kvs = new MemoryLWWKVS();
     lww_serializer = new MemoryLWWSerializer(lww_kvs);
 
-    MemorySetKVS *set_kvs = new MemorySetKVS();
-    set_serializer = new MemorySetSerializer(set_kvs);
+    if (kSetLayout == "packed") {
+      set_serializer = new MemoryPackedSetSerializer(new MemoryPackedSetKVS());
+      ordered_set_serializer =
+          new MemoryPackedOrderedSetSerializer(new MemoryPackedSetKVS());
+    } else {
+      MemorySetKVS *set_kvs = new MemorySetKVS();
+      set_serializer = new MemorySetSerializer(set_kvs);
 
-    MemoryOrderedSetKVS *ordered_set_kvs = new MemoryOrderedSetKVS();
-    ordered_set_serializer = new MemoryOrderedSetSerializer(ordered_set_kvs);
+      MemoryOrderedSetKVS *ordered_set_kvs = new MemoryOrderedSetKVS();
+      ordered_set_serializer = new MemoryOrderedSetSerializer(ordered_set_kvs);
+    }
 
     MemorySingleKeyCausalKVS *causal_kvs = new MemorySingleKeyCausalKVS();
     sk_causal_serializer = new MemorySingleKeyCausalSerializer(causal_kvs);
@@ -216,13 +335,28 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
 
     MemoryPriorityKVS *priority_kvs = new MemoryPriorityKVS();
     priority_serializer = new MemoryPrioritySerializer(priority_kvs);
+  } else if (kSelfTier == Tier::DISK && kDiskEngine == "log") {
+    log_store = new LogStore(ebs_dir);
+
+    lww_serializer = new LogLWWSerializer(log_store, value_cache);
+    set_serializer = new LogSetSerializer(log_store, value_cache);
+    ordered_set_serializer = new LogOrderedSetSerializer(log_store, value_cache);
+    sk_causal_serializer = new LogSingleKeyCausalSerializer(
+        log_store, value_cache, kCausalPruneAfter);
+    mk_causal_serializer = new LogMultiKeyCausalSerializer(
+        log_store, value_cache, kCausalPruneAfter);
+    priority_serializer = new LogPrioritySerializer(log_store, value_cache);
   } else if (kSelfTier == Tier::DISK) {
-    lww_serializer = new DiskLWWSerializer(thread_id);
-    set_serializer = new DiskSetSerializer(thread_id);
-    ordered_set_serializer = new DiskOrderedSetSerializer(thread_id);
-    sk_causal_serializer = new DiskSingleKeyCausalSerializer(thread_id);
-    mk_causal_serializer = new DiskMultiKeyCausalSerializer(thread_id);
-    priority_serializer = new DiskPrioritySerializer(thread_id);
+    FileStore *file_store = new FileStore(ebs_dir, kFdCacheCapacity);
+
+    lww_serializer = new DiskLWWSerializer(file_store, value_cache);
+    set_serializer = new DiskSetSerializer(file_store, value_cache);
+    ordered_set_serializer = new DiskOrderedSetSerializer(file_store, value_cache);
+    sk_causal_serializer = new DiskSingleKeyCausalSerializer(
+        file_store, value_cache, kCausalPruneAfter);
+    mk_causal_serializer = new DiskMultiKeyCausalSerializer(
+        file_store, value_cache, kCausalPruneAfter);
+    priority_serializer = new DiskPrioritySerializer(file_store, value_cache);
   } else {
     log->info("Invalid node type");
     exit(1);
@@ -235,14 +369,140 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
   serializers[LatticeType::MULTI_CAUSAL] = mk_causal_serializer;
   serializers[LatticeType::PRIORITY] = priority_serializer;
 
+  // with asynchronous disk I/O, the serializers are shared between the event
+  // loop and the I/O thread, so every call goes through one lock; the event
+  // I/O thread also takes it to compact the log store, and the event loop to
+  // read the value cache
+  std::mutex serializer_mutex;
+
+  if (kSelfTier == Tier::DISK && kDiskIO == "async") {
+    serializers.for_each(
+        [&serializer_mutex](LatticeType type, Serializer *&serializer) {
+          serializer = new LockedSerializer(serializer, &serializer_mutex);
+        });
+  }
+
+  // with the write-ahead log on, a memory thread restores its previous
+  // contents before it joins, and logs every later put and remove
+  WriteAheadLog *wal = nullptr;
+
+  if (kSelfTier == Tier::MEMORY && kEnableWal) {
+    wal = new WriteAheadLog(kWalRoot + "wal_" + std::to_string(thread_id) +
+                            "/");
+    wal->recover(serializers, stored_key_map);
+    log->info("Recovered {} keys from the write-ahead log.",
+              stored_key_map.size());
+
+    for (const auto &key_pair : stored_key_map) {
+      storage_consumption += key_pair.second.size_;
+    }
+
+    serializers.for_each([wal](LatticeType type, Serializer *&serializer) {
+      serializer = new LoggedSerializer(serializer, type, wal);
+    });
+  }
+
+  // deleted LWW keys are reclaimed once their tombstones are past the grace
+  // period; tombstones restored from the write-ahead log start theirs now
+  KeyExpiry *tombstones = nullptr;
+
+  if (kTombstoneGrace > 0) {
+    tombstones = new KeyExpiry({{"", kTombstoneGrace}});
+    serializers[LatticeType::LWW] =
+        new TombstoneSerializer(serializers[LatticeType::LWW], tombstones);
+
+    auto now = std::chrono::steady_clock::now();
+    for (const auto &key_pair : stored_key_map) {
+      if (key_pair.second.type_ == LatticeType::LWW &&
+          process_get(key_pair.first, serializers[LatticeType::LWW]).second ==
+              AnnaError::KEY_DNE) {
+        tombstones->touch(key_pair.first, now);
+      }
+    }
+  }
+
+  // with TTL rules, every put (re)starts the TTL of its key; keys restored
+  // from the write-ahead log start theirs now
+  KeyExpiry *expiry = nullptr;
+
+  if (!kTtlRules.empty()) {
+    expiry = new KeyExpiry(kTtlRules);
+
+    serializers.for_each([expiry](LatticeType type, Serializer *&serializer) {
+      serializer = new ExpiringSerializer(serializer, expiry);
+    });
+
+    auto now = std::chrono::steady_clock::now();
+    for (const auto &key_pair : stored_key_map) {
+      expiry->touch(key_pair.first, now);
+    }
+  }
+
+  // the I/O thread takes its own copy of the serializers, so it is started
+  // once they are all wrapped; it also compacts the log store whenever it has
+  // nothing else to do. The event loop's own serializers then queue their
+  // writes and removes behind the operations already submitted, so every
+  // operation on a key, whichever path it comes from, runs in the order the
+  // event loop issued it.
+  AsyncDiskIO *disk_io = nullptr;
+
+  if (kSelfTier == Tier::DISK && kDiskIO == "async") {
+    std::function<bool()> compact = nullptr;
+
+    if (log_store != nullptr) {
+      compact = [log_store, &serializer_mutex]() {
+        std::lock_guard<std::mutex> lock(serializer_mutex);
+        return log_store->compact(kLogCompactionBatch);
+      };
+    }
+
+    disk_io = new AsyncDiskIO(serializers, compact,
+                              pinned ? &kHelperCpus : nullptr);
+
+    serializers.for_each([disk_io](LatticeType type, Serializer *&serializer) {
+      serializer = new QueuedSerializer(serializer, type, disk_io);
+    });
+  }
+
+  // thread 0 notifies other servers that it has joined
+  if (thread_id == 0) {
+    string msg = Tier_Name(kSelfTier) + ":" + public_ip + ":" + private_ip +
+                 ":" + count_str;
+
+    for (const auto &pair : global_hash_rings) {
+      GlobalHashRing hash_ring = pair.second;
+
+      for (const ServerThread &st : hash_ring.get_unique_servers()) {
+        if (st.private_ip().compare(private_ip) != 0) {
+          kZmqUtil->send_string(msg, &pushers[st.node_join_connect_address()]);
+        }
+      }
+    }
+
+    msg = "join:" + msg;
+
+    // notify proxies that this node has joined
+    for (const string &address : routing_ips) {
+      kZmqUtil->send_string(
+          msg, &pushers[RoutingThread(address, 0).notify_connect_address()]);
+    }
+
+    // notify monitoring nodes that this node has joined
+    for (const string &address : monitoring_ips) {
+      kZmqUtil->send_string(
+          msg, &pushers[MonitoringThread(address).notify_connect_address()]);
+    }
+  }
+
+
   // the set of changes made on this thread since the last round of gossip
-  set<Key> local_changeset;
+  KeyHandleSet local_changeset(&key_interner);
 
   // keep track of the key stat
   // the first entry is the size of the key,
   // the second entry is its lattice type.
   // keep track of key access timestamp
-  map<Key, std::multiset<TimePoint>> key_access_tracker;
+  KeyAccessTracker key_access_tracker;
   // keep track of total access
   unsigned access_count;
 
@@ -283,6 +543,10 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
   management_node_response_puller.bind(
       wt.management_node_response_bind_address());
 
+  // responsible for answering key range scans from routing threads
+  zmq::socket_t scan_puller(context, ZMQ_PULL);
+  scan_puller.bind(wt.scan_request_bind_address());
+
   //  Initialize poll set
   vector<zmq::pollitem_t> pollitems = {
       {static_cast<void *>(join_puller), 0, ZMQ_POLLIN, 0},
@@ -293,20 +557,370 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
       {static_cast<void *>(replication_response_puller), 0, ZMQ_POLLIN, 0},
       {static_cast<void *>(replication_change_puller), 0, ZMQ_POLLIN, 0},
       {static_cast<void *>(cache_ip_response_puller), 0, ZMQ_POLLIN, 0},
-      {static_cast<void *>(management_node_response_puller), 0, ZMQ_POLLIN, 0}};
+      {static_cast<void *>(management_node_response_puller), 0, ZMQ_POLLIN, 0},
+      {static_cast<void *>(scan_puller), 0, ZMQ_POLLIN, 0}};
+
+  // the request, gossip and replication response sockets are also polled on
+  // their own, to drain them a batch of messages at a time
+  vector<zmq::pollitem_t> request_pollitem = {pollitems[3]};
+  vector<zmq::pollitem_t> gossip_pollitem = {pollitems[4]};
+  vector<zmq::pollitem_t> replication_response_pollitem = {pollitems[5]};
+
+  // completions of asynchronous disk operations are polled next to the sockets
+  if (disk_io != nullptr) {
+    pollitems.push_back({nullptr, disk_io->completion_fd(), ZMQ_POLLIN, 0});
+  }
+
+  // set while this thread is above its share of the memory high water mark
+  bool memory_pressure = false;
 
-  auto gossip_start = std::chrono::system_clock::now();
-  auto gossip_end = std::chrono::system_clock::now();
-  auto report_start = std::chrono::system_clock::now();
-  auto report_end = std::chrono::system_clock::now();
+  // the keys whose demotion is in flight, and when it was requested
+  map<Key, SteadyTimePoint> demotions;
 
   unsigned long long working_time = 0;
-  unsigned long long working_time_map[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  unsigned long long working_time_map[12] = {0, 0, 0, 0, 0, 0,
+                                             0, 0, 0, 0, 0, 0};
   unsigned epoch = 0;
 
+  // set while the log store has sealed segments left to compact
+  bool compaction_pending = false;
+
+  AdaptivePoller poller(kPollSpin);
+
+  // gossip updates to other threads
+  auto gossip = [&](const SteadyTimePoint &) {
+    auto work_start = std::chrono::system_clock::now();
+    // only gossip if we have changes
+    if (local_changeset.size() > 0) {
+      AddressKeysetMap addr_keyset_map;
+      AddressKeysetMap cache_keyset_map;
+
+      bool succeed;
+      for (const Key &key : local_changeset) {
+        // Get the threads that we need to gossip to.
+        ServerThreadList threads = kHashRingUtil->get_responsible_threads(
+            wt.replication_response_connect_address(), key, is_metadata(key),
+            global_hash_rings, local_hash_rings, key_replication_map, pushers,
+            kAllTiers, succeed, seed);
+
+        if (succeed) {
+          for (const ServerThread &thread : threads) {
+            if (!(thread == wt)) {
+              addr_keyset_map[thread.gossip_connect_address()].insert(key);
+            }
+          }
+        } else {
+          log->error("Missing key replication factor in gossip routine.");
+        }
+
+        // Get the caches that we need to gossip to.
+        const set<Address> *cache_ips = cache_index.caches(key);
+        if (cache_ips != nullptr) {
+          for (const Address &cache_ip : *cache_ips) {
+            CacheThread ct(cache_ip, 0);
+            cache_keyset_map[ct.cache_update_connect_address()].insert(key);
+          }
+        }
+      }
+
+      // servers store values as they are gossiped, compressed or not, but
+      // caches hand them to clients
+      send_gossip(addr_keyset_map, pushers, serializers, stored_key_map,
+                  disk_io);
+      send_gossip(cache_keyset_map, pushers, serializers, stored_key_map,
+                  disk_io, true);
+      local_changeset.clear();
+    }
+
+    auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::system_clock::now() - work_start)
+                            .count();
+
+    working_time += time_elapsed;
+    working_time_map[9] += time_elapsed;
+  };
+
+  // Collect and store internal statistics,
+  // fetch the most recent list of cache IPs,
+  // and send out GET requests for the cached keys by cache IP.
+  SteadyTimePoint report_start = poller.now();
+
+  auto report = [&](const SteadyTimePoint &now) {
+    auto duration =
+        std::chrono::duration_cast<std::chrono::seconds>(now - report_start)
+            .count();
+
+    epoch += 1;
+    auto ts = generate_timestamp(wt.tid());
+
+    Key key =
+        get_metadata_key(wt, kSelfTier, wt.tid(), MetadataType::server_stats);
+
+    int index = 0;
+    for (const unsigned long long &time : working_time_map) {
+      // cast to microsecond
+      double event_occupancy = (double)time / ((double)duration * 1000000);
+
+      if (event_occupancy > 0.02) {
+        log->info("Event {} occupancy is {}.", std::to_string(index++),
+                  std::to_string(event_occupancy));
+      }
+    }
+
+    double occupancy = (double)working_time / ((double)duration * 1000000);
+    if (occupancy > 0.02) {
+      log->info("Occupancy is {}.", std::to_string(occupancy));
+    }
+
+    // the share of the period this thread slept instead of spinning
+    double blocked =
+        (double)poller.blocked_time() / ((double)duration * 1000000);
+    log->info("Blocked in poll for {} of the report period.",
+              std::to_string(blocked));
+    poller.reset_counters();
+
+    ServerThreadStatistics stat;
+    stat.set_storage_consumption(storage_consumption / 1000); // cast to KB
+    stat.set_occupancy(occupancy);
+    stat.set_epoch(epoch);
+    stat.set_access_count(access_count);
+
+    if (value_cache != nullptr) {
+      std::lock_guard<std::mutex> lock(serializer_mutex);
+      stat.set_cache_hits(value_cache->hits());
+      stat.set_cache_misses(value_cache->misses());
+      value_cache->reset_counters();
+    }
+
+    string serialized_stat;
+    stat.SerializeToString(&serialized_stat);
+
+    KeyRequest req;
+    req.set_type(RequestType::PUT);
+    prepare_put_tuple(req, key, LatticeType::LWW,
+                      serialize(ts, serialized_stat));
+
+    auto threads = kHashRingUtil->get_responsible_threads_metadata(
+        key, global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY]);
+    if (threads.size() != 0) {
+      Address target_address =
+          std::next(begin(threads), rand_r(&seed) % threads.size())
+              ->key_request_connect_address();
+      string serialized;
+      req.SerializeToString(&serialized);
+      kZmqUtil->send_string(serialized, &pushers[target_address]);
+    }
+
+    // compute key access stats
+    KeyAccessData access;
+    auto current_time = std::chrono::system_clock::now();
+
+    // garbage collect
+    key_access_tracker.expire(current_time -
+                                  std::chrono::seconds(kKeyMonitoringThreshold),
+                              stored_key_map);
+
+    // update key_access_frequency; stored keys without recent accesses are
+    // reported with a count of zero, since those are the keys the monitoring
+    // policies look for
+    for (const auto &key_pair : stored_key_map) {
+      KeyAccessData_KeyCount *tp = access.add_keys();
+      tp->set_key(key_pair.first);
+      tp->set_access_count(key_access_tracker.count(key_pair.first));
+    }
+
+    // report key access stats
+    key = get_metadata_key(wt, kSelfTier, wt.tid(), MetadataType::key_access);
+    string serialized_access;
+    access.SerializeToString(&serialized_access);
+
+    req.Clear();
+    req.set_type(RequestType::PUT);
+    prepare_put_tuple(req, key, LatticeType::LWW,
+                      serialize(ts, serialized_access));
+
+    threads = kHashRingUtil->get_responsible_threads_metadata(
+        key, global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY]);
+
+    if (threads.size() != 0) {
+      Address target_address =
+          std::next(begin(threads), rand_r(&seed) % threads.size())
+              ->key_request_connect_address();
+      string serialized;
+      req.SerializeToString(&serialized);
+      kZmqUtil->send_string(serialized, &pushers[target_address]);
+    }
+
+    KeySizeData primary_key_size;
+    for (const auto &key_pair : stored_key_map) {
+      if (is_primary_replica(key_pair.first, key_replication_map,
+                             global_hash_rings, local_hash_rings, wt)) {
+        KeySizeData_KeySize *ks = primary_key_size.add_key_sizes();
+        ks->set_key(key_pair.first);
+        ks->set_size(key_pair.second.size_);
+      }
+    }
+
+    key = get_metadata_key(wt, kSelfTier, wt.tid(), MetadataType::key_size);
+
+    string serialized_size;
+    primary_key_size.SerializeToString(&serialized_size);
+
+    req.Clear();
+    req.set_type(RequestType::PUT);
+    prepare_put_tuple(req, key, LatticeType::LWW,
+                      serialize(ts, serialized_size));
+
+    threads = kHashRingUtil->get_responsible_threads_metadata(
+        key, global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY]);
+
+    if (threads.size() != 0) {
+      Address target_address =
+          std::next(begin(threads), rand_r(&seed) % threads.size())
+              ->key_request_connect_address();
+      string serialized;
+      req.SerializeToString(&serialized);
+      kZmqUtil->send_string(serialized, &pushers[target_address]);
+    }
+
+    report_start = now;
+
+    // Get the most recent list of cache IPs.
+    // (Actually gets the list of all current function executor nodes.)
+    // (The message content doesn't matter here; it's an argless RPC call.)
+    // Only do this if a management_ip is set -- i.e., we are not running in
+    // local mode.
+    if (management_ip != "NULL") {
+      kZmqUtil->send_string(
+          wt.management_node_response_connect_address(),
+          &pushers[get_func_nodes_req_address(management_ip)]);
+    }
+
+    // reset stats tracked in memory
+    working_time = 0;
+    access_count = 0;
+    memset(working_time_map, 0, sizeof(working_time_map));
+  };
+
+  // drop the keys whose TTL has run out, and with them any pending gossip,
+  // and reclaim the keys whose tombstones are past the grace period
+  auto expire = [&](const SteadyTimePoint &now) {
+    if (expiry != nullptr) {
+      vector<Key> expired;
+      expiry->expire(now, expired);
+
+      for (const Key &key : expired) {
+        remove_key(key, serializers, stored_key_map, storage_consumption);
+        local_changeset.erase(key);
+      }
+
+      if (!expired.empty()) {
+        log->info("Expired {} keys.", expired.size());
+      }
+    }
+
+    if (tombstones != nullptr) {
+      vector<Key> collected;
+      tombstones->expire(now, collected);
+
+      for (const Key &key : collected) {
+        remove_key(key, serializers, stored_key_map, storage_consumption);
+      }
+    }
+  };
+
+  // enforce the node's memory capacity locally, since the monitor's
+  // movement policy runs far too rarely to keep a node from running out
+  // of memory; every thread keeps the keys it stores within its share of the
+  // capacity, as the monitor measures them
+  auto check_memory = [&](const SteadyTimePoint &now) {
+    // the capacity is configured in KB
+    unsigned long long capacity = kMemoryNodeCapacity * 1000ULL / kThreadNum;
+
+    // keys on their way to the disk tier are already accounted for, until
+    // they are dropped or their demotion times out
+    unsigned long long demoting = 0;
+
+    for (auto it = demotions.begin(); it != demotions.end();) {
+      auto key_it = stored_key_map.find(it->first);
+
+      if (key_it == stored_key_map.end() ||
+          now - it->second >= std::chrono::milliseconds(kDemotionTimeout)) {
+        it = demotions.erase(it);
+      } else {
+        demoting += key_it->second.size_;
+        ++it;
+      }
+    }
+
+    memory_pressure = storage_consumption > kMemoryHighWaterMark * capacity;
+    double target = storage_consumption - demoting -
+                    kMemoryLowWaterMark * capacity;
+
+    if (memory_pressure && global_hash_rings[Tier::DISK].size() == 0) {
+      log->error("Storage of {} bytes is over the high water mark, but there "
+                 "is no disk tier to demote keys to.",
+                 storage_consumption);
+    } else if (memory_pressure && target > 0) {
+      vector<Key> keys = select_cold_keys(target, kMaxDemotionBatch,
+                                          stored_key_map, key_access_tracker,
+                                          demotions);
+
+      demote_keys(keys, global_hash_rings, local_hash_rings,
+                  key_replication_map, routing_ips, pushers, rid);
+
+      for (const Key &key : keys) {
+        demotions[key] = now;
+      }
+
+      log->info("Storage of {} bytes is over the high water mark. Demoting "
+                "{} keys to the disk tier.",
+                storage_consumption, keys.size());
+    }
+  };
+
+  // start a snapshot, which the event loop writes a batch at a time
+  auto snapshot = [&](const SteadyTimePoint &) {
+    if (!wal->snapshotting()) {
+      wal->begin_snapshot(stored_key_map);
+    }
+  };
+
+  PeriodicTimers timers;
+  timers.add(std::chrono::microseconds(PERIOD), poller.now(), gossip);
+  timers.add(std::chrono::seconds(kServerReportThreshold), poller.now(),
+             report);
+
+  if (expiry != nullptr || tombstones != nullptr) {
+    timers.add(std::chrono::milliseconds(kExpiryTick), poller.now(), expire);
+  }
+
+  if (kSelfTier == Tier::MEMORY) {
+    timers.add(std::chrono::milliseconds(kMemoryCheckPeriod), poller.now(),
+               check_memory);
+  }
+
+  if (wal != nullptr) {
+    timers.add(std::chrono::seconds(kSnapshotPeriod), poller.now(), snapshot);
+  }
+
   // enter event loop
   while (true) {
-    kZmqUtil->poll(0, &pollitems);
+    // when idle, block until the next timer or group commit is due, or not
+    // at all while there is background work in progress
+    SteadyTimePoint deadline = timers.next_deadline();
+    SteadyTimePoint commit_deadline;
+
+    if (wal != nullptr && wal->commit_deadline(commit_deadline)) {
+      deadline = std::min(deadline, commit_deadline);
+    }
+
+    if (compaction_pending || join_gossip_map.size() != 0 ||
+        (wal != nullptr && wal->snapshotting())) {
+      deadline = poller.now();
+    }
+
+    poller.poll(&pollitems, deadline);
 
     // receives a node join
     if (pollitems[0].revents & ZMQ_POLLIN) {
@@ -341,6 +955,20 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
 
     if (pollitems[2].revents & ZMQ_POLLIN) {
       string serialized = kZmqUtil->recv_string(&self_depart_puller);
+
+      // finish the disk operations in flight and acknowledge the logged
+      // writes before the keys are handed off
+      if (wal != nullptr) {
+        wal->commit();
+        wal->release(pushers);
+      }
+
+      if (disk_io != nullptr) {
+        disk_io->wait_until_idle();
+        disk_io->process_completions(stored_key_map, storage_consumption,
+                                     local_changeset, pushers);
+      }
+
       self_depart_handler(thread_id, seed, public_ip, private_ip, log,
                           serialized, global_hash_rings, local_hash_rings,
                           stored_key_map, key_replication_map, routing_ips,
@@ -352,12 +980,19 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
     if (pollitems[3].revents & ZMQ_POLLIN) {
       auto work_start = std::chrono::system_clock::now();
 
-      string serialized = kZmqUtil->recv_string(&request_puller);
-      user_request_handler(access_count, seed, serialized, log,
-                           global_hash_rings, local_hash_rings,
-                           pending_requests, key_access_tracker, stored_key_map,
-                           key_replication_map, local_changeset, wt,
-                           serializers, pushers);
+      unsigned drained = 0;
+
+      do {
+        string serialized = kZmqUtil->recv_string(&request_puller);
+        user_request_handler(access_count, seed, serialized, log,
+                             global_hash_rings, local_hash_rings,
+                             pending_requests, key_access_tracker,
+                             stored_key_map, storage_consumption,
+                             key_replication_map, local_changeset, wt,
+                             serializers, pushers, disk_io, wal,
+                             memory_pressure);
+      } while (++drained < kPollBatch &&
+               kZmqUtil->poll(0, &request_pollitem) > 0);
 
       auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
                               std::chrono::system_clock::now() - work_start)
@@ -367,31 +1002,37 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
       working_time_map[3] += time_elapsed;
     }
 
-    if (pollitems[4].revents & ZMQ_POLLIN) {
+    // finish user requests whose disk operations have completed
+    if (disk_io != nullptr && pollitems[10].revents & ZMQ_POLLIN) {
       auto work_start = std::chrono::system_clock::now();
 
-      string serialized = kZmqUtil->recv_string(&gossip_puller);
-      gossip_handler(seed, serialized, global_hash_rings, local_hash_rings,
-                     pending_gossip, stored_key_map, key_replication_map, wt,
-                     serializers, pushers, log);
+      disk_io->process_completions(stored_key_map, storage_consumption,
+                                   local_changeset, pushers);
 
       auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
                               std::chrono::system_clock::now() - work_start)
                               .count();
       working_time += time_elapsed;
-      working_time_map[4] += time_elapsed;
+      working_time_map[10] += time_elapsed;
     }
 
     // receives replication factor response
     if (pollitems[5].revents & ZMQ_POLLIN) {
       auto work_start = std::chrono::system_clock::now();
 
-      string serialized = kZmqUtil->recv_string(&replication_response_puller);
-      replication_response_handler(
-          seed, access_count, log, serialized, global_hash_rings,
-          local_hash_rings, pending_requests, pending_gossip,
-          key_access_tracker, stored_key_map, key_replication_map,
-          local_changeset, wt, serializers, pushers);
+      unsigned drained = 0;
+
+      do {
+        string serialized =
+            kZmqUtil->recv_string(&replication_response_puller);
+        replication_response_handler(
+            seed, access_count, log, serialized, global_hash_rings,
+            local_hash_rings, pending_requests, pending_gossip,
+            key_access_tracker, stored_key_map, storage_consumption,
+            key_replication_map, local_changeset, wt, serializers, pushers,
+            disk_io, wal);
+      } while (++drained < kReplicationResponseBatch &&
+               kZmqUtil->poll(0, &replication_response_pollitem) > 0);
 
       auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
                               std::chrono::system_clock::now() - work_start)
@@ -408,7 +1049,8 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
       replication_change_handler(
           public_ip, private_ip, thread_id, seed, log, serialized,
           global_hash_rings, local_hash_rings, stored_key_map,
-          key_replication_map, local_changeset, wt, serializers, pushers);
+          storage_consumption, key_replication_map, local_changeset, wt,
+          serializers, pushers, disk_io);
 
       auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
                               std::chrono::system_clock::now() - work_start)
@@ -422,7 +1064,7 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
       auto work_start = std::chrono::system_clock::now();
 
       string serialized = kZmqUtil->recv_string(&cache_ip_response_puller);
-      cache_ip_response_handler(serialized, cache_ip_to_keys, key_to_cache_ips);
+      cache_ip_response_handler(serialized, cache_index);
 
       auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
                               std::chrono::system_clock::now() - work_start)
@@ -438,8 +1080,8 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
       string serialized =
           kZmqUtil->recv_string(&management_node_response_puller);
       management_node_response_handler(
-          serialized, extant_caches, cache_ip_to_keys, key_to_cache_ips,
-          global_hash_rings, local_hash_rings, pushers, wt, rid);
+          serialized, extant_caches, cache_index, global_hash_rings,
+          local_hash_rings, pushers, wt, rid);
 
       auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
                               std::chrono::system_clock::now() - work_start)
@@ -448,224 +1090,64 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
       working_time_map[8] += time_elapsed;
     }
 
-    // gossip updates to other threads
-    gossip_end = std::chrono::system_clock::now();
-    if (std::chrono::duration_cast<std::chrono::microseconds>(gossip_end -
-                                                              gossip_start)
-            .count() >= PERIOD) {
+    // answer a key range scan
+    if (pollitems[9].revents & ZMQ_POLLIN) {
       auto work_start = std::chrono::system_clock::now();
-      // only gossip if we have changes
-      if (local_changeset.size() > 0) {
-        AddressKeysetMap addr_keyset_map;
-
-        bool succeed;
-        for (const Key &key : local_changeset) {
-          // Get the threads that we need to gossip to.
-          ServerThreadList threads = kHashRingUtil->get_responsible_threads(
-              wt.replication_response_connect_address(), key, is_metadata(key),
-              global_hash_rings, local_hash_rings, key_replication_map, pushers,
-              kAllTiers, succeed, seed);
-
-          if (succeed) {
-            for (const ServerThread &thread : threads) {
-              if (!(thread == wt)) {
-                addr_keyset_map[thread.gossip_connect_address()].insert(key);
-              }
-            }
-          } else {
-            log->error("Missing key replication factor in gossip routine.");
-          }
 
-          // Get the caches that we need to gossip to.
-          if (key_to_cache_ips.find(key) != key_to_cache_ips.end()) {
-            set<Address> &cache_ips = key_to_cache_ips[key];
-            for (const Address &cache_ip : cache_ips) {
-              CacheThread ct(cache_ip, 0);
-              addr_keyset_map[ct.cache_update_connect_address()].insert(key);
-            }
-          }
-        }
+      string serialized = kZmqUtil->recv_string(&scan_puller);
+      scan_handler(serialized, stored_key_map, pushers);
 
-        send_gossip(addr_keyset_map, pushers, serializers, stored_key_map);
-        local_changeset.clear();
-      }
-
-      gossip_start = std::chrono::system_clock::now();
       auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
                               std::chrono::system_clock::now() - work_start)
                               .count();
-
       working_time += time_elapsed;
-      working_time_map[9] += time_elapsed;
+      working_time_map[11] += time_elapsed;
     }
 
-    // Collect and store internal statistics,
-    // fetch the most recent list of cache IPs,
-    // and send out GET requests for the cached keys by cache IP.
-    report_end = std::chrono::system_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::seconds>(
-                        report_end - report_start)
-                        .count();
-
-    if (duration >= kServerReportThreshold) {
-      epoch += 1;
-      auto ts = generate_timestamp(wt.tid());
-
-      Key key =
-          get_metadata_key(wt, kSelfTier, wt.tid(), MetadataType::server_stats);
-
-      // compute total storage consumption
-      unsigned long long consumption = 0;
-      for (const auto &key_pair : stored_key_map) {
-        consumption += key_pair.second.size_;
-      }
-
-      int index = 0;
-      for (const unsigned long long &time : working_time_map) {
-        // cast to microsecond
-        double event_occupancy = (double)time / ((double)duration * 1000000);
-
-        if (event_occupancy > 0.02) {
-          log->info("Event {} occupancy is {}.", std::to_string(index++),
-                    std::to_string(event_occupancy));
-        }
-      }
-
-      double occupancy = (double)working_time / ((double)duration * 1000000);
-      if (occupancy > 0.02) {
-        log->info("Occupancy is {}.", std::to_string(occupancy));
-      }
-
-      ServerThreadStatistics stat;
-      stat.set_storage_consumption(consumption / 1000); // cast to KB
-      stat.set_occupancy(occupancy);
-      stat.set_epoch(epoch);
-      stat.set_access_count(access_count);
-
-      string serialized_stat;
-      stat.SerializeToString(&serialized_stat);
-
-      KeyRequest req;
-      req.set_type(RequestType::PUT);
-      prepare_put_tuple(req, key, LatticeType::LWW,
-                        serialize(ts, serialized_stat));
-
-      auto threads = kHashRingUtil->get_responsible_threads_metadata(
-          key, global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY]);
-      if (threads.size() != 0) {
-        Address target_address =
-            std::next(begin(threads), rand_r(&seed) % threads.size())
-                ->key_request_connect_address();
-        string serialized;
-        req.SerializeToString(&serialized);
-        kZmqUtil->send_string(serialized, &pushers[target_address]);
-      }
-
-      // compute key access stats
-      KeyAccessData access;
-      auto current_time = std::chrono::system_clock::now();
-
-      for (const auto &key_access_pair : key_access_tracker) {
-        Key key = key_access_pair.first;
-        auto access_times = key_access_pair.second;
-
-        // garbage collect
-        for (const auto &time : access_times) {
-          if (std::chrono::duration_cast<std::chrono::seconds>(current_time -
-                                                               time)
-                  .count() >= kKeyMonitoringThreshold) {
-            access_times.erase(time);
-            break;
-          }
-        }
-
-        // update key_access_frequency
-        KeyAccessData_KeyCount *tp = access.add_keys();
-        tp->set_key(key);
-        tp->set_access_count(access_times.size());
-      }
-
-      // report key access stats
-      key = get_metadata_key(wt, kSelfTier, wt.tid(), MetadataType::key_access);
-      string serialized_access;
-      access.SerializeToString(&serialized_access);
-
-      req.Clear();
-      req.set_type(RequestType::PUT);
-      prepare_put_tuple(req, key, LatticeType::LWW,
-                        serialize(ts, serialized_access));
-
-      threads = kHashRingUtil->get_responsible_threads_metadata(
-          key, global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY]);
-
-      if (threads.size() != 0) {
-        Address target_address =
-            std::next(begin(threads), rand_r(&seed) % threads.size())
-                ->key_request_connect_address();
-        string serialized;
-        req.SerializeToString(&serialized);
-        kZmqUtil->send_string(serialized, &pushers[target_address]);
-      }
-
-      KeySizeData primary_key_size;
-      for (const auto &key_pair : stored_key_map) {
-        if (is_primary_replica(key_pair.first, key_replication_map,
-                               global_hash_rings, local_hash_rings, wt)) {
-          KeySizeData_KeySize *ks = primary_key_size.add_key_sizes();
-          ks->set_key(key_pair.first);
-          ks->set_size(key_pair.second.size_);
-        }
-      }
-
-      key = get_metadata_key(wt, kSelfTier, wt.tid(), MetadataType::key_size);
-
-      string serialized_size;
-      primary_key_size.SerializeToString(&serialized_size);
-
-      req.Clear();
-      req.set_type(RequestType::PUT);
-      prepare_put_tuple(req, key, LatticeType::LWW,
-                        serialize(ts, serialized_size));
+    // Background work comes last, and beyond a first message or step of
+    // each kind, only runs while the iteration's budget lasts, so that a
+    // burst of it does not hold up the user requests waiting behind it.
+    SteadyTimePoint background_end = SteadyTimePoint::max();
+    if (kBackgroundBudget > 0) {
+      background_end = std::chrono::steady_clock::now() +
+                       std::chrono::microseconds(kBackgroundBudget);
+    }
 
-      threads = kHashRingUtil->get_responsible_threads_metadata(
-          key, global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY]);
+    // apply gossip from other replicas
+    if (pollitems[4].revents & ZMQ_POLLIN) {
+      auto work_start = std::chrono::system_clock::now();
 
-      if (threads.size() != 0) {
-        Address target_address =
-            std::next(begin(threads), rand_r(&seed) % threads.size())
-                ->key_request_connect_address();
-        string serialized;
-        req.SerializeToString(&serialized);
-        kZmqUtil->send_string(serialized, &pushers[target_address]);
-      }
+      unsigned drained = 0;
 
-      report_start = std::chrono::system_clock::now();
-
-      // Get the most recent list of cache IPs.
-      // (Actually gets the list of all current function executor nodes.)
-      // (The message content doesn't matter here; it's an argless RPC call.)
-      // Only do this if a management_ip is set -- i.e., we are not running in
-      // local mode.
-      if (management_ip != "NULL") {
-        kZmqUtil->send_string(
-            wt.management_node_response_connect_address(),
-            &pushers[get_func_nodes_req_address(management_ip)]);
-      }
+      do {
+        string serialized = kZmqUtil->recv_string(&gossip_puller);
+        gossip_handler(seed, serialized, global_hash_rings, local_hash_rings,
+                       pending_gossip, stored_key_map, storage_consumption,
+                       key_replication_map, wt, serializers, pushers, log);
+      } while (++drained < kPollBatch &&
+               std::chrono::steady_clock::now() < background_end &&
+               kZmqUtil->poll(0, &gossip_pollitem) > 0);
 
-      // reset stats tracked in memory
-      working_time = 0;
-      access_count = 0;
-      memset(working_time_map, 0, sizeof(working_time_map));
+      auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::system_clock::now() - work_start)
+                              .count();
+      working_time += time_elapsed;
+      working_time_map[4] += time_elapsed;
     }
 
+    // run the periodic work that is due
+    timers.run_due(poller.now());
+
     // redistribute data after node joins
     if (join_gossip_map.size() != 0) {
       set<Address> remove_address_set;
-      AddressKeysetMap addr_keyset_map;
 
-      for (const auto &join_pair : join_gossip_map) {
+      // reading and sending the keys is the costly part, so each address
+      // is sent on its own and the budget is checked in between
+      for (auto &join_pair : join_gossip_map) {
         Address address = join_pair.first;
-        set<Key> key_set = join_pair.second;
+        set<Key> &key_set = join_pair.second;
+        AddressKeysetMap addr_keyset_map;
         // track all sent keys because we cannot modify the key_set while
         // iterating over it
         set<Key> sent_keys;
@@ -678,6 +1160,9 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
           }
         }
 
+        send_gossip(addr_keyset_map, pushers, serializers, stored_key_map,
+                    disk_io);
+
         // remove the keys we just dealt with
         for (const Key &key : sent_keys) {
           key_set.erase(key);
@@ -686,24 +1171,41 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
         if (key_set.size() == 0) {
           remove_address_set.insert(address);
         }
+
+        if (std::chrono::steady_clock::now() >= background_end) {
+          break;
+        }
       }
 
       for (const Address &remove_address : remove_address_set) {
         join_gossip_map.erase(remove_address);
       }
 
-      send_gossip(addr_keyset_map, pushers, serializers, stored_key_map);
-
       // remove keys
       if (join_gossip_map.size() == 0) {
         for (const string &key : join_remove_set) {
-          serializers[stored_key_map[key].type_]->remove(key);
-          stored_key_map.erase(key);
+          remove_key(key, serializers, stored_key_map, storage_consumption);
         }
 
         join_remove_set.clear();
       }
     }
+
+    // reclaim the space held by superseded log records, a few at a time so
+    // that requests are not held up behind a whole segment; with
+    // asynchronous disk I/O, the I/O thread does this instead
+    if (log_store != nullptr && disk_io == nullptr) {
+      std::lock_guard<std::mutex> lock(serializer_mutex);
+      compaction_pending = log_store->compact(kLogCompactionBatch);
+    }
+
+    // sync logged writes in groups and acknowledge the PUTs they cover, and
+    // write the snapshot in progress a batch of keys at a time
+    if (wal != nullptr) {
+      wal->commit_if_due(poller.now());
+      wal->continue_snapshot(serializers, stored_key_map);
+      wal->release(pushers);
+    }
   }
 }
 
@@ -744,6 +1246,100 @@ int main(int argc, char *argv[]) {
   YAML::Node capacities = conf["capacities"];
   kMemoryNodeCapacity = capacities["memory-cap"].as<unsigned>() * 1000000;
   kEbsNodeCapacity = capacities["ebs-cap"].as<unsigned>() * 1000000;
+  kEbsCacheCapacity = capacities["ebs-cache-cap"].as<double>(0) * 1000000000;
+
+  // the storage and polling settings are optional; without them, a server
+  // stores, serves and polls as it did before they were added
+  YAML::Node storage = conf["storage"];
+  kMemoryEngine = storage["memory-engine"].as<string>("map");
+
+  if (kMemoryEngine != "map" && kMemoryEngine != "flat") {
+    std::cout << "Unrecognized memory engine " << kMemoryEngine
+              << ". Valid engines are map or flat." << std::endl;
+    return 1;
+  }
+
+  kSetLayout = storage["set-layout"].as<string>("node");
+
+  if (kSetLayout != "node" && kSetLayout != "packed") {
+    std::cout << "Unrecognized set layout " << kSetLayout
+              << ". Valid layouts are node or packed." << std::endl;
+    return 1;
+  }
+
+  kDiskEngine = storage["disk-engine"].as<string>("file");
+
+  if (kDiskEngine != "file" && kDiskEngine != "log") {
+    std::cout << "Unrecognized disk engine " << kDiskEngine
+              << ". Valid engines are file or log." << std::endl;
+    return 1;
+  }
+
+  kFdCacheCapacity = storage["fd-cache"].as<unsigned>(0);
+  kCausalPruneAfter = storage["causal-prune-after"].as<unsigned>(0);
+  kTombstoneGrace = storage["tombstone-grace"].as<unsigned>(0);
+
+  ValueCodec codec;
+  string compression = storage["compression"].as<string>("none");
+
+  if (!parse_value_codec(compression, codec)) {
+    std::cout << "Unrecognized compression " << compression
+              << ". Valid codecs are none, lz4 or zstd." << std::endl;
+    return 1;
+  }
+
+  if (!value_codec_available(codec)) {
+    std::cout << "Anna was built without " << compression
+              << ", so values will not be compressed." << std::endl;
+    codec = ValueCodec::NONE;
+  }
+
+  kValueCompressor = ValueCompressor(
+      codec, storage["compression-threshold"].as<unsigned>(8192));
+
+  for (const auto &rule : storage["ttl"]) {
+    kTtlRules.push_back(
+        {rule.first.as<string>(), rule.second.as<unsigned>()});
+  }
+
+  kDiskIO = storage["disk-io"].as<string>("sync");
+
+  if (kDiskIO != "sync" && kDiskIO != "async") {
+    std::cout << "Unrecognized disk I/O mode " << kDiskIO
+              << ". Valid modes are sync or async." << std::endl;
+    return 1;
+  }
+
+  kEnableWal = storage["wal"].as<bool>(false);
+  kWalRoot = storage["wal-root"].as<string>("/wal");
+  kSnapshotPeriod = storage["snapshot-period"].as<unsigned>(600);
+
+  if (kWalRoot.back() != '/') {
+    kWalRoot += "/";
+  }
+
+  kEbsRoot = conf["ebs"].as<string>();
+
+  if (kEbsRoot.back() != '/') {
+    kEbsRoot += "/";
+  }
+
+  YAML::Node polling = conf["polling"];
+  kPollSpin = polling["spin"].as<int>(-1);
+  kPollBatch = polling["batch"].as<unsigned>(1);
+  kReplicationResponseBatch = std::max(kPollBatch / 4, 1u);
+  kBackgroundBudget = polling["background-budget"].as<unsigned>(0);
+
+  YAML::Node affinity = conf["affinity"];
+  if (affinity && affinity["server"] &&
+      !parse_cpu_list(affinity["server"].as<string>(), kServerCpus)) {
+    std::cerr << "Invalid CPU list " << affinity["server"].as<string>()
+              << " for server threads." << std::endl;
+    return 1;
+  }
+
+  // read before run pins the main thread
+  kHelperCpus = helper_cpus(kServerCpus);
 
   YAML::Node replication = conf["replication"];
   kDefaultGlobalMemoryReplication = replication["memory"].as<unsigned>();
@@ -17,11 +17,13 @@
 void user_request_handler(
     unsigned &access_count, unsigned &seed, string &serialized, logger log,
     GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
-    map<Key, vector<PendingRequest>> &pending_requests,
-    map<Key, std::multiset<TimePoint>> &key_access_tracker,
+    KeyHandleMap<vector<PendingRequest>> &pending_requests,
+    KeyAccessTracker &key_access_tracker,
     map<Key, KeyProperty> &stored_key_map,
-    map<Key, KeyReplication> &key_replication_map, set<Key> &local_changeset,
-    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers) {
+    unsigned long long &storage_consumption,
+    map<Key, KeyReplication> &key_replication_map, KeyHandleSet &local_changeset,
+    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers,
+    AsyncDiskIO *disk_io, WriteAheadLog *wal, bool memory_pressure) {
   KeyRequest request;
   request.ParseFromString(serialized);
 
@@ -37,8 +39,14 @@ void user_request_handler(
 
   for (const auto &tuple : request.tuples()) {
     // first check if the thread is responsible for the key
-    Key key = tuple.key();
-    string payload = tuple.payload();
+    const Key &key = tuple.key();
+
+    // large values are compressed once, here, and stay compressed until they
+    // are read back
+    string payload = request_type == RequestType::PUT
+                         ? kValueCompressor.pack(tuple.lattice_type(),
+                                                 tuple.payload())
+                         : tuple.payload();
 
     ServerThreadList threads = kHashRingUtil->get_responsible_threads(
         wt.replication_response_connect_address(), key, is_metadata(key),
@@ -75,10 +83,15 @@ void user_request_handler(
               stored_key_map[key].type_ == LatticeType::NONE) {
 
             tp->set_error(AnnaError::KEY_DNE);
+          } else if (disk_io != nullptr) {
+            tp->set_lattice_type(stored_key_map[key].type_);
+            disk_io->get(key, stored_key_map[key].type_,
+                         response.tuples_size() - 1);
           } else {
             auto res = process_get(key, serializers[stored_key_map[key].type_]);
             tp->set_lattice_type(stored_key_map[key].type_);
-            tp->set_payload(res.first);
+            tp->set_payload(kValueCompressor.unpack(stored_key_map[key].type_,
+                                                    std::move(res.first)));
             tp->set_error(res.second);
           }
         } else if (request_type == RequestType::PUT) {
@@ -92,9 +105,23 @@ void user_request_handler(
                 "{}.",
                 key, LatticeType_Name(tuple.lattice_type()),
                 LatticeType_Name(stored_key_map[key].type_));
+          } else if (memory_pressure && !is_metadata(key)) {
+            // the node is over its memory budget, so the write is turned
+            // away until cold keys have been demoted; clients retry on a
+            // timeout
+            tp->set_lattice_type(tuple.lattice_type());
+            tp->set_error(AnnaError::TIMEOUT);
+          } else if (disk_io != nullptr) {
+            // record the type right away, so that later requests for this
+            // key find it; the size is filled in once the write completes
+            stored_key_map[key].type_ = tuple.lattice_type();
+            disk_io->put(key, tuple.lattice_type(), payload,
+                         response.tuples_size() - 1);
+            tp->set_lattice_type(tuple.lattice_type());
           } else {
             process_put(key, tuple.lattice_type(), payload,
-                        serializers[tuple.lattice_type()], stored_key_map);
+                        serializers[tuple.lattice_type()], stored_key_map,
+                        storage_consumption);
 
             local_changeset.insert(key);
             tp->set_lattice_type(tuple.lattice_type());
@@ -109,7 +136,7 @@ void user_request_handler(
           tp->set_invalidate(true);
         }
 
-        key_access_tracker[key].insert(std::chrono::system_clock::now());
+        key_access_tracker.record(key, std::chrono::system_clock::now());
         access_count += 1;
       }
     } else {
@@ -119,10 +146,20 @@ void user_request_handler(
     }
   }
 
+  // if any tuples went to disk, the response is sent once they complete
+  if (disk_io != nullptr && disk_io->defer(response, response_address)) {
+    return;
+  }
+
   if (response.tuples_size() > 0 && request.response_address() != "") {
     string serialized_response;
     response.SerializeToString(&serialized_response);
-    kZmqUtil->send_string(serialized_response,
-                          &pushers[request.response_address()]);
+
+    // with the write-ahead log on, a PUT is acknowledged once it is durable
+    if (wal == nullptr || request_type != RequestType::PUT ||
+        !wal->hold(request.response_address(), serialized_response)) {
+      kZmqUtil->send_string(serialized_response,
+                            &pushers[request.response_address()]);
+    }
   }
 }
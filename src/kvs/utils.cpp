@@ -16,7 +16,13 @@
 
 void send_gossip(AddressKeysetMap &addr_keyset_map, SocketCache &pushers,
                  SerializerMap &serializers,
-                 map<Key, KeyProperty> &stored_key_map) {
+                 map<Key, KeyProperty> &stored_key_map, AsyncDiskIO *disk_io,
+                 bool unpack) {
+  if (disk_io != nullptr) {
+    disk_io->gossip(addr_keyset_map, stored_key_map, unpack, pushers);
+    return;
+  }
+
   map<Address, KeyRequest> gossip_map;
 
   for (const auto &key_pair : addr_keyset_map) {
@@ -36,8 +42,14 @@ void send_gossip(AddressKeysetMap &addr_keyset_map, SocketCache &pushers,
 
       auto res = process_get(key, serializers[type]);
 
-      if (res.second == 0) {
-        prepare_put_tuple(gossip_map[address], key, type, res.first);
+      // LWW tombstones read as KEY_DNE, but are gossiped like any other value
+      // so that deletes reach every replica
+      if (res.second == 0 ||
+          (type == LatticeType::LWW && res.second == AnnaError::KEY_DNE &&
+           !res.first.empty())) {
+        prepare_put_tuple(gossip_map[address], key, type,
+                          unpack ? kValueCompressor.unpack(type, res.first)
+                                 : res.first);
       }
     }
   }
@@ -59,9 +71,146 @@ std::pair<string, AnnaError> process_get(const Key &key,
 
 void process_put(const Key &key, LatticeType lattice_type,
                  const string &payload, Serializer *serializer,
-                 map<Key, KeyProperty> &stored_key_map) {
-  stored_key_map[key].size_ = serializer->put(key, payload);
-  stored_key_map[key].type_ = std::move(lattice_type);
+                 map<Key, KeyProperty> &stored_key_map,
+                 unsigned long long &storage_consumption) {
+  KeyProperty &property = stored_key_map[key];
+  unsigned size = serializer->put(key, payload);
+
+  storage_consumption = storage_consumption - property.size_ + size;
+  property.size_ = size;
+  property.type_ = std::move(lattice_type);
+}
+
+void remove_key(const Key &key, SerializerMap &serializers,
+                map<Key, KeyProperty> &stored_key_map,
+                unsigned long long &storage_consumption) {
+  auto it = stored_key_map.find(key);
+  if (it == stored_key_map.end()) {
+    return;
+  }
+
+  serializers[it->second.type_]->remove(key);
+  storage_consumption -= it->second.size_;
+  stored_key_map.erase(it);
+}
+
+// Picks up to max_keys of the least recently accessed data keys, in order of
+// increasing access count, until their sizes add up to bytes; keys that are
+// already being demoted are skipped
+vector<Key>
+select_cold_keys(unsigned long long bytes, unsigned max_keys,
+                 map<Key, KeyProperty> &stored_key_map,
+                 KeyAccessTracker &key_access_tracker,
+                 const map<Key, SteadyTimePoint> &demotions) {
+  vector<std::pair<unsigned, Key>> candidates;
+
+  for (const auto &key_pair : stored_key_map) {
+    const Key &key = key_pair.first;
+
+    if (is_metadata(key) || key_pair.second.type_ == LatticeType::NONE ||
+        demotions.find(key) != demotions.end()) {
+      continue;
+    }
+
+    candidates.push_back(std::make_pair(key_access_tracker.count(key), key));
+  }
+
+  unsigned count = std::min((unsigned)candidates.size(), max_keys);
+  std::partial_sort(candidates.begin(), candidates.begin() + count,
+                    candidates.end());
+
+  vector<Key> keys;
+  unsigned long long selected_bytes = 0;
+
+  for (unsigned i = 0; i < count && selected_bytes < bytes; i++) {
+    const Key &key = candidates[i].second;
+
+    keys.push_back(key);
+    selected_bytes += stored_key_map[key].size_;
+  }
+
+  return keys;
+}
+
+// Moves keys out of the memory tier through the same replication factor
+// change the monitor uses for demotion: the new factors are stored in the
+// replication metadata, and every thread that holds the keys now or will
+// hold them afterwards (including this one) is told, as are the routing
+// nodes. The memory threads then gossip the keys to the disk tier and drop
+// them.
+void demote_keys(const vector<Key> &keys, GlobalRingMap &global_hash_rings,
+                 LocalRingMap &local_hash_rings,
+                 map<Key, KeyReplication> &key_replication_map,
+                 vector<Address> &routing_ips, SocketCache &pushers,
+                 unsigned &rid) {
+  map<Address, KeyRequest> addr_request_map;
+  map<Address, ReplicationFactorUpdate> replication_factor_map;
+
+  for (const Key &key : keys) {
+    if (key_replication_map.find(key) == key_replication_map.end()) {
+      continue;
+    }
+
+    KeyReplication &current = key_replication_map[key];
+    hmap<Tier, unsigned, TierEnumHash> global_replication =
+        current.global_replication_;
+    global_replication[Tier::MEMORY] = 0;
+    global_replication[Tier::DISK] =
+        std::max(current.global_replication_[Tier::DISK], (unsigned)1);
+
+    ReplicationFactor rep_data;
+    rep_data.set_key(key);
+
+    for (const auto &pair : global_replication) {
+      ReplicationFactor_ReplicationValue *global = rep_data.add_global();
+      global->set_tier(pair.first);
+      global->set_value(pair.second);
+    }
+
+    for (const auto &pair : current.local_replication_) {
+      ReplicationFactor_ReplicationValue *local = rep_data.add_local();
+      local->set_tier(pair.first);
+      local->set_value(pair.second);
+    }
+
+    string serialized_rep_data;
+    rep_data.SerializeToString(&serialized_rep_data);
+    prepare_metadata_put_request(
+        get_metadata_key(key, MetadataType::replication), serialized_rep_data,
+        global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY],
+        addr_request_map, "", rid);
+
+    for (const Tier &tier : kAllTiers) {
+      unsigned rep = std::max(current.global_replication_[tier],
+                              global_replication[tier]);
+
+      for (const ServerThread &thread :
+           responsible_global(key, rep, global_hash_rings[tier])) {
+        replication_factor_map[thread.replication_change_connect_address()]
+            .add_updates()
+            ->CopyFrom(rep_data);
+      }
+    }
+
+    for (const Address &address : routing_ips) {
+      replication_factor_map[RoutingThread(address, 0)
+                                 .replication_change_connect_address()]
+          .add_updates()
+          ->CopyFrom(rep_data);
+    }
+  }
+
+  for (const auto &request_pair : addr_request_map) {
+    string serialized;
+    request_pair.second.SerializeToString(&serialized);
+    kZmqUtil->send_string(serialized, &pushers[request_pair.first]);
+  }
+
+  for (const auto &update_pair : replication_factor_map) {
+    string serialized;
+    update_pair.second.SerializeToString(&serialized);
+    kZmqUtil->send_string(serialized, &pushers[update_pair.first]);
+  }
 }
 
 bool is_primary_replica(const Key &key,
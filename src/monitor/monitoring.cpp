@@ -12,9 +12,11 @@
 //  See the License for the specific language governing permissions and
 //  limitations under the License.
 
+#include "adaptive_poller.hpp"
 #include "monitor/monitoring_handlers.hpp"
 #include "monitor/monitoring_utils.hpp"
 #include "monitor/policies.hpp"
+#include "periodic_timers.hpp"
 #include "yaml-cpp/yaml.h"
 
 unsigned kMemoryThreadCount;
@@ -28,6 +30,10 @@ unsigned kDefaultGlobalEbsReplication;
 unsigned kDefaultLocalReplication;
 unsigned kMinimumReplicaNumber;
 
+// how long (in microseconds) the event loop keeps polling without blocking
+// after its last event; a negative value never blocks
+int kPollSpin;
+
 bool kEnableElasticity;
 bool kEnableTiering;
 bool kEnableSelectiveRep;
@@ -79,6 +85,9 @@ int main(int argc, char *argv[]) {
   kDefaultLocalReplication = replication["local"].as<unsigned>();
   kMinimumReplicaNumber = replication["minimum"].as<unsigned>();
 
+  YAML::Node polling = conf["polling"];
+  kPollSpin = polling["spin"].as<int>(-1);
+
   kTierMetadata[Tier::MEMORY] =
       TierMetadata(Tier::MEMORY, kMemoryThreadCount,
                    kDefaultGlobalMemoryReplication, kMemoryNodeCapacity);
@@ -164,9 +173,6 @@ int main(int argc, char *argv[]) {
       {static_cast<void *>(depart_done_puller), 0, ZMQ_POLLIN, 0},
       {static_cast<void *>(feedback_puller), 0, ZMQ_POLLIN, 0}};
 
-  auto report_start = std::chrono::system_clock::now();
-  auto report_end = std::chrono::system_clock::now();
-
   auto grace_start = std::chrono::system_clock::now();
 
   unsigned new_memory_count = 0;
@@ -178,8 +184,87 @@ int main(int argc, char *argv[]) {
 
   unsigned rid = 0;
 
+  AdaptivePoller poller(kPollSpin);
+  SteadyTimePoint report_start = poller.now();
+
+  auto report = [&](const SteadyTimePoint &now) {
+    server_monitoring_epoch += 1;
+
+    // the share of the period the monitor slept instead of spinning
+    double blocked = (double)poller.blocked_time() /
+                     std::chrono::duration_cast<std::chrono::microseconds>(
+                         now - report_start)
+                         .count();
+    log->info("Blocked in poll for {} of the report period.",
+              std::to_string(blocked));
+    poller.reset_counters();
+
+    memory_node_count =
+        global_hash_rings[Tier::MEMORY].size() / kVirtualThreadNum;
+    ebs_node_count = global_hash_rings[Tier::DISK].size() / kVirtualThreadNum;
+
+    key_access_frequency.clear();
+    key_access_summary.clear();
+
+    memory_storage.clear();
+    ebs_storage.clear();
+
+    memory_occupancy.clear();
+    ebs_occupancy.clear();
+
+    ss.clear();
+
+    user_latency.clear();
+    user_throughput.clear();
+    latency_miss_ratio_map.clear();
+
+    collect_internal_stats(
+        global_hash_rings, local_hash_rings, pushers, mt, response_puller,
+        log, rid, key_access_frequency, key_size, memory_storage, ebs_storage,
+        memory_occupancy, ebs_occupancy, memory_accesses, ebs_accesses);
+
+    compute_summary_stats(key_access_frequency, memory_storage, ebs_storage,
+                          memory_occupancy, ebs_occupancy, memory_accesses,
+                          ebs_accesses, key_access_summary, ss, log,
+                          server_monitoring_epoch);
+
+    collect_external_stats(user_latency, user_throughput, ss, log);
+
+    // initialize replication factor for new keys
+    for (const auto &key_access_pair : key_access_summary) {
+      Key key = key_access_pair.first;
+      if (!is_metadata(key) &&
+          key_replication_map.find(key) == key_replication_map.end()) {
+        init_replication(key_replication_map, key);
+      }
+    }
+
+    storage_policy(log, global_hash_rings, grace_start, ss, memory_node_count,
+                   ebs_node_count, new_memory_count, new_ebs_count,
+                   removing_ebs_node, management_ip, mt, departing_node_map,
+                   pushers);
+
+    movement_policy(log, global_hash_rings, local_hash_rings, grace_start, ss,
+                    memory_node_count, ebs_node_count, new_memory_count,
+                    new_ebs_count, management_ip, key_replication_map,
+                    key_access_summary, key_size, mt, pushers,
+                    response_puller, routing_ips, rid);
+
+    slo_policy(log, global_hash_rings, local_hash_rings, grace_start, ss,
+               memory_node_count, new_memory_count, removing_memory_node,
+               management_ip, key_replication_map, key_access_summary, mt,
+               departing_node_map, pushers, response_puller, routing_ips, rid,
+               latency_miss_ratio_map);
+
+    report_start = now;
+  };
+
+  PeriodicTimers timers;
+  timers.add(std::chrono::seconds(kMonitoringThreshold), poller.now(), report);
+
   while (true) {
-    kZmqUtil->poll(0, &pollitems);
+    // when idle, block until the next report is due
+    poller.poll(&pollitems, timers.next_deadline());
 
     if (pollitems[0].revents & ZMQ_POLLIN) {
       string serialized = kZmqUtil->recv_string(&notify_puller);
@@ -202,71 +287,6 @@ int main(int argc, char *argv[]) {
                        latency_miss_ratio_map);
     }
 
-    report_end = std::chrono::system_clock::now();
-
-    if (std::chrono::duration_cast<std::chrono::seconds>(report_end -
-                                                         report_start)
-            .count() >= kMonitoringThreshold) {
-      server_monitoring_epoch += 1;
-
-      memory_node_count =
-          global_hash_rings[Tier::MEMORY].size() / kVirtualThreadNum;
-      ebs_node_count = global_hash_rings[Tier::DISK].size() / kVirtualThreadNum;
-
-      key_access_frequency.clear();
-      key_access_summary.clear();
-
-      memory_storage.clear();
-      ebs_storage.clear();
-
-      memory_occupancy.clear();
-      ebs_occupancy.clear();
-
-      ss.clear();
-
-      user_latency.clear();
-      user_throughput.clear();
-      latency_miss_ratio_map.clear();
-
-      collect_internal_stats(
-          global_hash_rings, local_hash_rings, pushers, mt, response_puller,
-          log, rid, key_access_frequency, key_size, memory_storage, ebs_storage,
-          memory_occupancy, ebs_occupancy, memory_accesses, ebs_accesses);
-
-      compute_summary_stats(key_access_frequency, memory_storage, ebs_storage,
-                            memory_occupancy, ebs_occupancy, memory_accesses,
-                            ebs_accesses, key_access_summary, ss, log,
-                            server_monitoring_epoch);
-
-      collect_external_stats(user_latency, user_throughput, ss, log);
-
-      // initialize replication factor for new keys
-      for (const auto &key_access_pair : key_access_summary) {
-        Key key = key_access_pair.first;
-        if (!is_metadata(key) &&
-            key_replication_map.find(key) == key_replication_map.end()) {
-          init_replication(key_replication_map, key);
-        }
-      }
-
-      storage_policy(log, global_hash_rings, grace_start, ss, memory_node_count,
-                     ebs_node_count, new_memory_count, new_ebs_count,
-                     removing_ebs_node, management_ip, mt, departing_node_map,
-                     pushers);
-
-      movement_policy(log, global_hash_rings, local_hash_rings, grace_start, ss,
-                      memory_node_count, ebs_node_count, new_memory_count,
-                      new_ebs_count, management_ip, key_replication_map,
-                      key_access_summary, key_size, mt, pushers,
-                      response_puller, routing_ips, rid);
-
-      slo_policy(log, global_hash_rings, local_hash_rings, grace_start, ss,
-                 memory_node_count, new_memory_count, removing_memory_node,
-                 management_ip, key_replication_map, key_access_summary, mt,
-                 departing_node_map, pushers, response_puller, routing_ips, rid,
-                 latency_miss_ratio_map);
-
-      report_start = std::chrono::system_clock::now();
-    }
+    timers.run_due(poller.now());
   }
 }
@@ -12,6 +12,9 @@
 //  See the License for the specific language governing permissions and
 //  limitations under the License.
 
+#include "adaptive_poller.hpp"
+#include "periodic_timers.hpp"
+#include "thread_affinity.hpp"
 #include "route/routing_handlers.hpp"
 #include "yaml-cpp/yaml.h"
 
@@ -22,6 +25,10 @@ unsigned kRoutingThreadCount;
 unsigned kMemoryNodeCapacity;
 unsigned kEbsNodeCapacity;
 
+// the CPUs routing threads are pinned to, by thread id; empty leaves threads
+// unpinned
+vector<unsigned> kRoutingCpus;
+
 ZmqUtil zmq_util;
 ZmqUtilInterface *kZmqUtil = &zmq_util;
 
@@ -29,11 +36,19 @@ HashRingUtil hash_ring_util;
 HashRingUtilInterface *kHashRingUtil = &hash_ring_util;
 
 void run(unsigned thread_id, Address ip, vector<Address> monitoring_ips) {
+  bool pinned = !kRoutingCpus.empty() &&
+                pin_thread(thread_cpu(kRoutingCpus, thread_id));
+
   string log_file = "log_" + std::to_string(thread_id) + ".txt";
   string log_name = "routing_log_" + std::to_string(thread_id);
   auto log = spdlog::basic_logger_mt(log_name, log_file, true);
   log->flush_on(spdlog::level::info);
 
+  if (pinned) {
+    unsigned cpu = thread_cpu(kRoutingCpus, thread_id);
+    log->info("Pinned to CPU {} on NUMA node {}.", cpu, cpu_numa_node(cpu));
+  }
+
   RoutingThread rt = RoutingThread(ip, thread_id);
 
   unsigned seed = time(NULL);
@@ -99,15 +114,44 @@ void run(unsigned thread_id, Address ip, vector<Address> monitoring_ips) {
   zmq::socket_t key_address_puller(context, ZMQ_PULL);
   key_address_puller.bind(rt.key_address_bind_address());
 
+  // responsible for handling key range scans from users
+  zmq::socket_t scan_puller(context, ZMQ_PULL);
+  scan_puller.bind(rt.scan_bind_address());
+
+  // responsible for collecting the storage threads' answers to scans
+  zmq::socket_t scan_response_puller(context, ZMQ_PULL);
+  scan_response_puller.bind(rt.scan_response_bind_address());
+
+  // scans waiting for storage threads to answer, by the ID they were sent
+  // under
+  map<string, PendingScan> pending_scans;
+  unsigned scan_id = 0;
+
   vector<zmq::pollitem_t> pollitems = {
       {static_cast<void *>(addr_responder), 0, ZMQ_POLLIN, 0},
       {static_cast<void *>(notify_puller), 0, ZMQ_POLLIN, 0},
       {static_cast<void *>(replication_response_puller), 0, ZMQ_POLLIN, 0},
       {static_cast<void *>(replication_change_puller), 0, ZMQ_POLLIN, 0},
-      {static_cast<void *>(key_address_puller), 0, ZMQ_POLLIN, 0}};
+      {static_cast<void *>(key_address_puller), 0, ZMQ_POLLIN, 0},
+      {static_cast<void *>(scan_puller), 0, ZMQ_POLLIN, 0},
+      {static_cast<void *>(scan_response_puller), 0, ZMQ_POLLIN, 0}};
+
+  // routing threads block as soon as they are idle
+  AdaptivePoller poller(0);
+
+  // answer the scans that have timed out
+  auto expire = [&](const SteadyTimePoint &) {
+    expire_scans(log, pushers, pending_scans);
+  };
+
+  PeriodicTimers timers;
+  timers.add(std::chrono::milliseconds(kScanExpiryPeriod), poller.now(),
+             expire);
 
   while (true) {
-    kZmqUtil->poll(-1, &pollitems);
+    // wake up in time to answer scans that time out
+    poller.poll(&pollitems, pending_scans.empty() ? SteadyTimePoint::max()
+                                                  : timers.next_deadline());
 
     // only relavant for the seed node
     if (pollitems[0].revents & ZMQ_POLLIN) {
@@ -143,6 +187,19 @@ void run(unsigned thread_id, Address ip, vector<Address> monitoring_ips) {
                       local_hash_rings, key_replication_map, pending_requests,
                       seed);
     }
+
+    if (pollitems[5].revents & ZMQ_POLLIN) {
+      string serialized = kZmqUtil->recv_string(&scan_puller);
+      scan_handler(log, serialized, pushers, rt, global_hash_rings,
+                   pending_scans, scan_id);
+    }
+
+    if (pollitems[6].revents & ZMQ_POLLIN) {
+      string serialized = kZmqUtil->recv_string(&scan_response_puller);
+      scan_response_handler(serialized, pushers, pending_scans);
+    }
+
+    timers.run_due(poller.now());
   }
 }
 
@@ -168,6 +225,14 @@ int main(int argc, char *argv[]) {
   unsigned kDefaultGlobalEbsReplication = replication["ebs"].as<unsigned>();
   kDefaultLocalReplication = replication["local"].as<unsigned>();
 
+  YAML::Node affinity = conf["affinity"];
+  if (affinity && affinity["routing"] &&
+      !parse_cpu_list(affinity["routing"].as<string>(), kRoutingCpus)) {
+    std::cerr << "Invalid CPU list " << affinity["routing"].as<string>()
+              << " for routing threads." << std::endl;
+    return 1;
+  }
+
   YAML::Node routing = conf["routing"];
   Address ip = routing["ip"].as<string>();
   vector<Address> monitoring_ips;
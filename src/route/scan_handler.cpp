@@ -0,0 +1,133 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "route/routing_handlers.hpp"
+
+// Sends the client the first keys of the merged answers. Since every storage
+// thread returned its first keys after the same point, these are the first
+// keys of the whole range.
+void finish_scan(const PendingScan &scan, SocketCache &pushers,
+                 bool incomplete) {
+  ScanResponse response;
+  response.set_request_id(scan.request_id_);
+  response.set_incomplete(incomplete);
+
+  for (const Key &key : scan.keys_) {
+    if ((unsigned)response.keys_size() == scan.limit_) {
+      break;
+    }
+
+    response.add_keys(key);
+  }
+
+  if (response.keys_size() > 0 &&
+      (scan.truncated_ || scan.keys_.size() > scan.limit_)) {
+    response.set_continuation(response.keys(response.keys_size() - 1));
+  }
+
+  string serialized;
+  response.SerializeToString(&serialized);
+  kZmqUtil->send_string(serialized, &pushers[scan.response_address_]);
+}
+
+// Keys are spread over the storage threads by hash, so any of them may hold
+// keys in the range; the scan is sent to every thread of every storage tier.
+void scan_handler(logger log, string &serialized, SocketCache &pushers,
+                  RoutingThread &rt, GlobalRingMap &global_hash_rings,
+                  map<string, PendingScan> &pending_scans, unsigned &scan_id) {
+  ScanRequest request;
+  request.ParseFromString(serialized);
+
+  PendingScan scan;
+  scan.response_address_ = request.response_address();
+  scan.request_id_ = request.request_id();
+  scan.limit_ = request.limit() == 0
+                    ? kDefaultScanLimit
+                    : std::min(request.limit(), kMaxScanLimit);
+  scan.outstanding_ = 0;
+  scan.truncated_ = false;
+  scan.deadline_ = std::chrono::steady_clock::now() +
+                   std::chrono::milliseconds(kScanTimeout);
+
+  // the storage threads answer to this routing thread, under an ID of its own
+  string id = rt.ip() + ":" + std::to_string(rt.tid()) + "_" +
+              std::to_string(scan_id++);
+
+  request.set_request_id(id);
+  request.set_response_address(rt.scan_response_connect_address());
+  request.set_limit(scan.limit_);
+
+  string serialized_request;
+  request.SerializeToString(&serialized_request);
+
+  for (const Tier &tier : kAllTiers) {
+    unsigned thread_count = kTierMetadata[tier].thread_number_;
+
+    for (const ServerThread &server :
+         global_hash_rings[tier].get_unique_servers()) {
+      for (unsigned tid = 0; tid < thread_count; tid++) {
+        ServerThread thread(server.public_ip(), server.private_ip(), tid);
+        kZmqUtil->send_string(serialized_request,
+                              &pushers[thread.scan_request_connect_address()]);
+        scan.outstanding_ += 1;
+      }
+    }
+  }
+
+  if (scan.outstanding_ == 0) {
+    log->error("No storage threads to scan.");
+    finish_scan(scan, pushers, false);
+  } else {
+    pending_scans[id] = std::move(scan);
+  }
+}
+
+void scan_response_handler(string &serialized, SocketCache &pushers,
+                           map<string, PendingScan> &pending_scans) {
+  ScanResponse response;
+  response.ParseFromString(serialized);
+
+  // the scan may have timed out already
+  auto it = pending_scans.find(response.request_id());
+  if (it == pending_scans.end()) {
+    return;
+  }
+
+  PendingScan &scan = it->second;
+  scan.keys_.insert(response.keys().begin(), response.keys().end());
+  scan.truncated_ |= !response.continuation().empty();
+  scan.outstanding_ -= 1;
+
+  if (scan.outstanding_ == 0) {
+    finish_scan(scan, pushers, false);
+    pending_scans.erase(it);
+  }
+}
+
+// answers the scans that have waited too long with the keys they have
+void expire_scans(logger log, SocketCache &pushers,
+                  map<string, PendingScan> &pending_scans) {
+  auto now = std::chrono::steady_clock::now();
+
+  for (auto it = pending_scans.begin(); it != pending_scans.end();) {
+    if (it->second.deadline_ <= now) {
+      log->error("Scan {} timed out waiting for {} storage threads.",
+                 it->first, it->second.outstanding_);
+      finish_scan(it->second, pushers, true);
+      it = pending_scans.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
@@ -24,10 +24,25 @@
 #include "types.hpp"
 
 #include "server_handler_base.hpp"
+#include "test_file_store.hpp"
+#include "test_flat_kv_store.hpp"
+#include "test_key_access_tracker.hpp"
+#include "test_key_expiry.hpp"
+#include "test_key_interner.hpp"
+#include "test_log_store.hpp"
 #include "test_node_depart_handler.hpp"
 #include "test_node_join_handler.hpp"
+#include "test_packed_set_lattice.hpp"
+#include "test_periodic_timers.hpp"
+#include "test_scan_handler.hpp"
 #include "test_self_depart_handler.hpp"
+#include "test_thread_affinity.hpp"
 #include "test_user_request_handler.hpp"
+#include "test_value_cache.hpp"
+#include "test_value_compression.hpp"
+#include "test_vector_clock.hpp"
+#include "test_wire_merge.hpp"
+#include "test_write_ahead_log.hpp"
 
 unsigned kDefaultLocalReplication = 1;
 Tier kSelfTier = Tier::MEMORY;
@@ -35,6 +50,7 @@ unsigned kThreadNum = 1;
 
 vector<Tier> kSelfTierIdVector = {kSelfTier};
 hmap<Tier, TierMetadata, TierEnumHash> kTierMetadata = {};
+ValueCompressor kValueCompressor;
 
 unsigned kEbsThreadNum = 1;
 unsigned kMemoryThreadNum = 1;
@@ -12,6 +12,8 @@
 //  See the License for the specific language governing permissions and
 //  limitations under the License.
 
+#include "kvs/key_access_tracker.hpp"
+#include "kvs/key_interner.hpp"
 #include "mock/mock_hash_utils.hpp"
 #include "mock_zmq_utils.hpp"
 
@@ -32,12 +34,14 @@ protected:
   GlobalRingMap global_hash_rings;
   LocalRingMap local_hash_rings;
   map<Key, KeyProperty> stored_key_map;
+  unsigned long long storage_consumption = 0;
   map<Key, KeyReplication> key_replication_map;
   ServerThread wt;
-  map<Key, vector<PendingRequest>> pending_requests;
-  map<Key, vector<PendingGossip>> pending_gossip;
-  map<Key, std::multiset<TimePoint>> key_access_tracker;
-  set<Key> local_changeset;
+  KeyInterner key_interner;
+  KeyHandleMap<vector<PendingRequest>> pending_requests{&key_interner};
+  KeyHandleMap<vector<PendingGossip>> pending_gossip{&key_interner};
+  KeyAccessTracker key_access_tracker;
+  KeyHandleSet local_changeset{&key_interner};
 
   zmq::context_t context;
   SocketCache pushers = SocketCache(&context, ZMQ_PUSH);
@@ -0,0 +1,225 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <ftw.h>
+
+#include "kvs/file_store.hpp"
+
+TEST(CountingBloomFilterTest, InsertAndRemove) {
+  CountingBloomFilter filter(1000);
+
+  for (unsigned i = 0; i < 1000; i++) {
+    filter.insert(std::to_string(i));
+  }
+
+  for (unsigned i = 0; i < 1000; i++) {
+    EXPECT_TRUE(filter.may_contain(std::to_string(i)));
+  }
+
+  for (unsigned i = 0; i < 1000; i += 2) {
+    filter.remove(std::to_string(i));
+  }
+
+  // removing keys must never hide the keys that remain
+  for (unsigned i = 1; i < 1000; i += 2) {
+    EXPECT_TRUE(filter.may_contain(std::to_string(i)));
+  }
+
+  unsigned false_positives = 0;
+  for (unsigned i = 1000; i < 11000; i++) {
+    if (filter.may_contain(std::to_string(i))) {
+      false_positives += 1;
+    }
+  }
+
+  EXPECT_LT(false_positives, 500);
+  EXPECT_EQ(filter.size(), 500);
+}
+
+class FileStoreTest : public ::testing::Test {
+protected:
+  string root;
+  FileStore *store;
+
+  FileStoreTest() {
+    char dir[] = "/tmp/anna_file_store_XXXXXX";
+    root = string(mkdtemp(dir)) + "/";
+    store = new FileStore(root);
+  }
+
+  virtual ~FileStoreTest() {
+    delete store;
+
+    // the store's files sit two directories below the root
+    nftw(root.c_str(),
+         [](const char *path, const struct stat *, int, struct FTW *) {
+           return std::remove(path);
+         },
+         16, FTW_DEPTH | FTW_PHYS);
+  }
+};
+
+TEST_F(FileStoreTest, FilterSurvivesRestart) {
+  // enough keys to force the filter to be resized at least once
+  for (unsigned i = 0; i < 3000; i++) {
+    store->put(std::to_string(i), "value" + std::to_string(i));
+  }
+
+  store->put("0", "overwritten");
+  store->remove("1");
+
+  delete store;
+  store = new FileStore(root);
+
+  string value;
+  EXPECT_TRUE(store->get("0", value));
+  EXPECT_EQ(value, "overwritten");
+  EXPECT_FALSE(store->get("1", value));
+
+  for (unsigned i = 2; i < 3000; i++) {
+    EXPECT_TRUE(store->get(std::to_string(i), value));
+  }
+
+  EXPECT_FALSE(store->get("missing", value));
+}
+
+TEST_F(FileStoreTest, MigratesFlatLayout) {
+  delete store;
+
+  // files written by the flat layout, directly in the root
+  for (unsigned i = 0; i < 100; i++) {
+    std::ofstream(root + std::to_string(i)) << "value" << i;
+  }
+
+  EXPECT_EQ(FileStore::migrate(root), 100);
+  EXPECT_EQ(FileStore::migrate(root), 0);
+
+  store = new FileStore(root);
+
+  string value;
+  for (unsigned i = 0; i < 100; i++) {
+    EXPECT_TRUE(store->get(std::to_string(i), value));
+    EXPECT_EQ(value, "value" + std::to_string(i));
+
+    // a shard may share the name, but no file is left in the root
+    struct stat st;
+    if (stat((root + std::to_string(i)).c_str(), &st) == 0) {
+      EXPECT_TRUE(S_ISDIR(st.st_mode));
+    }
+  }
+}
+
+TEST_F(FileStoreTest, DescriptorCacheEviction) {
+  delete store;
+  store = new FileStore(root, 4);
+
+  // more keys than cached descriptors, so reads and writes go through both
+  // evicted and cached descriptors
+  for (unsigned i = 0; i < 20; i++) {
+    store->put(std::to_string(i), string(100, 'a'));
+  }
+
+  // shorter values must not leave the tail of the old one behind
+  for (unsigned i = 0; i < 20; i++) {
+    store->put(std::to_string(i), "v" + std::to_string(i));
+  }
+
+  store->remove("3");
+
+  string value;
+  for (unsigned i = 0; i < 20; i++) {
+    if (i == 3) {
+      EXPECT_FALSE(store->get(std::to_string(i), value));
+    } else {
+      EXPECT_TRUE(store->get(std::to_string(i), value));
+      EXPECT_EQ(value, "v" + std::to_string(i));
+    }
+  }
+
+  store->put("3", "back");
+  EXPECT_TRUE(store->get("3", value));
+  EXPECT_EQ(value, "back");
+}
+
+TEST_F(FileStoreTest, SetPutsAppendDeltas) {
+  DiskSetSerializer serializer(store);
+  Key key = "set";
+
+  // a value written before deltas existed: a bare SetValue
+  SetValue legacy;
+  for (unsigned i = 0; i < 1000; i++) {
+    legacy.add_values("element" + std::to_string(i));
+  }
+
+  string serialized;
+  legacy.SerializeToString(&serialized);
+  store->put(key, serialized);
+
+  auto put = [&serializer, &key](const string &element) {
+    SetValue value;
+    value.add_values(element);
+
+    string serialized;
+    value.SerializeToString(&serialized);
+    return serializer.put(key, serialized);
+  };
+
+  // the first put rewrites the value as a base; later ones only append
+  unsigned base = put("new0");
+  unsigned size = base;
+
+  for (unsigned i = 1; i < 10; i++) {
+    unsigned next = put("new" + std::to_string(i));
+    EXPECT_LT(next - size, 16);
+    size = next;
+  }
+
+  AnnaError error = AnnaError::NO_ERROR;
+  SetLattice<string> value = deserialize_set(serializer.get(key, error));
+  EXPECT_EQ(error, AnnaError::NO_ERROR);
+  EXPECT_EQ(value.size().reveal(), 1010);
+  EXPECT_TRUE(value.contains("element999").reveal());
+  EXPECT_TRUE(value.contains("new9").reveal());
+
+  // duplicate elements only grow the deltas, which are folded away each
+  // time they pass the ratio, so the value stays bounded (the base has also
+  // gained the nine new elements since it was first written)
+  for (unsigned i = 0; i < 2000; i++) {
+    size = put("element" + std::to_string(i % 1000));
+    EXPECT_LE(size, (base + 100) * (1 + kSetDeltaRatio));
+  }
+
+  value = deserialize_set(serializer.get(key, error));
+  EXPECT_EQ(value.size().reveal(), 1010);
+}
+
+TEST_F(FileStoreTest, MalformedPutsKeepStoredValue) {
+  DiskLWWSerializer serializer(store);
+  Key key = "key";
+  string stored = serialize(5, "value");
+  EXPECT_EQ(serializer.put(key, stored), stored.size());
+
+  // a truncated payload whose timestamp would win the merge
+  string newer = serialize(9, "newer");
+  EXPECT_EQ(serializer.put(key, newer.substr(0, newer.size() - 1)),
+            stored.size());
+
+  AnnaError error = AnnaError::NO_ERROR;
+  EXPECT_EQ(serializer.get(key, error), stored);
+
+  // a malformed put of a new key stores nothing
+  string missing;
+  EXPECT_EQ(serializer.put("other", newer.substr(0, newer.size() - 1)), 0);
+  EXPECT_FALSE(store->get("other", missing));
+}
@@ -0,0 +1,142 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/flat_kv_store.hpp"
+
+class FlatKVStoreTest : public ::testing::Test {
+protected:
+  FlatLWWKVS *kvs;
+
+  FlatKVStoreTest() { kvs = new FlatLWWKVS(); }
+  virtual ~FlatKVStoreTest() { delete kvs; }
+
+  LWWPairLattice<string> lww(unsigned long long ts, string value) {
+    return LWWPairLattice<string>(TimestampValuePair<string>(ts, value));
+  }
+};
+
+TEST_F(FlatKVStoreTest, GetMissingKey) {
+  AnnaError error = AnnaError::NO_ERROR;
+  kvs->get("key", error);
+
+  EXPECT_EQ(error, AnnaError::KEY_DNE);
+  EXPECT_EQ(kvs->size("key"), 0);
+  EXPECT_EQ(kvs->key_count(), 0);
+}
+
+TEST_F(FlatKVStoreTest, PutMerges) {
+  AnnaError error = AnnaError::NO_ERROR;
+  kvs->put("key", lww(1, "value1"));
+  kvs->put("key", lww(0, "value0"));
+
+  EXPECT_EQ(kvs->get("key", error).reveal().value, "value1");
+  EXPECT_EQ(error, AnnaError::NO_ERROR);
+
+  kvs->put("key", lww(2, "value2"));
+  EXPECT_EQ(kvs->get("key", error).reveal().value, "value2");
+  EXPECT_EQ(kvs->key_count(), 1);
+}
+
+TEST_F(FlatKVStoreTest, GrowAndRemove) {
+  const unsigned num_keys = 10000;
+  for (unsigned i = 0; i < num_keys; i++) {
+    kvs->put(std::to_string(i), lww(i, "value" + std::to_string(i)));
+  }
+
+  EXPECT_EQ(kvs->key_count(), num_keys);
+
+  for (unsigned i = 0; i < num_keys; i += 2) {
+    kvs->remove(std::to_string(i));
+  }
+
+  EXPECT_EQ(kvs->key_count(), num_keys / 2);
+
+  for (unsigned i = 0; i < num_keys; i++) {
+    AnnaError error = AnnaError::NO_ERROR;
+    auto val = kvs->get(std::to_string(i), error);
+
+    if (i % 2 == 0) {
+      EXPECT_EQ(error, AnnaError::KEY_DNE);
+    } else {
+      EXPECT_EQ(error, AnnaError::NO_ERROR);
+      EXPECT_EQ(val.reveal().value, "value" + std::to_string(i));
+    }
+  }
+}
+
+TEST_F(FlatKVStoreTest, ReuseAfterChurn) {
+  // repeatedly inserting and removing keys should recycle tombstones and
+  // pooled entries instead of growing without bound
+  for (unsigned round = 0; round < 100; round++) {
+    for (unsigned i = 0; i < 100; i++) {
+      kvs->put(std::to_string(round * 100 + i), lww(round, "value"));
+    }
+
+    for (unsigned i = 0; i < 100; i++) {
+      kvs->remove(std::to_string(round * 100 + i));
+    }
+  }
+
+  EXPECT_EQ(kvs->key_count(), 0);
+  EXPECT_LT(kvs->bytes_reserved(), 2 * kDefaultArenaChunkSize);
+}
+
+TEST_F(FlatKVStoreTest, SerializedFormFollowsMerges) {
+  FlatLWWSerializer serializer(kvs);
+  AnnaError error = AnnaError::NO_ERROR;
+
+  serializer.put("key", serialize(lww(1, "value1")));
+  EXPECT_EQ(kvs->serialized("key"), nullptr);
+
+  string first = serializer.get("key", error);
+  ASSERT_NE(kvs->serialized("key"), nullptr);
+  EXPECT_EQ(*kvs->serialized("key"), first);
+  EXPECT_EQ(serializer.get("key", error), first);
+
+  // a merge that changes the value must not be answered from the cache
+  serializer.put("key", serialize(lww(2, "value2")));
+  EXPECT_EQ(kvs->serialized("key"), nullptr);
+  EXPECT_EQ(serializer.get("key", error), serialize(lww(2, "value2")));
+  EXPECT_EQ(error, AnnaError::NO_ERROR);
+
+  // reads of missing keys are not cached
+  serializer.get("missing", error);
+  EXPECT_EQ(error, AnnaError::KEY_DNE);
+  EXPECT_EQ(kvs->serialized("missing"), nullptr);
+}
+
+TEST_F(FlatKVStoreTest, SerializedFormIsCounted) {
+  string value(1000, 'a');
+  AnnaError error = AnnaError::NO_ERROR;
+
+  // both stores keep the encoding in the value's entry, and count its buffer
+  // once a put reports the key's size
+  FlatLWWSerializer flat_serializer(kvs);
+  unsigned flat_size = flat_serializer.put("key", serialize(lww(1, value)));
+  flat_serializer.get("key", error);
+  EXPECT_GT(flat_serializer.put("key", serialize(lww(1, value))),
+            flat_size + value.size() - 1);
+
+  MemoryLWWKVS *map_kvs = new MemoryLWWKVS();
+  MemoryLWWSerializer map_serializer(map_kvs);
+  unsigned map_size = map_serializer.put("key", serialize(lww(1, value)));
+  map_serializer.get("key", error);
+  EXPECT_GT(map_serializer.put("key", serialize(lww(1, value))),
+            map_size + value.size() - 1);
+
+  map_serializer.remove("key");
+  EXPECT_EQ(map_kvs->serialized("key"), nullptr);
+  EXPECT_EQ(map_kvs->bytes("key"), 0);
+  delete map_kvs;
+}
@@ -0,0 +1,75 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/key_access_tracker.hpp"
+#include "kvs/kvs_handlers.hpp"
+
+TEST(KeyAccessTrackerTest, ExpiresStaleAccesses) {
+  KeyAccessTracker tracker;
+  map<Key, KeyProperty> stored_key_map;
+  stored_key_map["a"].type_ = LatticeType::LWW;
+  stored_key_map["b"].type_ = LatticeType::LWW;
+  TimePoint now = std::chrono::system_clock::now();
+
+  tracker.record("a", now - std::chrono::seconds(90));
+  tracker.record("a", now - std::chrono::seconds(30));
+  tracker.record("b", now - std::chrono::seconds(90));
+  EXPECT_EQ(tracker.count("a"), 2);
+
+  tracker.expire(now - std::chrono::seconds(60), stored_key_map);
+  EXPECT_EQ(tracker.count("a"), 1);
+  EXPECT_EQ(tracker.count("b"), 0);
+  EXPECT_EQ(tracker.count("c"), 0);
+
+  // b has no recent accesses left, so it is no longer tracked
+  EXPECT_EQ(tracker.size(), 1);
+}
+
+TEST(KeyAccessTrackerTest, ForgetsKeysThatAreNotStored) {
+  KeyAccessTracker tracker;
+  map<Key, KeyProperty> stored_key_map;
+  stored_key_map["a"].type_ = LatticeType::LWW;
+  TimePoint now = std::chrono::system_clock::now();
+
+  // reads of a key that does not exist, and a key removed since its access
+  tracker.record("missing", now);
+  tracker.record("a", now);
+  stored_key_map.erase("a");
+
+  tracker.expire(now - std::chrono::seconds(60), stored_key_map);
+  EXPECT_EQ(tracker.size(), 0);
+}
+
+TEST(KeyAccessTrackerTest, ColdKeysSkipDemotionsInFlight) {
+  KeyAccessTracker tracker;
+  map<Key, KeyProperty> stored_key_map;
+  TimePoint now = std::chrono::system_clock::now();
+
+  for (const Key &key : {"a", "b", "c"}) {
+    stored_key_map[key].type_ = LatticeType::LWW;
+    stored_key_map[key].size_ = 100;
+  }
+
+  tracker.record("c", now);
+
+  map<Key, SteadyTimePoint> demotions;
+  vector<Key> keys =
+      select_cold_keys(150, 10, stored_key_map, tracker, demotions);
+  EXPECT_EQ(keys, vector<Key>({"a", "b"}));
+
+  // a key already on its way out is not picked again; the next coldest is
+  demotions["a"] = std::chrono::steady_clock::now();
+  keys = select_cold_keys(150, 10, stored_key_map, tracker, demotions);
+  EXPECT_EQ(keys, vector<Key>({"b", "c"}));
+}
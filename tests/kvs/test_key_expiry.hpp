@@ -0,0 +1,117 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/key_expiry.hpp"
+#include "kvs/kvs_handlers.hpp"
+
+TEST(KeyExpiryTest, WheelFiresOnDeadline) {
+  TimingWheel<unsigned> wheel(5);
+  unsigned seed = 0;
+
+  // deadlines on every level, and past the top level's span
+  vector<uint64_t> deadlines;
+  for (unsigned i = 0; i < 2000; i++) {
+    deadlines.push_back(5 + rand_r(&seed) % (1 << (6 * (i % 4 + 1))));
+  }
+  deadlines.push_back(5 + (1ULL << 24) + 7);
+
+  for (unsigned i = 0; i < deadlines.size(); i++) {
+    wheel.schedule(i, deadlines[i]);
+  }
+
+  unsigned fired = 0;
+  for (uint64_t tick = 6; fired < deadlines.size(); tick++) {
+    vector<unsigned> due;
+    wheel.advance(tick, due);
+
+    for (unsigned i : due) {
+      EXPECT_EQ(std::max(deadlines[i], (uint64_t)6), tick);
+    }
+
+    fired += due.size();
+    ASSERT_LE(tick, 6 + (1ULL << 24) + 7);
+  }
+}
+
+TEST(KeyExpiryTest, ExpiresByPrefix) {
+  KeyExpiry expiry({{"session/", 10}, {"session/long/", 100}});
+  auto now = std::chrono::steady_clock::now();
+  vector<Key> expired;
+
+  expiry.touch("session/a", now);
+  expiry.touch("session/b", now);
+  expiry.touch("session/long/c", now);
+  expiry.touch("other", now);
+  EXPECT_EQ(expiry.size(), 3);
+
+  expiry.expire(now + std::chrono::seconds(5), expired);
+  EXPECT_EQ(expired.size(), 0);
+
+  // a put restarts the TTL, and a remove cancels it
+  expiry.touch("session/a", now + std::chrono::seconds(5));
+  expiry.forget("session/long/c");
+
+  expiry.expire(now + std::chrono::seconds(11), expired);
+  EXPECT_EQ(expired, vector<Key>({"session/b"}));
+
+  expired.clear();
+  expiry.expire(now + std::chrono::seconds(200), expired);
+  EXPECT_EQ(expired, vector<Key>({"session/a"}));
+  EXPECT_EQ(expiry.size(), 0);
+}
+
+TEST(KeyExpiryTest, ReclaimsTombstones) {
+  MemoryLWWKVS kvs;
+  KeyExpiry tombstones({{"", 60}});
+  TombstoneSerializer serializer(new MemoryLWWSerializer(&kvs), &tombstones);
+  vector<Key> collected;
+
+  serializer.put("deleted", serialize(1, string("value")));
+  EXPECT_FALSE(tombstones.pending("deleted"));
+
+  // neither a stale tombstone nor a stale write changes anything
+  serializer.put("deleted", serialize(3, string("")));
+  serializer.put("deleted", serialize(2, string("")));
+  serializer.put("deleted", serialize(2, string("stale")));
+  EXPECT_TRUE(tombstones.pending("deleted"));
+
+  // a later write brings a key back
+  serializer.put("restored", serialize(1, string("")));
+  serializer.put("restored", serialize(2, string("value")));
+  EXPECT_FALSE(tombstones.pending("restored"));
+
+  tombstones.expire(std::chrono::steady_clock::now() +
+                        std::chrono::seconds(61),
+                    collected);
+  EXPECT_EQ(collected, vector<Key>({"deleted"}));
+}
+
+TEST_F(ServerHandlerTest, GossipCarriesTombstones) {
+  Key key = "key";
+  process_put(key, LatticeType::LWW, serialize(1, string("")),
+              serializers[LatticeType::LWW], stored_key_map,
+              storage_consumption);
+
+  AddressKeysetMap addr_keyset_map;
+  addr_keyset_map[wt.gossip_connect_address()].insert(key);
+  send_gossip(addr_keyset_map, pushers, serializers, stored_key_map);
+
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 1);
+
+  KeyRequest request;
+  request.ParseFromString(messages[0]);
+  EXPECT_EQ(request.tuples_size(), 1);
+  EXPECT_TRUE(wire_lww_tombstone(request.tuples(0).payload()));
+}
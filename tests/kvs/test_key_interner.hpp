@@ -0,0 +1,95 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/key_interner.hpp"
+
+TEST(KeyInternerTest, ReusesReleasedHandles) {
+  KeyInterner keys;
+
+  KeyHandle a = keys.acquire("a");
+  KeyHandle b = keys.acquire("b");
+  EXPECT_NE(a, b);
+  EXPECT_EQ(keys.acquire("a"), a);
+  EXPECT_EQ(keys.key(b), "b");
+
+  keys.release(a);
+  EXPECT_EQ(keys.size(), 2);
+  keys.release(a);
+  EXPECT_EQ(keys.size(), 1);
+
+  KeyHandle handle;
+  EXPECT_FALSE(keys.find("a", handle));
+  EXPECT_EQ(keys.acquire("c"), a);
+  EXPECT_TRUE(keys.find("c", handle));
+  EXPECT_EQ(handle, a);
+}
+
+TEST(KeyInternerTest, SetsAndMapsShareHandles) {
+  KeyInterner keys;
+  CacheKeyIndex index(&keys);
+  index.update("cache", vector<Key>{"a"});
+
+  {
+    KeyHandleSet changeset(&keys);
+    KeyHandleMap<vector<unsigned>> pending(&keys);
+
+    changeset.insert("a");
+    changeset.insert("a");
+    changeset.insert("b");
+    pending["a"].push_back(1);
+    pending["a"].push_back(2);
+
+    // every structure holds "a", but it is stored once
+    EXPECT_EQ(keys.size(), 2);
+    EXPECT_EQ(changeset.size(), 2);
+    EXPECT_EQ(*pending.find("a"), vector<unsigned>({1, 2}));
+    EXPECT_EQ(pending.find("b"), nullptr);
+
+    set<Key> members;
+    for (const Key &key : changeset) {
+      members.insert(key);
+    }
+    EXPECT_EQ(members, set<Key>({"a", "b"}));
+
+    pending.erase("a");
+    changeset.erase("b");
+    EXPECT_EQ(keys.size(), 1);
+  }
+
+  // the handles of the set and the map are released with them
+  index.remove_cache("cache");
+  EXPECT_EQ(keys.size(), 0);
+}
+
+TEST(KeyInternerTest, CacheIndexFollowsCacheKeyLists) {
+  KeyInterner keys;
+  CacheKeyIndex index(&keys);
+
+  index.update("cache1", vector<Key>{"a", "b", "b"});
+  index.update("cache2", vector<Key>{"b"});
+  EXPECT_EQ(*index.caches("a"), set<Address>({"cache1"}));
+  EXPECT_EQ(*index.caches("b"), set<Address>({"cache1", "cache2"}));
+
+  index.update("cache1", vector<Key>{"b", "c"});
+  EXPECT_EQ(index.caches("a"), nullptr);
+  EXPECT_EQ(*index.caches("c"), set<Address>({"cache1"}));
+  EXPECT_EQ(keys.size(), 2);
+
+  index.remove_cache("cache1");
+  EXPECT_EQ(*index.caches("b"), set<Address>({"cache2"}));
+  EXPECT_EQ(index.caches("c"), nullptr);
+
+  index.remove_cache("cache2");
+  EXPECT_EQ(keys.size(), 0);
+}
@@ -0,0 +1,213 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/log_store.hpp"
+
+class LogStoreTest : public ::testing::Test {
+protected:
+  string root;
+  LogStore *store;
+
+  // small segments, so that a few hundred puts exercise rolling and
+  // compaction
+  const uint64_t segment_size = 4096;
+
+  LogStoreTest() {
+    char dir[] = "/tmp/anna_log_store_XXXXXX";
+    root = string(mkdtemp(dir)) + "/";
+    store = new LogStore(root, segment_size);
+  }
+
+  virtual ~LogStoreTest() {
+    delete store;
+
+    DIR *dir = opendir(root.c_str());
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      std::remove((root + entry->d_name).c_str());
+    }
+
+    closedir(dir);
+    rmdir(root.c_str());
+  }
+
+  void restart() {
+    delete store;
+    store = new LogStore(root, segment_size);
+  }
+
+  string lww(unsigned long long ts, string value) {
+    LWWValue lww_value;
+    lww_value.set_timestamp(ts);
+    lww_value.set_value(value);
+
+    string serialized;
+    lww_value.SerializeToString(&serialized);
+    return serialized;
+  }
+};
+
+TEST_F(LogStoreTest, PutGetRemove) {
+  string value;
+  EXPECT_FALSE(store->get("key", value));
+
+  store->put("key", "value1");
+  store->put("key", "value2");
+  EXPECT_TRUE(store->get("key", value));
+  EXPECT_EQ(value, "value2");
+  EXPECT_EQ(store->key_count(), 1);
+
+  store->remove("key");
+  EXPECT_FALSE(store->get("key", value));
+  EXPECT_EQ(store->key_count(), 0);
+}
+
+TEST_F(LogStoreTest, RecoverAfterRestart) {
+  for (unsigned i = 0; i < 500; i++) {
+    store->put(std::to_string(i), "value" + std::to_string(i));
+  }
+
+  store->put("0", "overwritten");
+  store->remove("1");
+
+  EXPECT_GT(store->segment_count(), 1);
+  restart();
+
+  string value;
+  EXPECT_EQ(store->key_count(), 499);
+  EXPECT_TRUE(store->get("0", value));
+  EXPECT_EQ(value, "overwritten");
+  EXPECT_FALSE(store->get("1", value));
+  EXPECT_TRUE(store->get("499", value));
+  EXPECT_EQ(value, "value499");
+}
+
+TEST_F(LogStoreTest, CompactionReclaimsSegments) {
+  for (unsigned round = 0; round < 10; round++) {
+    for (unsigned i = 0; i < 50; i++) {
+      store->put(std::to_string(i), "round" + std::to_string(round));
+    }
+  }
+
+  store->remove("0");
+  uint64_t before = store->disk_bytes();
+
+  while (store->compact(kLogCompactionBatch)) {
+  }
+
+  EXPECT_LT(store->disk_bytes(), before);
+
+  // compaction must not lose live values or resurrect removed ones, even
+  // across a restart
+  restart();
+
+  string value;
+  EXPECT_EQ(store->key_count(), 49);
+  EXPECT_FALSE(store->get("0", value));
+  for (unsigned i = 1; i < 50; i++) {
+    EXPECT_TRUE(store->get(std::to_string(i), value));
+    EXPECT_EQ(value, "round9");
+  }
+}
+
+TEST_F(LogStoreTest, SerializerMerges) {
+  LogLWWSerializer serializer(store);
+  AnnaError error = AnnaError::NO_ERROR;
+
+  serializer.put("key", lww(2, "new"));
+  serializer.put("key", lww(1, "old"));
+
+  LWWValue value;
+  value.ParseFromString(serializer.get("key", error));
+  EXPECT_EQ(error, AnnaError::NO_ERROR);
+  EXPECT_EQ(value.value(), "new");
+
+  serializer.remove("key");
+  serializer.get("key", error);
+  EXPECT_EQ(error, AnnaError::KEY_DNE);
+}
+
+TEST_F(LogStoreTest, SetPutsAppendOrFoldOnce) {
+  LogSetSerializer serializer(store);
+  Key key = "set";
+
+  auto put = [&serializer, &key](unsigned first, unsigned count) {
+    SetValue value;
+    for (unsigned i = first; i < first + count; i++) {
+      value.add_values("element" + std::to_string(i));
+    }
+
+    string serialized;
+    value.SerializeToString(&serialized);
+    return serializer.put(key, serialized);
+  };
+
+  put(0, 1000);
+
+  // every put writes one record, whether it is appended as a delta or, once
+  // the deltas would pass the ratio, folded into a new base instead
+  unsigned folds = 0;
+  unsigned size = 0;
+
+  for (unsigned i = 0; i < 100; i++) {
+    uint64_t before = store->disk_bytes();
+    unsigned next = put(i * 10, 10);
+
+    EXPECT_EQ(store->disk_bytes() - before,
+              sizeof(LogRecordHeader) + key.size() + next);
+
+    if (next < size) {
+      folds += 1;
+    }
+
+    size = next;
+  }
+
+  EXPECT_GT(folds, 0);
+}
+
+TEST_F(LogStoreTest, CausalSerializerKeepsDominatingVersion) {
+  LogSingleKeyCausalSerializer serializer(store);
+  AnnaError error = AnnaError::NO_ERROR;
+
+  auto causal = [](std::map<string, uint32_t> clock, string value) {
+    SingleKeyCausalValue causal_value;
+    causal_value.mutable_vector_clock()->insert(clock.begin(), clock.end());
+    causal_value.add_values(value);
+
+    string serialized;
+    causal_value.SerializeToString(&serialized);
+    return serialized;
+  };
+
+  auto values = [&serializer, &error]() {
+    SingleKeyCausalValue causal_value;
+    causal_value.ParseFromString(serializer.get("key", error));
+    return vector<string>(causal_value.values().begin(),
+                          causal_value.values().end());
+  };
+
+  serializer.put("key", causal({{"a", 1}}, "first"));
+  serializer.put("key", causal({{"a", 2}}, "second"));
+  EXPECT_EQ(values(), vector<string>({"second"}));
+
+  // a dominated put leaves the value as it is
+  serializer.put("key", causal({{"a", 1}}, "stale"));
+  EXPECT_EQ(values(), vector<string>({"second"}));
+
+  // a concurrent put keeps both
+  serializer.put("key", causal({{"b", 1}}, "concurrent"));
+  EXPECT_EQ(values(), vector<string>({"concurrent", "second"}));
+  EXPECT_EQ(error, AnnaError::NO_ERROR);
+}
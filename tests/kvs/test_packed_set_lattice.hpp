@@ -0,0 +1,109 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/packed_set_lattice.hpp"
+
+PackedStringSet packed_set(const vector<string> &elements) {
+  SetValue value;
+  for (const string &element : elements) {
+    value.add_values(element);
+  }
+
+  string serialized;
+  value.SerializeToString(&serialized);
+  return PackedStringSet::decode(serialized);
+}
+
+ordered_set<string> unpack(const PackedStringSet &packed) {
+  ordered_set<string> result;
+  for (std::size_t i = 0; i < packed.size(); i++) {
+    result.insert(string(packed.at(i).data, packed.at(i).size));
+  }
+
+  EXPECT_EQ(result.size(), packed.size());
+  return result;
+}
+
+TEST(PackedSetLatticeTest, MergeMatchesOrderedSet) {
+  unsigned seed = 0;
+
+  // elements that share long prefixes, differ only past the first eight
+  // bytes, are empty, or contain zero bytes, mixed with random ones
+  vector<string> pool = {"",
+                         string(1, '\0'),
+                         string(2, '\0'),
+                         "a",
+                         string("a\0b", 3),
+                         "abcdefgh",
+                         "abcdefghi",
+                         "abcdefghj",
+                         string("abcdefgh\0", 9),
+                         "b"};
+  for (unsigned i = 0; i < 200; i++) {
+    pool.push_back("prefix/" + std::to_string(rand_r(&seed) % 1000));
+  }
+
+  for (unsigned round = 0; round < 50; round++) {
+    vector<string> left, right;
+    for (unsigned i = 0; i < rand_r(&seed) % 100; i++) {
+      left.push_back(pool[rand_r(&seed) % pool.size()]);
+    }
+    for (unsigned i = 0; i < rand_r(&seed) % 100; i++) {
+      right.push_back(pool[rand_r(&seed) % pool.size()]);
+    }
+
+    ordered_set<string> expected(left.begin(), left.end());
+    expected.insert(right.begin(), right.end());
+
+    PackedSetLattice lattice(packed_set(left));
+    lattice.merge(packed_set(right));
+
+    EXPECT_EQ(unpack(lattice.reveal()), expected);
+
+    // the elements are stored in std::set order
+    vector<string> stored;
+    for (std::size_t i = 0; i < lattice.reveal().size(); i++) {
+      stored.emplace_back(lattice.reveal().at(i).data,
+                          lattice.reveal().at(i).size);
+    }
+    EXPECT_TRUE(std::equal(stored.begin(), stored.end(), expected.begin()));
+
+    for (const string &element : pool) {
+      EXPECT_EQ(lattice.contains(element).reveal(),
+                expected.find(element) != expected.end());
+    }
+  }
+}
+
+TEST(PackedSetLatticeTest, SerializerRoundTrip) {
+  MemoryPackedSetKVS *kvs = new MemoryPackedSetKVS();
+  MemoryPackedSetSerializer serializer(kvs);
+
+  set<string> first = {"c", "a", "b"};
+  set<string> second = {"d", "a"};
+  serializer.put("key", serialize(SetLattice<string>(first)));
+  unsigned size = serializer.put("key", serialize(SetLattice<string>(second)));
+  EXPECT_GT(size, 4);
+
+  AnnaError error = AnnaError::NO_ERROR;
+  SetLattice<string> value = deserialize_set(serializer.get("key", error));
+  EXPECT_EQ(error, AnnaError::NO_ERROR);
+  EXPECT_EQ(value.reveal(), set<string>({"a", "b", "c", "d"}));
+
+  error = AnnaError::NO_ERROR;
+  serializer.get("missing", error);
+  EXPECT_EQ(error, AnnaError::KEY_DNE);
+
+  delete kvs;
+}
@@ -0,0 +1,55 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "periodic_timers.hpp"
+
+TEST(PeriodicTimersTest, RunsTasksInDeadlineOrder) {
+  PeriodicTimers timers;
+  SteadyTimePoint start;
+  vector<string> runs;
+
+  EXPECT_EQ(timers.next_deadline(), SteadyTimePoint::max());
+
+  timers.add(std::chrono::seconds(10), start,
+             [&runs](const SteadyTimePoint &) { runs.push_back("slow"); });
+  timers.add(std::chrono::seconds(3), start,
+             [&runs](const SteadyTimePoint &) { runs.push_back("fast"); });
+
+  EXPECT_EQ(timers.next_deadline(), start + std::chrono::seconds(3));
+
+  timers.run_due(start + std::chrono::seconds(2));
+  EXPECT_EQ(runs.size(), 0);
+
+  for (unsigned second = 3; second <= 10; second++) {
+    timers.run_due(start + std::chrono::seconds(second));
+  }
+
+  EXPECT_EQ(runs, vector<string>({"fast", "fast", "fast", "slow"}));
+  EXPECT_EQ(timers.next_deadline(), start + std::chrono::seconds(12));
+}
+
+TEST(PeriodicTimersTest, LateTaskRunsOnce) {
+  PeriodicTimers timers;
+  SteadyTimePoint start;
+  unsigned runs = 0;
+
+  timers.add(std::chrono::seconds(1), start,
+             [&runs](const SteadyTimePoint &) { runs += 1; });
+
+  // a loop that was busy for several periods catches up with one run, and
+  // the next is a full period after it
+  timers.run_due(start + std::chrono::seconds(5));
+  EXPECT_EQ(runs, 1);
+  EXPECT_EQ(timers.next_deadline(), start + std::chrono::seconds(6));
+}
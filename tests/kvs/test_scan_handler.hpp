@@ -0,0 +1,75 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/kvs_handlers.hpp"
+
+vector<Key> scan_keys(map<Key, KeyProperty> &stored_key_map,
+                      SocketCache &pushers, const string &start,
+                      const string &end, const string &prefix, unsigned limit,
+                      const string &continuation, string &next) {
+  ScanRequest request;
+  request.set_request_id("0");
+  request.set_response_address("tcp://127.0.0.1:7500");
+  request.set_start(start);
+  request.set_end(end);
+  request.set_prefix(prefix);
+  request.set_limit(limit);
+  request.set_continuation(continuation);
+
+  string serialized;
+  request.SerializeToString(&serialized);
+  scan_handler(serialized, stored_key_map, pushers);
+
+  ScanResponse response;
+  response.ParseFromString(mock_zmq_util.sent_messages.back());
+  next = response.continuation();
+  return vector<Key>(response.keys().begin(), response.keys().end());
+}
+
+TEST_F(ServerHandlerTest, ScanRangeAndPrefix) {
+  for (const char *key : {"a", "user:1", "user:2", "user:3", "video:1"}) {
+    stored_key_map[key] = {1, LatticeType::LWW};
+  }
+  stored_key_map[get_metadata_key("user:1", MetadataType::replication)] = {
+      1, LatticeType::LWW};
+
+  string next;
+  EXPECT_EQ(scan_keys(stored_key_map, pushers, "", "", "user:", 10, "", next),
+            vector<Key>({"user:1", "user:2", "user:3"}));
+  EXPECT_EQ(next, "");
+
+  EXPECT_EQ(
+      scan_keys(stored_key_map, pushers, "user:2", "video", "", 10, "", next),
+      vector<Key>({"user:2", "user:3"}));
+
+  EXPECT_EQ(get_zmq_messages().size(), 2);
+}
+
+TEST_F(ServerHandlerTest, ScanPagesWithContinuation) {
+  for (const char *key : {"k1", "k2", "k3", "k4", "k5"}) {
+    stored_key_map[key] = {1, LatticeType::LWW};
+  }
+
+  string next;
+  vector<Key> keys;
+
+  do {
+    vector<Key> page =
+        scan_keys(stored_key_map, pushers, "k2", "", "k", 2, next, next);
+    EXPECT_LE(page.size(), 2);
+    keys.insert(keys.end(), page.begin(), page.end());
+  } while (!next.empty());
+
+  EXPECT_EQ(keys, vector<Key>({"k2", "k3", "k4", "k5"}));
+}
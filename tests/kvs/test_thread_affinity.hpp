@@ -0,0 +1,53 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "thread_affinity.hpp"
+
+TEST(ThreadAffinityTest, ParsesCpuLists) {
+  vector<unsigned> cpus;
+  EXPECT_TRUE(parse_cpu_list("8,0-2,5", cpus));
+  EXPECT_EQ(cpus, vector<unsigned>({8, 0, 1, 2, 5}));
+
+  EXPECT_EQ(thread_cpu(cpus, 1), 0);
+  EXPECT_EQ(thread_cpu(cpus, 6), 0);
+
+  const vector<string> malformed = {"", "1,", "3-1", "1-", "a", "0-2x", "-1"};
+  for (const string &list : malformed) {
+    vector<unsigned> rejected;
+    EXPECT_FALSE(parse_cpu_list(list, rejected)) << list;
+  }
+}
+
+TEST(ThreadAffinityTest, HelpersAvoidPinnedCpus) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  sched_getaffinity(0, sizeof(cpus), &cpus);
+
+  vector<unsigned> all;
+  for (unsigned cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &cpus)) {
+      all.push_back(cpu);
+    }
+  }
+
+  // with every CPU pinned, helpers share them all
+  cpu_set_t helpers = helper_cpus(all);
+  EXPECT_TRUE(CPU_EQUAL(&helpers, &cpus));
+
+  if (all.size() > 1) {
+    helpers = helper_cpus({all[0]});
+    EXPECT_FALSE(CPU_ISSET(all[0], &helpers));
+    EXPECT_EQ(CPU_COUNT(&helpers), all.size() - 1);
+  }
+}
@@ -12,6 +12,8 @@
 //  See the License for the specific language governing permissions and
 //  limitations under the License.
 
+#include <poll.h>
+
 #include "kvs/kvs_handlers.hpp"
 
 TEST_F(ServerHandlerTest, UserGetLWWTest) {
@@ -29,8 +31,9 @@ TEST_F(ServerHandlerTest, UserGetLWWTest) {
 
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
-                       stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -49,7 +52,7 @@ TEST_F(ServerHandlerTest, UserGetLWWTest) {
 
   EXPECT_EQ(local_changeset.size(), 0);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 }
 
 TEST_F(ServerHandlerTest, UserGetSetTest) {
@@ -70,8 +73,9 @@ TEST_F(ServerHandlerTest, UserGetSetTest) {
 
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
-                       stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -90,7 +94,7 @@ TEST_F(ServerHandlerTest, UserGetSetTest) {
 
   EXPECT_EQ(local_changeset.size(), 0);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 }
 
 TEST_F(ServerHandlerTest, UserGetOrderedSetTest) {
@@ -112,8 +116,9 @@ TEST_F(ServerHandlerTest, UserGetOrderedSetTest) {
 
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
-                       stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -132,7 +137,7 @@ TEST_F(ServerHandlerTest, UserGetOrderedSetTest) {
 
   EXPECT_EQ(local_changeset.size(), 0);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 }
 
 TEST_F(ServerHandlerTest, UserGetCausalTest) {
@@ -157,8 +162,9 @@ TEST_F(ServerHandlerTest, UserGetCausalTest) {
 
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
-                       stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -207,7 +213,7 @@ TEST_F(ServerHandlerTest, UserGetCausalTest) {
 
   EXPECT_EQ(local_changeset.size(), 0);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 }
 
 TEST_F(ServerHandlerTest, UserPutAndGetLWWTest) {
@@ -223,8 +229,9 @@ TEST_F(ServerHandlerTest, UserPutAndGetLWWTest) {
 
   user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
-                       stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -242,14 +249,15 @@ TEST_F(ServerHandlerTest, UserPutAndGetLWWTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 
   string get_request = get_key_request(key, ip);
 
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
-                       stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
 
   messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 2);
@@ -267,7 +275,7 @@ TEST_F(ServerHandlerTest, UserPutAndGetLWWTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 2);
-  EXPECT_EQ(key_access_tracker[key].size(), 2);
+  EXPECT_EQ(key_access_tracker.count(key), 2);
 }
 
 TEST_F(ServerHandlerTest, UserPutAndGetSetTest) {
@@ -286,8 +294,9 @@ TEST_F(ServerHandlerTest, UserPutAndGetSetTest) {
 
   user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
-                       stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -305,14 +314,15 @@ TEST_F(ServerHandlerTest, UserPutAndGetSetTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 
   string get_request = get_key_request(key, ip);
 
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
-                       stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
 
   messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 2);
@@ -330,7 +340,7 @@ TEST_F(ServerHandlerTest, UserPutAndGetSetTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 2);
-  EXPECT_EQ(key_access_tracker[key].size(), 2);
+  EXPECT_EQ(key_access_tracker.count(key), 2);
 }
 
 TEST_F(ServerHandlerTest, UserPutAndGetOrderedSetTest) {
@@ -349,8 +359,9 @@ TEST_F(ServerHandlerTest, UserPutAndGetOrderedSetTest) {
 
   user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
-                       stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -368,14 +379,15 @@ TEST_F(ServerHandlerTest, UserPutAndGetOrderedSetTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 
   string get_request = get_key_request(key, ip);
 
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
-                       stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
 
   messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 2);
@@ -393,7 +405,7 @@ TEST_F(ServerHandlerTest, UserPutAndGetOrderedSetTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 2);
-  EXPECT_EQ(key_access_tracker[key].size(), 2);
+  EXPECT_EQ(key_access_tracker.count(key), 2);
 }
 
 TEST_F(ServerHandlerTest, UserPutAndGetCausalTest) {
@@ -415,8 +427,9 @@ TEST_F(ServerHandlerTest, UserPutAndGetCausalTest) {
 
   user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
-                       stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -434,14 +447,15 @@ TEST_F(ServerHandlerTest, UserPutAndGetCausalTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 
   string get_request = get_key_request(key, ip);
 
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
-                       stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
 
   messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 2);
@@ -489,9 +503,322 @@ TEST_F(ServerHandlerTest, UserPutAndGetCausalTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 2);
-  EXPECT_EQ(key_access_tracker[key].size(), 2);
+  EXPECT_EQ(key_access_tracker.count(key), 2);
 }
 
 // TODO: Test key address cache invalidation
 // TODO: Test replication factor request and making the request pending
 // TODO: Test metadata operations -- does this matter?
+
+TEST_F(ServerHandlerTest, UserAsyncPutGetTest) {
+  Key key = "key";
+  string value = "value";
+  string put_request = put_key_request(key, LatticeType::LWW,
+                                       serialize(0, value), ip);
+  string get_request = get_key_request(key, ip);
+
+  unsigned access_count = 0;
+  unsigned seed = 0;
+
+  AsyncDiskIO *disk_io = new AsyncDiskIO(serializers);
+
+  user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
+                       local_hash_rings, pending_requests, key_access_tracker,
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, disk_io,
+                       nullptr, false);
+  user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
+                       local_hash_rings, pending_requests, key_access_tracker,
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, disk_io,
+                       nullptr, false);
+
+  // nothing is sent until the disk operations complete
+  EXPECT_EQ(get_zmq_messages().size(), 0);
+  EXPECT_EQ(stored_key_map[key].type_, LatticeType::LWW);
+
+  while (get_zmq_messages().size() < 2) {
+    struct pollfd item = {disk_io->completion_fd(), POLLIN, 0};
+    poll(&item, 1, 1000);
+    disk_io->process_completions(stored_key_map, storage_consumption,
+                                 local_changeset, pushers);
+  }
+
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 2);
+
+  KeyResponse put_response;
+  put_response.ParseFromString(messages[0]);
+  EXPECT_EQ(put_response.type(), RequestType::PUT);
+  EXPECT_EQ(put_response.tuples(0).error(), 0);
+
+  KeyResponse get_response;
+  get_response.ParseFromString(messages[1]);
+  EXPECT_EQ(get_response.type(), RequestType::GET);
+  EXPECT_EQ(get_response.tuples(0).payload(), serialize(0, value));
+  EXPECT_EQ(get_response.tuples(0).error(), 0);
+
+  EXPECT_EQ(local_changeset.size(), 1);
+  EXPECT_EQ(access_count, 2);
+
+  delete disk_io;
+}
+
+TEST_F(ServerHandlerTest, UserAsyncPutOfRemovedKeyTest) {
+  Key key = "key";
+  string put_request = put_key_request(key, LatticeType::LWW,
+                                       serialize(0, "value"), ip);
+
+  unsigned access_count = 0;
+  unsigned seed = 0;
+
+  AsyncDiskIO *disk_io = new AsyncDiskIO(serializers);
+
+  // the event loop queues its own writes and removes, as the server does
+  SerializerMap queued = serializers;
+  queued.for_each([disk_io](LatticeType type, Serializer *&serializer) {
+    serializer = new QueuedSerializer(serializer, type, disk_io);
+  });
+
+  user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
+                       local_hash_rings, pending_requests, key_access_tracker,
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, queued, pushers, disk_io, nullptr,
+                       false);
+
+  // the key is dropped, e.g. by a join, while its write is in flight
+  remove_key(key, queued, stored_key_map, storage_consumption);
+
+  while (get_zmq_messages().size() < 1) {
+    struct pollfd item = {disk_io->completion_fd(), POLLIN, 0};
+    poll(&item, 1, 1000);
+    disk_io->process_completions(stored_key_map, storage_consumption,
+                                 local_changeset, pushers);
+  }
+
+  EXPECT_EQ(stored_key_map.find(key), stored_key_map.end());
+  EXPECT_EQ(storage_consumption, 0);
+  EXPECT_EQ(local_changeset.size(), 0);
+
+  AnnaError error = AnnaError::NO_ERROR;
+  queued[LatticeType::LWW]->get(key, error);
+  EXPECT_EQ(error, AnnaError::KEY_DNE);
+
+  queued.for_each(
+      [](LatticeType type, Serializer *&serializer) { delete serializer; });
+  delete disk_io;
+}
+
+TEST_F(ServerHandlerTest, AsyncGossipAfterQueuedPutTest) {
+  Key key = "key";
+  string value = serialize(0, "value");
+
+  AsyncDiskIO *disk_io = new AsyncDiskIO(serializers);
+
+  SerializerMap queued = serializers;
+  queued.for_each([disk_io](LatticeType type, Serializer *&serializer) {
+    serializer = new QueuedSerializer(serializer, type, disk_io);
+  });
+
+  // a gossiped write is queued, and the gossip of the same key reads it
+  // behind the write
+  process_put(key, LatticeType::LWW, value, queued[LatticeType::LWW],
+              stored_key_map, storage_consumption);
+
+  AddressKeysetMap addr_keyset_map;
+  addr_keyset_map[wt.gossip_connect_address()].insert(key);
+  send_gossip(addr_keyset_map, pushers, queued, stored_key_map, disk_io);
+
+  while (get_zmq_messages().size() < 1) {
+    struct pollfd item = {disk_io->completion_fd(), POLLIN, 0};
+    poll(&item, 1, 1000);
+    disk_io->process_completions(stored_key_map, storage_consumption,
+                                 local_changeset, pushers);
+  }
+
+  KeyRequest request;
+  request.ParseFromString(get_zmq_messages()[0]);
+  EXPECT_EQ(request.tuples_size(), 1);
+  EXPECT_EQ(request.tuples(0).key(), key);
+  EXPECT_EQ(request.tuples(0).payload(), value);
+
+  // the size is recorded once the write completes, but the write itself is
+  // not gossiped on
+  EXPECT_EQ(storage_consumption, stored_key_map[key].size_);
+  EXPECT_NE(storage_consumption, 0);
+  EXPECT_EQ(local_changeset.size(), 0);
+
+  queued.for_each(
+      [](LatticeType type, Serializer *&serializer) { delete serializer; });
+  delete disk_io;
+}
+
+TEST_F(ServerHandlerTest, UserPutUnderMemoryPressureTest) {
+  Key key = "key";
+  string put_request =
+      put_key_request(key, LatticeType::LWW, serialize(0, "value"), ip);
+
+  unsigned access_count = 0;
+  unsigned seed = 0;
+
+  user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
+                       local_hash_rings, pending_requests, key_access_tracker,
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, true);
+
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 1);
+
+  KeyResponse response;
+  response.ParseFromString(messages[0]);
+
+  EXPECT_EQ(response.tuples().size(), 1);
+  EXPECT_EQ(response.tuples(0).error(), AnnaError::TIMEOUT);
+
+  // the write was turned away without being stored
+  EXPECT_EQ(stored_key_map.count(key), 0);
+  EXPECT_EQ(local_changeset.size(), 0);
+}
+
+TEST_F(ServerHandlerTest, UserPutStorageAccountingTest) {
+  Key key = "key";
+  string value(1000, 'a');
+  unsigned access_count = 0;
+  unsigned seed = 0;
+
+  string put_request =
+      put_key_request(key, LatticeType::LWW, serialize(0, value), ip);
+  user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
+                       local_hash_rings, pending_requests, key_access_tracker,
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
+
+  // the size is in bytes, and covers the key and value
+  unsigned size = stored_key_map[key].size_;
+  EXPECT_GT(size, key.size() + value.size());
+  EXPECT_EQ(storage_consumption, size);
+
+  // a larger value replaces the old one in the running total
+  put_request =
+      put_key_request(key, LatticeType::LWW, serialize(1, value + value), ip);
+  user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
+                       local_hash_rings, pending_requests, key_access_tracker,
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
+
+  EXPECT_GT(stored_key_map[key].size_, size + value.size() - 1);
+  EXPECT_EQ(storage_consumption, stored_key_map[key].size_);
+
+  remove_key(key, serializers, stored_key_map, storage_consumption);
+  EXPECT_EQ(storage_consumption, 0);
+  EXPECT_EQ(stored_key_map.count(key), 0);
+}
+
+TEST_F(ServerHandlerTest, UserPutHeldUntilLogCommitTest) {
+  Key key = "key";
+  string put_request =
+      put_key_request(key, LatticeType::LWW, serialize(0, "value"), ip);
+  string get_request = get_key_request(key, ip);
+
+  unsigned access_count = 0;
+  unsigned seed = 0;
+
+  char dir[] = "/tmp/anna_wal_XXXXXX";
+  string root = string(mkdtemp(dir)) + "/";
+  WriteAheadLog *wal = new WriteAheadLog(root);
+  wal->recover(serializers, stored_key_map);
+
+  SerializerMap logged = serializers;
+  logged.for_each([wal](LatticeType type, Serializer *&serializer) {
+    serializer = new LoggedSerializer(serializer, type, wal);
+  });
+
+  user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
+                       local_hash_rings, pending_requests, key_access_tracker,
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, logged, pushers, nullptr, wal,
+                       false);
+
+  // the write is not acknowledged while its record is only buffered...
+  wal->release(pushers);
+  EXPECT_EQ(get_zmq_messages().size(), 0);
+
+  // ...but reads are answered right away
+  user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
+                       local_hash_rings, pending_requests, key_access_tracker,
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, logged, pushers, nullptr, wal,
+                       false);
+  EXPECT_EQ(get_zmq_messages().size(), 1);
+
+  // the response goes out once the commit has synced the record
+  wal->commit();
+  wal->release(pushers);
+
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 2);
+
+  KeyResponse response;
+  response.ParseFromString(messages[1]);
+  EXPECT_EQ(response.type(), RequestType::PUT);
+  EXPECT_EQ(response.tuples(0).error(), AnnaError::NO_ERROR);
+
+  logged.for_each(
+      [](LatticeType type, Serializer *&serializer) { delete serializer; });
+  delete wal;
+
+  DIR *root_dir = opendir(root.c_str());
+  struct dirent *entry;
+  while ((entry = readdir(root_dir)) != nullptr) {
+    std::remove((root + entry->d_name).c_str());
+  }
+
+  closedir(root_dir);
+  rmdir(root.c_str());
+}
+
+TEST_F(ServerHandlerTest, UserRequestBatchTest) {
+  serializers[LatticeType::LWW]->put("a", serialize(0, "value"));
+  stored_key_map["a"].type_ = LatticeType::LWW;
+  serializers[LatticeType::LWW]->put("b", serialize(0, "value"));
+  stored_key_map["b"].type_ = LatticeType::LWW;
+
+  unsigned access_count = 0;
+  unsigned seed = 0;
+
+  // a batch as the event loop drains it: two requests that share an id, and
+  // one with another id
+  vector<string> requests = {get_key_request("a", ip), get_key_request("b", ip),
+                             get_key_request("a", ip)};
+  KeyRequest request;
+  request.ParseFromString(requests[2]);
+  request.set_request_id("other");
+  request.SerializeToString(&requests[2]);
+
+  for (string &serialized : requests) {
+    user_request_handler(access_count, seed, serialized, log_,
+                         global_hash_rings, local_hash_rings, pending_requests,
+                         key_access_tracker, stored_key_map,
+                         storage_consumption, key_replication_map,
+                         local_changeset, wt, serializers, pushers, nullptr,
+                         nullptr, false);
+  }
+
+  // every request gets a response of its own, in order
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 3);
+
+  vector<string> ids = {kRequestId, kRequestId, "other"};
+  vector<Key> keys = {"a", "b", "a"};
+
+  for (unsigned i = 0; i < messages.size(); i++) {
+    KeyResponse response;
+    response.ParseFromString(messages[i]);
+    EXPECT_EQ(response.response_id(), ids[i]);
+    EXPECT_EQ(response.tuples_size(), 1);
+    EXPECT_EQ(response.tuples(0).key(), keys[i]);
+  }
+}
@@ -0,0 +1,81 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/value_cache.hpp"
+
+const std::size_t kTestCacheCapacity = 100000;
+
+TEST(ValueCacheTest, HitsMissesAndInvalidation) {
+  ValueCache cache(kTestCacheCapacity);
+  string value;
+
+  EXPECT_FALSE(cache.get("key", value));
+  cache.put("key", "value");
+  EXPECT_TRUE(cache.get("key", value));
+  EXPECT_EQ(value, "value");
+
+  cache.remove("key");
+  EXPECT_FALSE(cache.get("key", value));
+
+  EXPECT_EQ(cache.hits(), 1);
+  EXPECT_EQ(cache.misses(), 2);
+
+  cache.reset_counters();
+  EXPECT_EQ(cache.hits(), 0);
+  EXPECT_EQ(cache.misses(), 0);
+}
+
+TEST(ValueCacheTest, StaysWithinCapacity) {
+  ValueCache cache(kTestCacheCapacity);
+  string value;
+
+  for (unsigned i = 0; i < 10000; i++) {
+    Key key = std::to_string(i);
+    cache.get(key, value);
+    cache.put(key, string(100, 'a'));
+  }
+
+  EXPECT_LE(cache.bytes(), kTestCacheCapacity);
+  EXPECT_GT(cache.bytes(), 0);
+}
+
+TEST(ValueCacheTest, HotKeysSurviveScan) {
+  ValueCache cache(kTestCacheCapacity);
+  string value;
+
+  // a working set of hot keys that fits comfortably in the cache
+  for (unsigned round = 0; round < 5; round++) {
+    for (unsigned i = 0; i < 100; i++) {
+      Key key = "hot" + std::to_string(i);
+      if (!cache.get(key, value)) {
+        cache.put(key, string(100, 'h'));
+      }
+    }
+  }
+
+  // a scan over many keys that are each read exactly once
+  for (unsigned i = 0; i < 10000; i++) {
+    Key key = "cold" + std::to_string(i);
+    if (!cache.get(key, value)) {
+      cache.put(key, string(100, 'c'));
+    }
+  }
+
+  cache.reset_counters();
+  for (unsigned i = 0; i < 100; i++) {
+    cache.get("hot" + std::to_string(i), value);
+  }
+
+  EXPECT_GT(cache.hits(), 90);
+}
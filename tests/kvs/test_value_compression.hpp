@@ -0,0 +1,155 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <random>
+
+#include "kvs/kvs_handlers.hpp"
+
+// a value that compresses well, as JSON documents do
+string compressible_value(unsigned size) {
+  string value;
+
+  while (value.size() < size) {
+    value += "{\"id\": " + std::to_string(value.size() % 97) +
+             ", \"name\": \"anna\"}";
+  }
+
+  return value;
+}
+
+TEST(ValueCompressionTest, FramesLookalikeValues) {
+  ValueCompressor compressor;
+  string lookalike = kCompressedMagic + "value";
+
+  string packed = compressor.pack(LatticeType::LWW, serialize(1, lookalike));
+  EXPECT_NE(packed, serialize(1, lookalike));
+  EXPECT_EQ(compressor.unpack(LatticeType::LWW, packed),
+            serialize(1, lookalike));
+
+  // everything else is left alone
+  EXPECT_EQ(compressor.pack(LatticeType::LWW, serialize(1, "value")),
+            serialize(1, "value"));
+  EXPECT_EQ(compressor.pack(LatticeType::LWW, serialize(1, "")),
+            serialize(1, ""));
+  EXPECT_EQ(compressor.unpack(LatticeType::LWW, serialize(1, "value")),
+            serialize(1, "value"));
+}
+
+TEST(ValueCompressionTest, CompressesLargeValues) {
+  string value = compressible_value(65536);
+
+  for (ValueCodec codec : {ValueCodec::LZ4, ValueCodec::ZSTD}) {
+    if (!value_codec_available(codec)) {
+      continue;
+    }
+
+    ValueCompressor compressor(codec, 4096);
+
+    // small and incompressible values are stored as they are
+    EXPECT_EQ(compressor.pack(LatticeType::LWW, serialize(1, "value")),
+              serialize(1, "value"));
+    std::mt19937 rng(0);
+    string noise;
+    for (unsigned i = 0; i < 8192; i++) {
+      noise.push_back((char)rng());
+    }
+    EXPECT_EQ(compressor.pack(LatticeType::LWW, serialize(1, noise)),
+              serialize(1, noise));
+
+    string packed = compressor.pack(LatticeType::LWW, serialize(7, value));
+    EXPECT_LT(packed.size(), value.size() / 4);
+
+    uint64_t timestamp;
+    wire_lww_timestamp(packed, timestamp);
+    EXPECT_EQ(timestamp, 7);
+
+    // unpacking does not depend on how the reader is configured
+    EXPECT_EQ(ValueCompressor().unpack(LatticeType::LWW, packed),
+              serialize(7, value));
+  }
+}
+
+TEST_F(ServerHandlerTest, UserPutStoresCompressedValues) {
+  if (!value_codec_available(ValueCodec::LZ4)) {
+    return;
+  }
+
+  kValueCompressor = ValueCompressor(ValueCodec::LZ4, 4096);
+  Key key = "key";
+  string value = compressible_value(65536);
+  unsigned access_count = 0;
+  unsigned seed = 0;
+
+  string put_request =
+      put_key_request(key, LatticeType::LWW, serialize(0, value), ip);
+  user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
+                       local_hash_rings, pending_requests, key_access_tracker,
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
+
+  // the stored value, which is also what is gossiped, stays compressed
+  EXPECT_LT(stored_key_map[key].size_, value.size() / 4);
+  auto stored = process_get(key, serializers[LatticeType::LWW]);
+  EXPECT_LT(stored.first.size(), value.size() / 4);
+
+  string get_request = get_key_request(key, ip);
+  user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
+                       local_hash_rings, pending_requests, key_access_tracker,
+                       stored_key_map, storage_consumption, key_replication_map,
+                       local_changeset, wt, serializers, pushers, nullptr,
+                       nullptr, false);
+
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 2);
+
+  KeyResponse response;
+  response.ParseFromString(messages[1]);
+  EXPECT_EQ(response.tuples(0).payload(), serialize(0, value));
+
+  kValueCompressor = ValueCompressor();
+}
+
+TEST_F(ServerHandlerTest, GossipUnpacksValuesForCaches) {
+  if (!value_codec_available(ValueCodec::LZ4)) {
+    return;
+  }
+
+  kValueCompressor = ValueCompressor(ValueCodec::LZ4, 4096);
+  Key key = "key";
+  string value = serialize(0, compressible_value(65536));
+  process_put(key, LatticeType::LWW, kValueCompressor.pack(LatticeType::LWW,
+                                                           value),
+              serializers[LatticeType::LWW], stored_key_map,
+              storage_consumption);
+
+  AddressKeysetMap addr_keyset_map;
+  addr_keyset_map[wt.gossip_connect_address()].insert(key);
+  send_gossip(addr_keyset_map, pushers, serializers, stored_key_map);
+  send_gossip(addr_keyset_map, pushers, serializers, stored_key_map, nullptr,
+              true);
+
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 2);
+
+  // other servers get the stored frame, caches the value the client put
+  KeyRequest request;
+  request.ParseFromString(messages[0]);
+  EXPECT_LT(request.tuples(0).payload().size(), value.size() / 4);
+
+  request.ParseFromString(messages[1]);
+  EXPECT_EQ(request.tuples(0).payload(), value);
+
+  kValueCompressor = ValueCompressor();
+}
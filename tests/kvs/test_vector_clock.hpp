@@ -0,0 +1,138 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/vector_clock.hpp"
+
+TEST(VectorClockTest, MergeTakesPointwiseMax) {
+  ClientTable clients(0);
+  auto now = std::chrono::system_clock::now();
+  unsigned seed = 0;
+
+  for (unsigned round = 0; round < 20; round++) {
+    std::map<string, uint32_t> left, right;
+
+    for (unsigned i = 0; i < 50; i++) {
+      left["client" + std::to_string(rand_r(&seed) % 80)] = rand_r(&seed) % 10;
+      right["client" + std::to_string(rand_r(&seed) % 80)] = rand_r(&seed) % 10;
+    }
+
+    // every other round, both clocks have the same clients
+    if (round % 2 == 0) {
+      for (const auto &pair : left) {
+        right.insert({pair.first, 0});
+      }
+      for (const auto &pair : right) {
+        left.insert({pair.first, 0});
+      }
+    }
+
+    std::map<string, uint32_t> expected = left;
+    for (const auto &pair : right) {
+      expected[pair.first] = std::max(expected[pair.first], pair.second);
+    }
+
+    CompactVectorClock clock, other;
+    clock.parse(left, clients);
+    other.parse(right, clients);
+    clock.merge(other, clients, now);
+
+    std::map<string, uint32_t> merged;
+    clock.write(&merged, clients);
+    EXPECT_EQ(merged, expected);
+    EXPECT_EQ(clock.size(), expected.size());
+  }
+}
+
+TEST(VectorClockTest, PrunesRetiredClients) {
+  ClientTable clients(10);
+  auto start = std::chrono::system_clock::now();
+  auto at = [&start](unsigned seconds) {
+    return start + std::chrono::seconds(seconds);
+  };
+
+  std::map<string, uint32_t> stored = {{"idle", 3}, {"active", 1}};
+  std::map<string, uint32_t> merged;
+
+  // merges a put into the stored clock at a given time, as the disk
+  // serializers do
+  auto put = [&](const std::map<string, uint32_t> &input, unsigned seconds) {
+    clients.expire(at(seconds));
+
+    CompactVectorClock clock, update;
+    clock.parse(stored, clients);
+    update.parse(input, clients);
+    clock.merge(update, clients, at(seconds));
+
+    merged.clear();
+    clock.write(&merged, clients);
+  };
+
+  // only "active" advances; "idle" is merely repeated, as by gossip
+  put({{"idle", 3}, {"active", 2}}, 8);
+  EXPECT_EQ(merged, (std::map<string, uint32_t>{{"active", 2}, {"idle", 3}}));
+
+  // past the horizon, the idle client is retired, so neither the stored
+  // clock nor the put brings it back
+  put({{"idle", 3}, {"active", 3}}, 12);
+  EXPECT_EQ(merged, (std::map<string, uint32_t>{{"active", 3}}));
+
+  // after a second horizon it is forgotten, and starts over
+  put({{"active", 4}}, 20);
+  clients.expire(at(23));
+  EXPECT_EQ(clients.size(), 1);
+
+  put({{"idle", 1}}, 23);
+  EXPECT_EQ(merged, (std::map<string, uint32_t>{{"active", 1}, {"idle", 3}}));
+}
+
+TEST(VectorClockTest, RetiredClientWritesAgain) {
+  ClientTable clients(10);
+  auto start = std::chrono::system_clock::now();
+
+  std::map<string, uint32_t> stored = {{"client", 3}};
+  std::map<string, uint32_t> merged;
+
+  // merges a put into the stored clock at a given time, as the disk
+  // serializers do, and returns whether the put wins outright
+  auto put = [&](const std::map<string, uint32_t> &input, unsigned seconds) {
+    auto now = start + std::chrono::seconds(seconds);
+    clients.expire(now);
+
+    CompactVectorClock clock, update;
+    clock.parse(stored, clients);
+    update.parse(input, clients);
+    clock.merge(update, clients, now);
+
+    merged.clear();
+    clock.write(&merged, clients);
+    stored = merged;
+    return clock == update;
+  };
+
+  EXPECT_TRUE(put({{"client", 3}}, 0));
+
+  // the client pauses for longer than the horizon and is retired; its pruned
+  // entry, gossiped back, stays pruned...
+  EXPECT_TRUE(put({{"client", 3}}, 12));
+  EXPECT_EQ(merged, (std::map<string, uint32_t>{}));
+
+  // ...but its next write is newer than anything pruned, so it brings the
+  // client back and wins
+  EXPECT_TRUE(put({{"client", 4}}, 13));
+  EXPECT_EQ(merged, (std::map<string, uint32_t>{{"client", 4}}));
+
+  // and the client is active again, so its entries are no longer dropped
+  EXPECT_FALSE(put({{"client", 3}}, 14));
+  EXPECT_EQ(merged, (std::map<string, uint32_t>{{"client", 4}}));
+}
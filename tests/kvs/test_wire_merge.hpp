@@ -0,0 +1,76 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/wire_merge.hpp"
+
+string encode_set(const vector<string> &elements) {
+  SetValue value;
+  for (const string &element : elements) {
+    value.add_values(element);
+  }
+
+  string serialized;
+  value.SerializeToString(&serialized);
+  return serialized;
+}
+
+TEST(WireMergeTest, ReadsTimestampAndPriority) {
+  LWWValue lww;
+  lww.set_timestamp(1ULL << 40);
+  lww.set_value(string(300, 'a'));
+
+  string serialized;
+  lww.SerializeToString(&serialized);
+
+  uint64_t timestamp;
+  EXPECT_TRUE(wire_lww_timestamp(serialized, timestamp));
+  EXPECT_EQ(timestamp, 1ULL << 40);
+
+  PriorityValue priority;
+  priority.set_priority(2.5);
+  priority.set_value("value");
+  priority.SerializeToString(&serialized);
+
+  double value;
+  EXPECT_TRUE(wire_priority(serialized, value));
+  EXPECT_EQ(value, 2.5);
+
+  // an unset field decodes to its default, and truncated input is rejected
+  EXPECT_TRUE(wire_lww_timestamp("", timestamp));
+  EXPECT_EQ(timestamp, 0);
+  EXPECT_FALSE(wire_lww_timestamp(serialized.substr(0, 4), timestamp));
+}
+
+TEST(WireMergeTest, SetUnion) {
+  // unsorted input with duplicates, as a client may send it
+  string left = encode_set({"c", "a", string(200, 'z'), "a"});
+  string right = encode_set({"b", "c", "", "ab"});
+
+  string merged;
+  ASSERT_TRUE(wire_set_union(left, right, merged));
+
+  SetValue value;
+  ASSERT_TRUE(value.ParseFromString(merged));
+
+  vector<string> elements(value.values().begin(), value.values().end());
+  vector<string> expected = {"", "a", "ab", "b", "c", string(200, 'z')};
+  EXPECT_EQ(elements, expected);
+
+  // merging a value with itself changes nothing
+  string again;
+  ASSERT_TRUE(wire_set_union(merged, merged, again));
+  EXPECT_EQ(again, merged);
+
+  EXPECT_FALSE(wire_set_union(left, right.substr(0, right.size() - 1), merged));
+}
@@ -0,0 +1,218 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/write_ahead_log.hpp"
+
+class WriteAheadLogTest : public ::testing::Test {
+protected:
+  string root;
+  WriteAheadLog *wal;
+  MemoryLWWKVS *lww_kvs;
+  Serializer *lww_serializer;
+  SerializerMap serializers;
+  map<Key, KeyProperty> stored_key_map;
+
+  WriteAheadLogTest() : wal(nullptr), lww_kvs(nullptr) {
+    char dir[] = "/tmp/anna_wal_XXXXXX";
+    root = string(mkdtemp(dir)) + "/";
+    restart();
+  }
+
+  virtual ~WriteAheadLogTest() {
+    shutdown();
+
+    DIR *dir = opendir(root.c_str());
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      std::remove((root + entry->d_name).c_str());
+    }
+
+    closedir(dir);
+    rmdir(root.c_str());
+  }
+
+  void shutdown() {
+    delete wal;
+    delete serializers[LatticeType::LWW];
+    delete lww_serializer;
+    delete lww_kvs;
+  }
+
+  // simulates a process restart: the in-memory state is lost, and rebuilt
+  // from the files the previous log left behind
+  void restart() {
+    if (wal != nullptr) {
+      shutdown();
+    }
+
+    stored_key_map.clear();
+    lww_kvs = new MemoryLWWKVS();
+
+    lww_serializer = new MemoryLWWSerializer(lww_kvs);
+    serializers[LatticeType::LWW] = lww_serializer;
+
+    wal = new WriteAheadLog(root);
+    wal->recover(serializers, stored_key_map);
+
+    serializers[LatticeType::LWW] =
+        new LoggedSerializer(lww_serializer, LatticeType::LWW, wal);
+  }
+
+  void put(const Key &key, unsigned long long ts, const string &value) {
+    LWWValue lww_value;
+    lww_value.set_timestamp(ts);
+    lww_value.set_value(value);
+
+    string serialized;
+    lww_value.SerializeToString(&serialized);
+
+    stored_key_map[key].size_ =
+        serializers[LatticeType::LWW]->put(key, serialized);
+    stored_key_map[key].type_ = LatticeType::LWW;
+  }
+
+  void remove(const Key &key) {
+    serializers[LatticeType::LWW]->remove(key);
+    stored_key_map.erase(key);
+  }
+
+  string value(const Key &key) {
+    AnnaError error = AnnaError::NO_ERROR;
+    LWWValue lww_value;
+    lww_value.ParseFromString(serializers[LatticeType::LWW]->get(key, error));
+    return lww_value.value();
+  }
+
+  unsigned count_files(const string &suffix) {
+    unsigned count = 0;
+    DIR *dir = opendir(root.c_str());
+    struct dirent *entry;
+
+    while ((entry = readdir(dir)) != nullptr) {
+      string name = entry->d_name;
+      if (name.size() > suffix.size() &&
+          name.compare(name.size() - suffix.size(), suffix.size(), suffix) ==
+              0) {
+        count += 1;
+      }
+    }
+
+    closedir(dir);
+    return count;
+  }
+};
+
+TEST_F(WriteAheadLogTest, ReplaysPutsAndRemoves) {
+  put("a", 1, "first");
+  put("a", 2, "second");
+  put("b", 1, "value");
+  put("c", 1, "value");
+  remove("c");
+  wal->commit();
+
+  restart();
+
+  EXPECT_EQ(stored_key_map.size(), 2);
+  EXPECT_EQ(stored_key_map["a"].type_, LatticeType::LWW);
+  EXPECT_EQ(value("a"), "second");
+  EXPECT_EQ(value("b"), "value");
+  EXPECT_EQ(stored_key_map.count("c"), 0);
+}
+
+TEST_F(WriteAheadLogTest, SnapshotReplacesOlderLogs) {
+  for (unsigned i = 0; i < 2500; i++) {
+    put(std::to_string(i), 1, "old");
+  }
+
+  wal->begin_snapshot(stored_key_map);
+
+  // writes made while the snapshot is in progress land in the new segment
+  put("0", 2, "new");
+  remove("1");
+
+  while (wal->snapshotting()) {
+    wal->continue_snapshot(serializers, stored_key_map);
+  }
+
+  EXPECT_EQ(count_files(".snap"), 1);
+  EXPECT_EQ(count_files(".wal"), 1);
+
+  put("2", 2, "after");
+  wal->commit();
+  restart();
+
+  EXPECT_EQ(stored_key_map.size(), 2499);
+  EXPECT_EQ(value("0"), "new");
+  EXPECT_EQ(stored_key_map.count("1"), 0);
+  EXPECT_EQ(value("2"), "after");
+  EXPECT_EQ(value("2499"), "old");
+}
+
+TEST_F(WriteAheadLogTest, SnapshotKeepsTombstones) {
+  put("a", 1, "value");
+  put("a", 2, "");
+
+  wal->begin_snapshot(stored_key_map);
+  while (wal->snapshotting()) {
+    wal->continue_snapshot(serializers, stored_key_map);
+  }
+
+  EXPECT_EQ(count_files(".wal"), 1);
+  restart();
+
+  // the delete outlives the segments it was logged in, so the older value
+  // cannot win a merge again
+  EXPECT_EQ(stored_key_map.count("a"), 1);
+  put("a", 1, "value");
+
+  AnnaError error = AnnaError::NO_ERROR;
+  LWWValue lww_value;
+  lww_value.ParseFromString(serializers[LatticeType::LWW]->get("a", error));
+  EXPECT_EQ(error, AnnaError::KEY_DNE);
+  EXPECT_EQ(lww_value.timestamp(), 2);
+}
+
+TEST_F(WriteAheadLogTest, IgnoresTornTail) {
+  put("a", 1, "value");
+  put("b", 1, "value");
+  wal->commit();
+
+  // cut the last record in half, as a crash in the middle of a write would
+  string segment = root + "log_0.wal";
+  struct stat st;
+  stat(segment.c_str(), &st);
+  EXPECT_EQ(truncate(segment.c_str(), st.st_size - 3), 0);
+
+  restart();
+
+  EXPECT_EQ(stored_key_map.size(), 1);
+  EXPECT_EQ(value("a"), "value");
+}
+
+TEST_F(WriteAheadLogTest, CommitDeadlineFollowsOldestRecord) {
+  SteadyTimePoint deadline;
+  EXPECT_FALSE(wal->commit_deadline(deadline));
+
+  auto before = std::chrono::steady_clock::now();
+  put("a", 1, "value");
+  put("b", 1, "value");
+
+  EXPECT_TRUE(wal->commit_deadline(deadline));
+  EXPECT_GE(deadline, before + std::chrono::microseconds(kWalCommitInterval));
+  EXPECT_LE(deadline, std::chrono::steady_clock::now() +
+                          std::chrono::microseconds(kWalCommitInterval));
+
+  wal->commit();
+  EXPECT_FALSE(wal->commit_deadline(deadline));
+}
@@ -28,6 +28,7 @@
 #include "test_membership_handler.hpp"
 #include "test_replication_change_handler.hpp"
 #include "test_replication_response_handler.hpp"
+#include "test_scan_handler.hpp"
 #include "test_seed_handler.hpp"
 
 unsigned kDefaultLocalReplication = 1;
@@ -0,0 +1,106 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "route/routing_handlers.hpp"
+
+string scan_response(const string &request_id, vector<Key> keys,
+                     const string &continuation) {
+  ScanResponse response;
+  response.set_request_id(request_id);
+  response.set_continuation(continuation);
+
+  for (const Key &key : keys) {
+    response.add_keys(key);
+  }
+
+  string serialized;
+  response.SerializeToString(&serialized);
+  return serialized;
+}
+
+TEST_F(RoutingHandlerTest, ScanMergesStorageThreads) {
+  global_hash_rings[Tier::MEMORY].insert("127.0.0.2", "127.0.0.2", 0, 0);
+  map<string, PendingScan> pending_scans;
+  unsigned scan_id = 0;
+
+  ScanRequest request;
+  request.set_request_id("1");
+  request.set_response_address("tcp://127.0.0.1:5000");
+  request.set_prefix("user:");
+  request.set_limit(3);
+
+  string serialized;
+  request.SerializeToString(&serialized);
+  scan_handler(log_, serialized, pushers, rt, global_hash_rings, pending_scans,
+               scan_id);
+
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 2);
+  EXPECT_EQ(pending_scans.size(), 1);
+
+  ScanRequest sent;
+  sent.ParseFromString(messages[0]);
+  EXPECT_EQ(sent.response_address(), rt.scan_response_connect_address());
+  EXPECT_EQ(sent.prefix(), "user:");
+
+  string first = scan_response(sent.request_id(), {"user:1", "user:4"}, "");
+  scan_response_handler(first, pushers, pending_scans);
+  EXPECT_EQ(get_zmq_messages().size(), 2);
+
+  string second =
+      scan_response(sent.request_id(), {"user:2", "user:3", "user:4"}, "user:4");
+  scan_response_handler(second, pushers, pending_scans);
+  EXPECT_EQ(pending_scans.size(), 0);
+
+  messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 3);
+
+  ScanResponse response;
+  response.ParseFromString(messages[2]);
+  EXPECT_EQ(response.request_id(), "1");
+  EXPECT_EQ(vector<Key>(response.keys().begin(), response.keys().end()),
+            vector<Key>({"user:1", "user:2", "user:3"}));
+  EXPECT_EQ(response.continuation(), "user:3");
+  EXPECT_FALSE(response.incomplete());
+}
+
+TEST_F(RoutingHandlerTest, ScanTimesOut) {
+  map<string, PendingScan> pending_scans;
+  unsigned scan_id = 0;
+
+  ScanRequest request;
+  request.set_request_id("1");
+  request.set_response_address("tcp://127.0.0.1:5000");
+
+  string serialized;
+  request.SerializeToString(&serialized);
+  scan_handler(log_, serialized, pushers, rt, global_hash_rings, pending_scans,
+               scan_id);
+
+  expire_scans(log_, pushers, pending_scans);
+  EXPECT_EQ(pending_scans.size(), 1);
+
+  pending_scans.begin()->second.deadline_ = std::chrono::steady_clock::now();
+  expire_scans(log_, pushers, pending_scans);
+  EXPECT_EQ(pending_scans.size(), 0);
+
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 2);
+
+  ScanResponse response;
+  response.ParseFromString(messages[1]);
+  EXPECT_EQ(response.request_id(), "1");
+  EXPECT_EQ(response.keys_size(), 0);
+  EXPECT_TRUE(response.incomplete());
+}